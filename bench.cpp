@@ -0,0 +1,407 @@
+#include "expression.hpp"
+#include "parser.hpp"
+#include "flat.hpp"
+#include "polynomial.hpp"
+#include "builder.hpp"
+#include "stream.hpp"
+#include "group.hpp"
+#include "egraph.hpp"
+#include "budget.hpp"
+#include "tiered.hpp"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <functional>
+#include <map>
+
+// runs f the given number of times, returns nanoseconds per call
+double measure(size_t runs, const std::function<long double(size_t)>& f){
+    volatile long double sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < runs; i++){
+        sink = sink + f(i);
+    }
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / runs;
+}
+
+void bench_flat(){
+    std::cout << "virtual tree vs flat expression\n";
+
+    Expressions::Expression<long double> f("sin(x) * cos(y) + ln(x + 2) * exp(y / 3) - x ^ 2 / (y + 1)");
+    std::vector<Expressions::Expression<long double>> trees{f, f.diff("x"), f.diff("x").diff("y")};
+    std::vector<std::string> names{"f", "df/dx", "d2f/dxdy"};
+
+    const size_t runs = 20000;
+    for (size_t t = 0; t < trees.size(); t++){
+        Expressions::Expression<long double>& tree = trees[t];
+        Expressions::FlatExpression<long double> flat(tree);
+        Expressions::Expression<long double> resolved_tree = tree.evaluate({"x", "y"}, {1.25, 0.5});
+
+        // slot order of the flat expression
+        std::vector<long double> values;
+        for (const std::string& var : flat.variables()){ values.push_back(var == "x" ? 1.25 : 0.5); }
+
+        double eval_ns = measure(runs, [&](size_t i){ return tree.eval_and_resolve({"x", "y"}, {1.25 + i * 1e-9L, 0.5}); });
+        double tree_ns = measure(runs, [&](size_t){ return resolved_tree.resolve(); });
+        double flat_ns = measure(runs, [&](size_t i){ values[0] += 1e-9L; return flat.resolve(values); });
+
+        std::cout << "  " << names[t] << " (" << flat.size() << " flat nodes)\n"
+                  << "    eval_and_resolve:  " << eval_ns << " ns\n"
+                  << "    tree resolve:      " << tree_ns << " ns\n"
+                  << "    flat resolve:      " << flat_ns << " ns\n";
+    }
+}
+
+void bench_sample(){
+    std::cout << "tabulating 10^5 points\n";
+
+    Expressions::Expression<long double> f("sin(x) * cos(y) + ln(y + 2) * exp(y / 3) - x ^ 2 / (y + 1)");
+    const size_t n = 100000;
+    std::vector<long double> out(n);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++){
+        out[i] = f.eval_and_resolve({"x", "y"}, {10.0L * i / (n - 1), 0.5});
+    }
+    auto middle = std::chrono::steady_clock::now();
+    f.sample("x", 0, 10, n, out.data(), {"y"}, {0.5});
+    auto stop = std::chrono::steady_clock::now();
+
+    std::cout << "    eval_and_resolve loop: " << std::chrono::duration<double, std::milli>(middle - start).count() << " ms\n"
+              << "    sample:                " << std::chrono::duration<double, std::milli>(stop - middle).count() << " ms\n";
+}
+
+void bench_precision(){
+    std::cout << "flat resolve by precision\n";
+
+    Expressions::Expression<long double> f("sin(x) * cos(y) + ln(x + 2) * exp(y / 3) - x ^ 2 / (y + 1)");
+    Expressions::Expression<long double> df = f.diff("x").diff("y");
+    Expressions::FlatExpression<long double> flat_ld(df);
+    Expressions::FlatExpression<double> flat_d(df.convert<double>());
+    Expressions::FlatExpression<float> flat_f(df.convert<float>());
+
+    std::vector<long double> ld(flat_ld.variables().size(), 0.5L);
+    std::vector<double> d(flat_d.variables().size(), 0.5);
+    std::vector<float> f32(flat_f.variables().size(), 0.5f);
+
+    const size_t runs = 20000;
+    std::cout << "    long double: " << measure(runs, [&](size_t){ ld[0] += 1e-9L; return flat_ld.resolve(ld); }) << " ns\n"
+              << "    double:      " << measure(runs, [&](size_t){ d[0] += 1e-9; return flat_d.resolve(d); }) << " ns\n"
+              << "    float:       " << measure(runs, [&](size_t){ f32[0] += 1e-6f; return flat_f.resolve(f32); }) << " ns\n";
+}
+
+void bench_polynomial(){
+    std::cout << "polynomial form\n";
+
+    Expressions::Expression<long double> f("(x + 1) ^ 3 * (x - 2) ^ 2 + 3 * x * y ^ 2 - (y + x) * (y - x) * 5");
+    Expressions::Expression<long double> df = f.diff("x").diff("x");
+    Expressions::Expression<long double> poly = Expressions::polynomial_form(f);
+    Expressions::Expression<long double> dpoly = poly.diff("x").diff("x");
+
+    Expressions::FlatExpression<long double> flat(df);
+    Expressions::FlatExpression<long double> flat_poly(dpoly);
+    std::vector<long double> values(flat.variables().size(), 0.5L);
+    std::vector<long double> poly_values(flat_poly.variables().size(), 0.5L);
+
+    const size_t runs = 20000;
+    std::cout << "  d2f/dx2 (" << flat.size() << " flat nodes, " << flat_poly.size() << " in polynomial form)\n"
+              << "    flat resolve:            " << measure(runs, [&](size_t){ values[0] += 1e-9L; return flat.resolve(values); }) << " ns\n"
+              << "    polynomial flat resolve: " << measure(runs, [&](size_t){ poly_values[0] += 1e-9L; return flat_poly.resolve(poly_values); }) << " ns\n";
+}
+
+void bench_optimize(){
+    std::cout << "strength reduction\n";
+
+    Expressions::Expression<long double> f("sin(x * y) * cos(x) + x ^ 3 * y ^ 2 + (x + y) ^ 0.5");
+    Expressions::FlatExpression<long double> flat(f.diff("x").diff("y"));
+    Expressions::FlatExpression<long double> optimized = flat.optimize();
+    std::vector<long double> values(flat.variables().size(), 0.5L);
+    std::vector<long double> optimized_values(optimized.variables().size(), 0.5L);
+
+    const size_t runs = 20000;
+    std::cout << "  d2f/dxdy (" << flat.size() << " flat nodes, " << optimized.size() << " optimized)\n"
+              << "    flat resolve:      " << measure(runs, [&](size_t){ values[0] += 1e-9L; return flat.resolve(values); }) << " ns\n"
+              << "    optimized resolve: " << measure(runs, [&](size_t){ optimized_values[0] += 1e-9L; return optimized.resolve(optimized_values); }) << " ns\n";
+}
+
+void bench_specialize(){
+    std::cout << "specializing 50 parameters of a model in x and y\n";
+
+    // variables are letters only: paa, pab, ...
+    auto name = [](size_t i){ return std::string("p") + char('a' + i / 26) + char('a' + i % 26); };
+    std::string model = "0";
+    std::map<std::string, long double> parameters;
+    for (size_t i = 0; i < 50; i++){
+        std::string p = name(i), q = name((i * 7 + 3) % 50);
+        model += " + (" + p + " * " + q + " + exp(" + p + " / 7)) * sin(x * " + q + ") + ln(" + q + " + 1) * y";
+        parameters[p] = 0.1L * i;
+    }
+
+    Expressions::Expression<long double> f(model);
+    Expressions::FlatExpression<long double> flat(f);
+    std::vector<std::string> names{"x", "y"};
+    std::vector<long double> values{0.5L, 0.25L};
+    for (const auto& [name, value] : parameters){
+        names.push_back(name);
+        values.push_back(value);
+    }
+    std::vector<long double> slots = flat.slot_values(names, values);
+
+    Expressions::FlatExpression<long double> specialized(f.specialize(parameters));
+    std::vector<long double> free_slots = specialized.slot_values({"x", "y"}, {0.5L, 0.25L});
+
+    const size_t runs = 20000;
+    std::cout << "  model (" << flat.size() << " flat nodes, " << specialized.size() << " specialized)\n"
+              << "    flat resolve:        " << measure(runs, [&](size_t){ return flat.resolve(slots); }) << " ns\n"
+              << "    specialized resolve: " << measure(runs, [&](size_t){ return specialized.resolve(free_slots); }) << " ns\n";
+}
+
+void bench_group(){
+    std::cout << "a function with its gradient and hessian, separately vs grouped\n";
+
+    Expressions::Expression<long double> f("sin(x) * cos(y) + ln(x + 2) * exp(y / 3) - x ^ 2 / (y + 1)");
+    std::vector<Expressions::Expression<long double>> outputs{f, f.diff("x"), f.diff("y"),
+                                                              f.diff("x").diff("x"), f.diff("x").diff("y"), f.diff("y").diff("y")};
+    std::vector<std::string> names{"x", "y"};
+    std::vector<long double> values{1.25, 0.5};
+
+    size_t separate_nodes = 0;
+    std::vector<Expressions::FlatExpression<long double>> separate;
+    std::vector<std::vector<long double>> slots;
+    for (const auto& output : outputs){
+        separate.push_back(Expressions::FlatExpression<long double>(output).optimize());
+        slots.push_back(separate.back().slot_values(names, values));
+        separate_nodes += separate.back().size();
+    }
+    Expressions::ExpressionGroup<long double> group(outputs);
+    std::vector<long double> group_values = group.slot_values(names, values);
+    std::vector<long double> out(group.size());
+
+    const size_t runs = 20000;
+    std::cout << "  6 outputs (" << separate_nodes << " flat nodes separately, " << group.nodes() << " grouped)\n"
+              << "    eval_and_resolve: " << measure(runs / 10, [&](size_t){
+                     long double sum = 0;
+                     for (const auto& output : outputs){ sum += output.eval_and_resolve(names, values); }
+                     return sum;
+                 }) << " ns\n"
+              << "    separate resolve: " << measure(runs, [&](size_t){
+                     long double sum = 0;
+                     for (size_t i = 0; i < separate.size(); i++){ sum += separate[i].resolve(slots[i]); }
+                     return sum;
+                 }) << " ns\n"
+              << "    grouped resolve:  " << measure(runs, [&](size_t){ group.resolve(group_values, out.data()); return out[0]; }) << " ns\n";
+}
+
+void bench_egraph(){
+    std::cout << "equality saturation of a function and its derivatives\n";
+
+    Expressions::Expression<long double> f("sin(x) * cos(y) + ln(x + 2) * exp(y / 3) - x ^ 2 / (y + 1)");
+    std::vector<std::pair<std::string, Expressions::Expression<long double>>> cases{
+        {"f", f}, {"df/dx", f.diff("x")}, {"d2f/dxdy", f.diff("x").diff("y")}};
+    std::vector<std::string> names{"x", "y"};
+    std::vector<long double> values{1.25, 0.5};
+
+    const size_t runs = 20000;
+    for (const auto& [name, expression] : cases){
+        auto start = std::chrono::steady_clock::now();
+        Expressions::Expression<long double> saturated = Expressions::saturate(expression);
+        auto stop = std::chrono::steady_clock::now();
+
+        Expressions::FlatExpression<long double> before = Expressions::FlatExpression<long double>(expression).optimize();
+        Expressions::FlatExpression<long double> after = Expressions::FlatExpression<long double>(saturated).optimize();
+        std::vector<long double> before_slots = before.slot_values(names, values);
+        std::vector<long double> after_slots = after.slot_values(names, values);
+        std::cout << "  " << name << ": cost " << Expressions::evaluation_cost(expression) << " -> "
+                  << Expressions::evaluation_cost(saturated) << ", saturated in "
+                  << std::chrono::duration<double, std::milli>(stop - start).count() << " ms\n"
+                  << "    flat resolve: " << measure(runs, [&](size_t){ return before.resolve(before_slots); }) << " ns -> "
+                  << measure(runs, [&](size_t){ return after.resolve(after_slots); }) << " ns\n";
+    }
+}
+
+void bench_lazy_diff(){
+    std::cout << "one-off derivative evaluations, diff tree vs lazy derivative\n";
+
+    Expressions::Expression<long double> f("sin(x) * cos(y) + ln(x + 2) * exp(y / 3) - x ^ 2 / (y + 1)");
+    std::vector<std::string> names{"x", "y"};
+
+    const size_t runs = 20000;
+    std::cout << "    diff + eval_and_resolve: " << measure(runs, [&](size_t i){
+                     return f.diff("x").eval_and_resolve(names, {1.25L + i * 1e-6L, 0.5L});
+                 }) << " ns\n"
+              << "    lazy_diff:               " << measure(runs, [&](size_t i){
+                     return f.lazy_diff("x").eval_and_resolve(names, {1.25L + i * 1e-6L, 0.5L});
+                 }) << " ns\n";
+}
+
+void bench_budget(){
+    std::cout << "second derivative of a function, with and without a budget\n";
+
+    Expressions::Expression<long double> f("sin(x) * cos(y) + ln(x + 2) * exp(y / 3) - x ^ 2 / (y + 1)");
+    Expressions::Expression<long double> df = f.diff("x");
+    Expressions::ResourceBudget budget;
+    budget.max_nodes = 1000000;
+
+    const size_t runs = 20000;
+    std::cout << "    diff:              " << measure(runs, [&](size_t){ return df.diff("y").root()->arity(); }) << " ns\n"
+              << "    diff in a scope:   " << measure(runs, [&](size_t){
+                     Expressions::BudgetScope scope(budget);
+                     return df.diff("y").root()->arity();
+                 }) << " ns\n"
+              << "    estimate_diff:     " << measure(runs, [&](size_t){ return Expressions::estimate_diff(df, "y").nodes; }) << " ns\n";
+}
+
+void bench_dependencies(){
+    std::cout << "a model with a large part independent of x\n";
+
+    Expressions::Expression<long double> g("sin(y) * exp(y / 3) + ln(y + 2) * cos(y * z) - y ^ 2 / (z + 1)");
+    for (int i = 0; i < 4; i++){ g = g * g.sin() + g; }
+    Expressions::Expression<long double> f = g + Expressions::Expression<long double>("x * z");
+    std::vector<std::string> names{"x"};
+
+    const size_t runs = 2000;
+    std::cout << "    diff by x:         " << measure(runs, [&](size_t){ return f.diff("x").root()->arity(); }) << " ns\n"
+              << "    evaluate x:        " << measure(runs, [&](size_t i){
+                     return f.evaluate(names, {1.25L + i * 1e-6L}).root()->arity();
+                 }) << " ns\n"
+              << "    free_variables:    " << measure(runs, [&](size_t){ return f.free_variables().size(); }) << " ns\n";
+}
+
+void bench_tiered(){
+    std::cout << "tiered evaluation of a hot expression\n";
+
+    Expressions::Expression<long double> f("sin(x) * cos(y) + ln(x + 2) * exp(y / 3) - x ^ 2 / (y + 1)");
+    std::vector<std::string> names{"x", "y"};
+    Expressions::TieredEvaluator<long double> tiered;
+    size_t id = tiered.add(f);
+
+    const size_t runs = 20000;
+    double tree_ns = measure(runs, [&](size_t i){ return f.eval_and_resolve(names, {1.25L + i * 1e-6L, 0.5L}); });
+    // the first runs promote the expression while it's evaluated
+    double tiered_ns = measure(runs, [&](size_t i){ return tiered.eval_and_resolve(id, names, {1.25L + i * 1e-6L, 0.5L}); });
+    tiered.wait_idle();
+    double promoted_ns = measure(runs, [&](size_t i){ return tiered.eval_and_resolve(id, names, {1.25L + i * 1e-6L, 0.5L}); });
+    Expressions::TierStats stats = tiered.stats(id);
+    std::cout << "    tree eval_and_resolve:   " << tree_ns << " ns\n"
+              << "    tiered, while promoting: " << tiered_ns << " ns\n"
+              << "    tiered, optimized:       " << promoted_ns << " ns\n"
+              << "    calls per tier: " << stats.tier_calls[0] << " tree, " << stats.tier_calls[1] << " flat, "
+              << stats.tier_calls[2] << " optimized, promotions took " << stats.promotion_ms << " ms\n";
+}
+
+void bench_build(){
+    std::cout << "building and flattening a sum of 10^5 terms\n";
+
+    const size_t n = 100000;
+    Expressions::Expression<long double> x("x");
+    auto start = std::chrono::steady_clock::now();
+    Expressions::Expression<long double> sum(0.0L);
+    for (size_t i = 0; i < n; i++){
+        sum = sum + x * Expressions::Expression<long double>(static_cast<long double>(i));
+    }
+    Expressions::FlatExpression<long double> flat(sum);
+    auto middle = std::chrono::steady_clock::now();
+    Expressions::ExpressionBuilder<long double> builder;
+    uint32_t bx = builder.variable("x");
+    uint32_t bsum = builder.number(0);
+    for (size_t i = 0; i < n; i++){
+        bsum = builder.op(Expressions::NodeKind::Plus, bsum,
+                          builder.op(Expressions::NodeKind::Mult, bx, builder.number(static_cast<long double>(i))));
+    }
+    Expressions::FlatExpression<long double> built = builder.flatten(bsum);
+    auto stop = std::chrono::steady_clock::now();
+
+    std::cout << "    expression operators: " << std::chrono::duration<double, std::milli>(middle - start).count() << " ms\n"
+              << "    builder:              " << std::chrono::duration<double, std::milli>(stop - middle).count() << " ms\n";
+
+    // construction alone, without flattening
+    auto time_ms = [](const std::function<Expressions::Expression<long double>()>& f){
+        auto begin = std::chrono::steady_clock::now();
+        Expressions::Expression<long double> res = f();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    };
+    std::cout << "    building only, copying operators: " << time_ms([&](){
+                     Expressions::Expression<long double> res(0.0L);
+                     for (size_t i = 0; i < n; i++){ res = res + x * Expressions::Expression<long double>(static_cast<long double>(i)); }
+                     return res;
+                 }) << " ms\n"
+              << "    building only, moving operators:  " << time_ms([&](){
+                     Expressions::Expression<long double> res(0.0L);
+                     for (size_t i = 0; i < n; i++){ res = std::move(res) + x * Expressions::Expression<long double>(static_cast<long double>(i)); }
+                     return res;
+                 }) << " ms\n"
+              << "    building only, accumulator:       " << time_ms([&](){
+                     Expressions::ExpressionAccumulator<long double> accumulator;
+                     accumulator.reserve(n);
+                     for (size_t i = 0; i < n; i++){ accumulator.add(x * Expressions::Expression<long double>(static_cast<long double>(i))); }
+                     return accumulator.build();
+                 }) << " ms\n";
+}
+
+void bench_parse(){
+    std::cout << "parsing a generated formula\n";
+
+    std::string formula = "x";
+    const char* terms[] = {" + sin(x * 1.5) * y", " - y ^ 2 / (x + 3)", " + -exp(x / 7) * ln(y + 2)", " - cos(x - y) ^ -1"};
+    for (size_t i = 0; i < 20000; i++){
+        formula += terms[i % 4];
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Expressions::Expression<long double> parsed(formula);
+    auto stop = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    std::cout << "    " << formula.size() / 1000 << " KB in " << seconds * 1000 << " ms, "
+              << formula.size() / seconds / 1e6 << " MB/s\n";
+
+    // the same text as 20000 separate statements, streamed in chunks
+    std::string statements;
+    for (size_t i = 0; i < 20000; i++){
+        statements += std::string(terms[i % 4] + 3) + "\n";
+    }
+    std::istringstream in(statements);
+    start = std::chrono::steady_clock::now();
+    size_t count = Expressions::parse_stream<long double>(in, [](size_t, Expressions::Expression<long double>){});
+    stop = std::chrono::steady_clock::now();
+
+    seconds = std::chrono::duration<double>(stop - start).count();
+    std::cout << "    " << count << " streamed statements in " << seconds * 1000 << " ms, "
+              << statements.size() / seconds / 1e6 << " MB/s\n";
+
+    // the statements parsed independently on one thread and on all cores
+    std::vector<std::string_view> formulas;
+    for (size_t i = 0; i < 20000; i++){
+        formulas.push_back(terms[i % 4] + 3);
+    }
+    for (size_t threads : {size_t(1), size_t(0)}){
+        start = std::chrono::steady_clock::now();
+        auto results = Expressions::parse_many<long double>(formulas, threads);
+        stop = std::chrono::steady_clock::now();
+
+        seconds = std::chrono::duration<double>(stop - start).count();
+        std::cout << "    parse_many " << results.size() << " formulas on " << (threads ? "1 thread" : "all cores")
+                  << " in " << seconds * 1000 << " ms\n";
+    }
+}
+
+int main(){
+    bench_flat();
+    bench_sample();
+    bench_precision();
+    bench_polynomial();
+    bench_optimize();
+    bench_specialize();
+    bench_group();
+    bench_egraph();
+    bench_lazy_diff();
+    bench_budget();
+    bench_dependencies();
+    bench_tiered();
+    bench_build();
+    bench_parse();
+    return 0;
+}
@@ -0,0 +1,281 @@
+#include <string>
+#include <vector>
+#include <complex>
+#include <algorithm>
+#include <unordered_map>
+#include "budget.hpp"
+#include "polynomial.hpp"
+
+namespace Expressions {
+
+bool ResourceEstimate::fits(const ResourceBudget& budget) const {
+    return nodes <= static_cast<double>(budget.max_nodes) &&
+           depth <= static_cast<double>(budget.max_depth) &&
+           bytes <= static_cast<double>(budget.max_bytes);
+}
+
+BudgetExceeded::BudgetExceeded(const std::string& what) : std::runtime_error(what) {}
+
+
+/*ESTIMATES*/
+
+namespace {
+
+// trees built from a node by the operations, polynomials are leaves
+struct NodeEstimate
+{
+    double depth = 0;
+    // evaluate() copies the subtree if it depends on a bound variable
+    double tree_nodes = 0;
+    double tree_bytes = 0;
+    // diff() builds new nodes for every path, sharing the operands of the original,
+    // and a single 0 for a subtree independent of the variable
+    double diff_nodes = 0;
+    double diff_bytes = 0;
+    double diff_depth = 0;
+};
+
+template <typename T>
+double node_bytes(NodeKind kind){
+    switch (kind){
+        case NodeKind::Number:     return sizeof(NumberNode<T>) + NODE_CONTROL_BYTES;
+        case NodeKind::Variable:   return sizeof(VariableNode<T>) + NODE_CONTROL_BYTES;
+        case NodeKind::Polynomial: return sizeof(PolynomialNode<T>) + NODE_CONTROL_BYTES;
+        case NodeKind::Sin:
+        case NodeKind::Cos:
+        case NodeKind::Ln:
+        case NodeKind::Exp:        return sizeof(SinNode<T>) + NODE_CONTROL_BYTES;
+        default:                   return sizeof(PlusNode<T>) + NODE_CONTROL_BYTES;
+    }
+}
+
+// nodes of every kind built by the diff rule of one node, besides the derivatives of its operands
+// see the diff() of every node class
+struct DiffRule
+{
+    double binary;
+    double unary;
+    double numbers;
+};
+
+DiffRule diff_rule(NodeKind kind){
+    switch (kind){
+        case NodeKind::Number:
+        case NodeKind::Variable: return {0, 0, 1};
+        case NodeKind::Plus:
+        case NodeKind::Minus:    return {1, 0, 0};
+        case NodeKind::Mult:     return {3, 0, 0};
+        case NodeKind::Div:      return {5, 0, 1};
+        case NodeKind::Pow:      return {8, 1, 1};
+        case NodeKind::Sin:      return {1, 1, 0};
+        case NodeKind::Cos:      return {2, 1, 1};
+        case NodeKind::Ln:       return {1, 0, 0};
+        case NodeKind::Exp:      return {1, 1, 0};
+        default:                 return {0, 0, 0};
+    }
+}
+
+// unique nodes of the expression and of the Horner forms of its polynomials
+template <typename T>
+std::pair<double, double> unique_size(const std::shared_ptr<ExpressionNode<T>>& root){
+    std::unordered_map<const ExpressionNode<T>*, bool> visited;
+    std::vector<const ExpressionNode<T>*> stack{root.get()};
+    double nodes = 0;
+    double bytes = 0;
+    while (!stack.empty()){
+        const ExpressionNode<T>* node = stack.back();
+        stack.pop_back();
+        if (!visited.emplace(node, true).second){ continue; }
+
+        nodes += 1;
+        bytes += node_bytes<T>(node->kind());
+        if (node->kind() == NodeKind::Polynomial){
+            stack.push_back(static_cast<const PolynomialNode<T>*>(node)->lowered().get());
+        }
+        for (size_t i = 0; i < node->arity(); i++){ stack.push_back(node->operand(i).get()); }
+    }
+    return {nodes, bytes};
+}
+
+// estimates of the root from those of every node, computed once per shared node
+// var is the mask of the variable of the derivative, bound those of the evaluated variables
+template <typename T>
+NodeEstimate estimate(const std::shared_ptr<ExpressionNode<T>>& root, VariableMask var, VariableMask bound){
+    static thread_local std::vector<std::pair<const std::shared_ptr<ExpressionNode<T>>*, bool>> stack;
+    static thread_local std::vector<NodeEstimate> results;
+    // estimates of nodes referenced from several places, nodes owned once are computed without a lookup
+    std::unordered_map<const ExpressionNode<T>*, NodeEstimate> shared;
+    stack.clear();
+    results.clear();
+    const double binary = node_bytes<T>(NodeKind::Plus);
+    const double unary = node_bytes<T>(NodeKind::Sin);
+    const double number = node_bytes<T>(NodeKind::Number);
+
+    // iterative post-order traversal, operand estimates are on top of the results stack
+    stack.push_back({&root, false});
+    while (!stack.empty()){
+        auto [pointer, expanded] = stack.back();
+        stack.pop_back();
+        const ExpressionNode<T>* node = pointer->get();
+        bool is_shared = pointer->use_count() > 1;
+
+        size_t arity = node->arity();
+        if (!expanded){
+            if (is_shared){
+                auto found = shared.find(node);
+                if (found != shared.end()){
+                    results.push_back(found->second);
+                    continue;
+                }
+            }
+            if (arity > 0){
+                stack.push_back({pointer, true});
+                for (size_t i = arity; i-- > 0;){
+                    stack.push_back({&node->operand(i), false});
+                }
+                continue;
+            }
+        }
+
+        NodeEstimate res;
+        NodeKind kind = node->kind();
+        if (kind == NodeKind::Polynomial){
+            // the derivative is at most as big as the polynomial, with its own Horner form
+            auto [nodes, bytes] = unique_size(static_cast<const PolynomialNode<T>*>(node)->lowered());
+            res = {1, 1, node_bytes<T>(kind), nodes + 1, bytes + node_bytes<T>(kind), 1};
+        } else if (arity == 0){
+            res = {1, 1, number, 1, number, 1};
+        } else {
+            NodeEstimate r = results.back();
+            if (arity > 1){ results.pop_back(); }
+            NodeEstimate l = results.back();
+            results.pop_back();
+            DiffRule rule = diff_rule(kind);
+
+            res.depth = 1 + std::max(l.depth, r.depth);
+            res.tree_nodes = 1 + l.tree_nodes + (arity > 1 ? r.tree_nodes : 0);
+            res.tree_bytes = node_bytes<T>(kind) + l.tree_bytes + (arity > 1 ? r.tree_bytes : 0);
+            res.diff_nodes = rule.binary + rule.unary + rule.numbers + l.diff_nodes + (arity > 1 ? r.diff_nodes : 0);
+            res.diff_bytes = rule.binary * binary + rule.unary * unary + rule.numbers * number +
+                             l.diff_bytes + (arity > 1 ? r.diff_bytes : 0);
+
+            // depth of the operands in the derivative, the rules nest them at most this deep
+            double operands = std::max({l.depth, r.depth, l.diff_depth, r.diff_depth});
+            switch (kind){
+                case NodeKind::Plus:
+                case NodeKind::Minus: res.diff_depth = 1 + std::max(l.diff_depth, r.diff_depth); break;
+                case NodeKind::Mult:  res.diff_depth = 2 + operands; break;
+                case NodeKind::Div:   res.diff_depth = 3 + operands; break;
+                case NodeKind::Pow:   res.diff_depth = std::max(3 + operands, 4 + std::max(l.depth, r.depth)); break;
+                case NodeKind::Cos:   res.diff_depth = 2 + operands; break;
+                case NodeKind::Ln:    res.diff_depth = 1 + operands; break;
+                default:              res.diff_depth = std::max(2 + l.depth, 1 + l.diff_depth); break;
+            }
+        }
+        if (!(node->dependencies() & var)){
+            res.diff_nodes = 1;
+            res.diff_bytes = number;
+            res.diff_depth = 1;
+        }
+        if (!(node->dependencies() & bound)){
+            res.tree_nodes = 0;
+            res.tree_bytes = 0;
+        }
+        if (is_shared){ shared.emplace(node, res); }
+        results.push_back(res);
+    }
+
+    return results.back();
+}
+
+} // namespace
+
+template <typename T>
+ResourceEstimate estimate_size(const Expression<T>& expression){
+    auto [nodes, bytes] = unique_size(expression.root());
+    return {nodes, estimate(expression.root(), 0, 0).depth, bytes};
+}
+
+template <typename T>
+ResourceEstimate estimate_diff(const Expression<T>& expression, const std::string& var){
+    NodeEstimate res = estimate(expression.root(), variable_mask(var), 0);
+    return {res.diff_nodes, res.diff_depth, res.diff_bytes};
+}
+
+template <typename T>
+ResourceEstimate estimate_evaluate(const Expression<T>& expression, const std::vector<std::string>& variables){
+    NodeEstimate res = estimate(expression.root(), 0, variables_mask(variables));
+    return {res.tree_nodes, res.depth, res.tree_bytes};
+}
+
+
+/*SCOPES*/
+
+thread_local BudgetScope* BudgetScope::current_ = nullptr;
+
+BudgetScope::BudgetScope(const ResourceBudget& budget) : budget_(budget), outer_(current_) {
+    current_ = this;
+}
+
+BudgetScope::~BudgetScope(){
+    current_ = outer_;
+}
+
+const ResourceBudget& BudgetScope::budget() const { return budget_; }
+
+size_t BudgetScope::nodes() const { return nodes_; }
+
+size_t BudgetScope::bytes() const { return bytes_; }
+
+bool BudgetScope::active(){ return current_ != nullptr; }
+
+void BudgetScope::charge_scopes(size_t bytes){
+    bytes += NODE_CONTROL_BYTES;
+    for (BudgetScope* scope = current_; scope; scope = scope->outer_){
+        if (scope->nodes_ + 1 > scope->budget_.max_nodes){
+            throw BudgetExceeded("node budget of " + std::to_string(scope->budget_.max_nodes) + " exceeded");
+        }
+        if (scope->bytes_ + bytes > scope->budget_.max_bytes){
+            throw BudgetExceeded("memory budget of " + std::to_string(scope->budget_.max_bytes) + " bytes exceeded");
+        }
+    }
+    for (BudgetScope* scope = current_; scope; scope = scope->outer_){
+        scope->nodes_ += 1;
+        scope->bytes_ += bytes;
+    }
+}
+
+void BudgetScope::admit(const ResourceEstimate& estimate, const std::string& operation){
+    for (BudgetScope* scope = current_; scope; scope = scope->outer_){
+        ResourceBudget left{scope->budget_.max_nodes - scope->nodes_,
+                            scope->budget_.max_depth,
+                            scope->budget_.max_bytes - scope->bytes_};
+        if (estimate.fits(left)){ continue; }
+        throw BudgetExceeded(operation + " needs " + std::to_string(estimate.nodes) + " nodes of depth " +
+                             std::to_string(estimate.depth) + " in " + std::to_string(estimate.bytes) +
+                             " bytes, the budget has " + std::to_string(left.max_nodes) + " nodes of depth " +
+                             std::to_string(left.max_depth) + " in " + std::to_string(left.max_bytes) + " bytes left");
+    }
+}
+
+void BudgetScope::check_depth(size_t depth, const std::string& operation){
+    for (BudgetScope* scope = current_; scope; scope = scope->outer_){
+        if (depth > scope->budget_.max_depth){
+            throw BudgetExceeded(operation + " exceeds the depth budget of " + std::to_string(scope->budget_.max_depth));
+        }
+    }
+}
+
+#define INSTANTIATE_BUDGET(T) \
+    template ResourceEstimate estimate_size(const Expression<T>&); \
+    template ResourceEstimate estimate_diff(const Expression<T>&, const std::string&); \
+    template ResourceEstimate estimate_evaluate(const Expression<T>&, const std::vector<std::string>&);
+
+INSTANTIATE_BUDGET(float)
+INSTANTIATE_BUDGET(double)
+INSTANTIATE_BUDGET(long double)
+INSTANTIATE_BUDGET(std::complex<long double>)
+
+#undef INSTANTIATE_BUDGET
+
+} // namespace Expressions
@@ -0,0 +1,98 @@
+#ifndef HEADER_GUARD_BUDGET_HPP_INCLUDED
+#define HEADER_GUARD_BUDGET_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include "expression.hpp"
+
+namespace Expressions {
+
+// allocation of every node besides the node itself, the control block of std::make_shared
+constexpr size_t NODE_CONTROL_BYTES = 16;
+
+// limits of the trees built by an operation
+struct ResourceBudget
+{
+    size_t max_nodes = SIZE_MAX;
+    size_t max_depth = SIZE_MAX;
+    size_t max_bytes = SIZE_MAX;
+};
+
+// size of the tree an operation would build
+// nodes and bytes are doubles, repeated derivatives grow exponentially and overflow integers
+struct ResourceEstimate
+{
+    double nodes = 0;
+    double depth = 0;
+    double bytes = 0;
+
+    bool fits(const ResourceBudget& budget) const;
+};
+
+class BudgetExceeded : public std::runtime_error
+{
+public:
+    explicit BudgetExceeded(const std::string& what);
+};
+
+// estimates computed over the shared nodes of the expression, without building anything
+// polynomials count as one node holding their Horner form
+// nodes and depth of the expression itself
+template <typename T>
+ResourceEstimate estimate_size(const Expression<T>& expression);
+// nodes allocated by diff(var) and depth of the derivative, exact except for polynomials
+template <typename T>
+ResourceEstimate estimate_diff(const Expression<T>& expression, const std::string& var);
+// nodes allocated by evaluate() and eval_and_resolve() binding the given variables,
+// which copy the subtrees depending on them once per parent and share the others
+template <typename T>
+ResourceEstimate estimate_evaluate(const Expression<T>& expression, const std::vector<std::string>& variables);
+
+// budget of the work done on this thread while the scope lives:
+//   diff(), evaluate() and eval_and_resolve() compare their estimate with the remaining budget
+//   and throw BudgetExceeded before building anything
+//   parsing checks the nesting depth as it goes and the depth of the parsed tree
+//   every node built meanwhile is charged, so parsing, simplification and the other transformations
+//   throw BudgetExceeded at the first node over the budget
+// scopes nest, the work is charged to and checked against all of them
+// parallel_for runs on the calling thread while a scope is active, so parse_many, ExpressionGroup::resolve_rows
+// and the other parallel operations are charged too
+// a scope has to be destroyed on the thread that created it, in reverse order of creation
+class BudgetScope
+{
+private:
+    ResourceBudget budget_;
+    size_t nodes_ = 0;
+    size_t bytes_ = 0;
+    BudgetScope* outer_;
+
+    static thread_local BudgetScope* current_;
+
+    static void charge_scopes(size_t bytes);
+public:
+    explicit BudgetScope(const ResourceBudget& budget);
+    ~BudgetScope();
+    BudgetScope(const BudgetScope&) = delete;
+    BudgetScope& operator = (const BudgetScope&) = delete;
+
+    const ResourceBudget& budget() const;
+    // nodes and bytes charged so far
+    size_t nodes() const;
+    size_t bytes() const;
+
+    // true if a scope is active on this thread
+    static bool active();
+    // charges a node of the given size, called by the node constructors
+    static void charge(size_t bytes){
+        if (current_){ charge_scopes(bytes); }
+    }
+    // throws if the estimated work exceeds what is left of any active budget
+    static void admit(const ResourceEstimate& estimate, const std::string& operation);
+    // throws if depth exceeds any active depth budget
+    static void check_depth(size_t depth, const std::string& operation);
+};
+} // namespace Expressions
+
+#endif // HEADER_GUARD_BUDGET_HPP_INCLUDED
@@ -0,0 +1,123 @@
+#include <string>
+#include <vector>
+#include <complex>
+#include <stdexcept>
+#include <unordered_map>
+#include "builder.hpp"
+#include "polynomial.hpp"
+
+namespace Expressions {
+
+template <typename T>
+uint32_t ExpressionBuilder<T>::push(NodeKind kind, uint32_t left, uint32_t right, T value){
+    nodes_.push_back(FlatNode<T>{kind, left, right, value});
+    return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+template <typename T>
+uint32_t ExpressionBuilder<T>::number(T value){ return push(NodeKind::Number, 0, 0, value); }
+
+template <typename T>
+uint32_t ExpressionBuilder<T>::variable(const std::string& name){
+    auto found = slots_.find(name);
+    uint32_t slot;
+    if (found != slots_.end()){
+        slot = found->second;
+    } else {
+        slot = static_cast<uint32_t>(variables_.size());
+        variables_.push_back(name);
+        slots_.emplace(name, slot);
+    }
+    return push(NodeKind::Variable, slot, 0, T(0));
+}
+
+template <typename T>
+uint32_t ExpressionBuilder<T>::op(NodeKind kind, uint32_t left, uint32_t right){
+    bool unary = kind == NodeKind::Sin || kind == NodeKind::Cos || kind == NodeKind::Ln || kind == NodeKind::Exp;
+    bool binary = kind == NodeKind::Plus || kind == NodeKind::Minus || kind == NodeKind::Mult ||
+                  kind == NodeKind::Div || kind == NodeKind::Pow;
+    if (!unary && !binary){ throw std::invalid_argument("builder operations can't be leaf or polynomial nodes"); }
+    if (left >= nodes_.size() || (binary && right >= nodes_.size())){
+        throw std::out_of_range("operand is not a node of this builder");
+    }
+    return push(kind, left, unary ? 0 : right, T(0));
+}
+
+template <typename T>
+uint32_t ExpressionBuilder<T>::add(const Expression<T>& expression){
+    return add_nodes(*this, expression);
+}
+
+template <typename T>
+Expression<T> ExpressionBuilder<T>::build(uint32_t root) const {
+    if (root >= nodes_.size()){ throw std::out_of_range("root is not a node of this builder"); }
+
+    // number of users of every node reachable from root
+    std::vector<uint32_t> uses(root + 1, 0);
+    uses[root] = 1;
+    for (size_t i = root + 1; i-- > 0;){
+        const FlatNode<T>& node = nodes_[i];
+        if (uses[i] == 0 || node.kind == NodeKind::Number || node.kind == NodeKind::Variable){ continue; }
+        uses[node.left]++;
+        if (node.kind != NodeKind::Sin && node.kind != NodeKind::Cos && node.kind != NodeKind::Ln && node.kind != NodeKind::Exp){
+            uses[node.right]++;
+        }
+    }
+
+    // operands precede their users, so one pass over the nodes builds the tree
+    // the last user of a node takes it over, so no reference is left behind to release afterwards
+    std::vector<std::shared_ptr<ExpressionNode<T>>> built(root + 1);
+    auto take = [&](uint32_t index) -> std::shared_ptr<ExpressionNode<T>> {
+        return --uses[index] == 0 ? std::move(built[index]) : built[index];
+    };
+    for (size_t i = 0; i <= root; i++){
+        if (uses[i] == 0){ continue; }
+        const FlatNode<T>& node = nodes_[i];
+        switch (node.kind){
+            case NodeKind::Number:
+                built[i] = std::make_shared<NumberNode<T>>(node.value);
+                break;
+            case NodeKind::Variable:
+                built[i] = std::make_shared<VariableNode<T>>(variables_[node.left]);
+                break;
+            case NodeKind::Sin:
+            case NodeKind::Cos:
+            case NodeKind::Ln:
+            case NodeKind::Exp:
+                built[i] = make_node<T>(node.kind, take(node.left));
+                break;
+            default: {
+                std::shared_ptr<ExpressionNode<T>> left = take(node.left);
+                built[i] = make_node<T>(node.kind, left, take(node.right));
+            }
+        }
+    }
+
+    return Expression<T>(std::move(built[root]));
+}
+
+template <typename T>
+FlatExpression<T> ExpressionBuilder<T>::flatten(uint32_t root) const {
+    if (root >= nodes_.size()){ throw std::out_of_range("root is not a node of this builder"); }
+    return FlatExpression<T>::reachable(nodes_, variables_, root);
+}
+
+template <typename T>
+size_t ExpressionBuilder<T>::size() const { return nodes_.size(); }
+
+template <typename T>
+void ExpressionBuilder<T>::reserve(size_t nodes){ nodes_.reserve(nodes); }
+
+template <typename T>
+void ExpressionBuilder<T>::clear(){
+    nodes_.clear();
+    variables_.clear();
+    slots_.clear();
+}
+
+template class ExpressionBuilder<float>;
+template class ExpressionBuilder<double>;
+template class ExpressionBuilder<long double>;
+template class ExpressionBuilder<std::complex<long double>>;
+
+} // namespace Expressions
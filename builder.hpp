@@ -0,0 +1,51 @@
+#ifndef HEADER_GUARD_BUILDER_HPP_INCLUDED
+#define HEADER_GUARD_BUILDER_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "expression.hpp"
+#include "flat.hpp"
+
+namespace Expressions {
+
+// single-threaded construction of expressions:
+// nodes live in an arena owned by the builder and refer to each other by index,
+// so building costs no reference counting at all; shared_ptr nodes are created once by build()
+// a builder must not be used from several threads at the same time
+template <typename T>
+class ExpressionBuilder
+{
+private:
+    std::vector<FlatNode<T>> nodes_;
+    std::vector<std::string> variables_;
+    std::unordered_map<std::string, uint32_t> slots_;
+
+    uint32_t push(NodeKind kind, uint32_t left, uint32_t right, T value);
+public:
+    ExpressionBuilder() = default;
+    ~ExpressionBuilder() = default;
+
+    // nodes are referred to by the indices returned here
+    uint32_t number(T value);
+    uint32_t variable(const std::string& name);
+    // operation node, the right operand is ignored for functions
+    // throws std::invalid_argument for leaf kinds and std::out_of_range for unknown operands
+    uint32_t op(NodeKind kind, uint32_t left, uint32_t right = 0);
+    // copies a node tree into the arena, returns the index of its root
+    uint32_t add(const Expression<T>& expression);
+
+    // node tree of the given root, nodes shared in the arena stay shared
+    Expression<T> build(uint32_t root) const;
+    // flat expression of the given root, without going through a node tree
+    FlatExpression<T> flatten(uint32_t root) const;
+
+    size_t size() const;
+    void reserve(size_t nodes);
+    // drops all nodes, indices returned before are invalid afterwards
+    void clear();
+};
+} // namespace Expressions
+
+#endif // HEADER_GUARD_BUILDER_HPP_INCLUDED
@@ -0,0 +1,206 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "calc.hpp"
+#include "group.hpp"
+#include "parallel.hpp"
+
+namespace Expressions {
+
+std::vector<std::string_view> split(std::string_view text, char separator){
+    std::vector<std::string_view> parts;
+    for (size_t begin = 0;;){
+        size_t end = std::min(text.find(separator, begin), text.size());
+        parts.push_back(text.substr(begin, end - begin));
+        if (end == text.size()){ return parts; }
+        begin = end + 1;
+    }
+}
+
+std::string_view trim(std::string_view text){
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos){ return {}; }
+    return text.substr(begin, text.find_last_not_of(" \t\r") - begin + 1);
+}
+
+namespace {
+
+// the output columns, evaluated together so the derivatives share subtrees with f
+class Calculator
+{
+private:
+    ExpressionGroup<double> outputs_;
+    std::vector<std::string> names_;
+    // input column of every variable of the outputs
+    std::vector<size_t> columns_;
+    size_t width_ = 0;
+
+    static std::vector<Expression<double>> expressions(const CalcOptions& options){
+        Expression<double> f(options.expression);
+        std::vector<Expression<double>> result{f};
+        for (const std::string& var : options.derivatives){ result.push_back(f.diff(var)); }
+        return result;
+    }
+
+public:
+    Calculator(const CalcOptions& options, const std::vector<std::string>& header)
+        : outputs_(expressions(options), options.allow_rewrites) {
+        names_.push_back("f");
+        for (const std::string& var : options.derivatives){ names_.push_back("df/d" + var); }
+
+        width_ = header.size();
+        for (const std::string& var : outputs_.variables()){
+            size_t column = std::find(header.begin(), header.end(), var) - header.begin();
+            if (column == header.size()){ throw std::runtime_error("no input column for variable " + var); }
+            columns_.push_back(column);
+        }
+    }
+
+    const std::vector<std::string>& names() const { return names_; }
+    size_t width() const { return width_; }
+
+    // evaluates every output for one row of width() input values
+    void evaluate(const double* row, double* out, std::vector<double>& slots) const {
+        slots.resize(columns_.size());
+        for (size_t s = 0; s < slots.size(); s++){ slots[s] = row[columns_[s]]; }
+        outputs_.resolve(slots, out);
+    }
+};
+
+// splits rows into pieces processed by parallel_for, a few per thread for balance
+size_t piece_count(size_t rows, size_t threads){
+    return std::max<size_t>(1, std::min(rows, (threads ? threads : default_threads()) * 4));
+}
+
+void write_all(std::ostream& out, const char* data, size_t size){
+    out.write(data, static_cast<std::streamsize>(size));
+    if (!out){ throw std::runtime_error("error writing the output"); }
+}
+
+// reads up to size bytes, fewer only at the end of the input
+size_t read_some(std::istream& in, char* data, size_t size){
+    in.read(data, static_cast<std::streamsize>(size));
+    if (in.bad()){ throw std::runtime_error("error reading the input"); }
+    return static_cast<size_t>(in.gcount());
+}
+
+std::string read_header(std::istream& in){
+    std::string header;
+    if (!std::getline(in, header)){ throw std::runtime_error("the input has no header line"); }
+    return header;
+}
+
+std::vector<std::string> header_names(const std::string& header){
+    std::vector<std::string> names;
+    for (std::string_view name : split(header, ',')){ names.emplace_back(trim(name)); }
+    return names;
+}
+
+} // namespace
+
+void calc_csv(const CalcOptions& options, std::istream& in, std::ostream& out){
+    Calculator calculator(options, header_names(read_header(in)));
+    size_t width = calculator.width();
+    size_t outputs = calculator.names().size();
+
+    std::string header;
+    for (const std::string& name : calculator.names()){ header += (header.empty() ? "" : ",") + name; }
+    header += '\n';
+    write_all(out, header.data(), header.size());
+
+    std::vector<char> buffer(CALC_BLOCK_BYTES);
+    size_t filled = 0;
+    size_t line_number = 2;
+    for (bool end = false; !end;){
+        size_t got = read_some(in, buffer.data() + filled, buffer.size() - filled);
+        filled += got;
+        end = got == 0;
+
+        // complete lines of the block, the whole rest at the end of the input
+        std::string_view text(buffer.data(), filled);
+        size_t complete = end ? filled : text.rfind('\n') + 1;
+        if (!end && complete == 0){
+            // a line longer than the buffer
+            if (filled == buffer.size()){ buffer.resize(buffer.size() * 2); }
+            continue;
+        }
+        std::vector<std::string_view> lines = split(text.substr(0, complete), '\n');
+
+        size_t pieces = piece_count(lines.size(), options.threads);
+        std::vector<std::string> formatted(pieces);
+        parallel_for(pieces, [&](size_t begin, size_t end_piece){
+            std::vector<double> row(width);
+            std::vector<double> results(outputs);
+            std::vector<double> slots;
+            char number[64];
+            for (size_t p = begin; p < end_piece; p++){
+                std::string& text_out = formatted[p];
+                for (size_t l = p * lines.size() / pieces; l < (p + 1) * lines.size() / pieces; l++){
+                    if (trim(lines[l]).empty()){ continue; }
+                    std::vector<std::string_view> fields = split(lines[l], ',');
+                    if (fields.size() != width){
+                        throw std::runtime_error("line " + std::to_string(line_number + l) + ": expected " +
+                                                 std::to_string(width) + " columns");
+                    }
+                    for (size_t c = 0; c < width; c++){
+                        std::string_view field = trim(fields[c]);
+                        auto [ptr, error] = std::from_chars(field.data(), field.data() + field.size(), row[c]);
+                        if (error != std::errc() || ptr != field.data() + field.size()){
+                            throw std::runtime_error("line " + std::to_string(line_number + l) + ": invalid number \"" +
+                                                     std::string(field) + "\"");
+                        }
+                    }
+                    calculator.evaluate(row.data(), results.data(), slots);
+                    for (size_t o = 0; o < outputs; o++){
+                        if (o > 0){ text_out += ','; }
+                        text_out.append(number, std::to_chars(number, number + sizeof(number), results[o]).ptr);
+                    }
+                    text_out += '\n';
+                }
+            }
+        }, options.threads);
+
+        for (const std::string& piece : formatted){ write_all(out, piece.data(), piece.size()); }
+
+        line_number += lines.size() - (end ? 0 : 1);
+        std::memmove(buffer.data(), buffer.data() + complete, filled - complete);
+        filled -= complete;
+    }
+}
+
+void calc_binary(const CalcOptions& options, std::istream& in, std::ostream& out){
+    Calculator calculator(options, header_names(read_header(in)));
+    size_t width = calculator.width();
+    size_t outputs = calculator.names().size();
+    if (width == 0){ throw std::runtime_error("the input has no columns"); }
+
+    std::string header;
+    for (const std::string& name : calculator.names()){ header += (header.empty() ? "" : ",") + name; }
+    header += '\n';
+    write_all(out, header.data(), header.size());
+
+    size_t block_rows = std::max<size_t>(1, CALC_BLOCK_BYTES / (width * sizeof(double)));
+    std::vector<double> values(block_rows * width);
+    std::vector<double> results(block_rows * outputs);
+    for (;;){
+        size_t got = read_some(in, reinterpret_cast<char*>(values.data()), values.size() * sizeof(double));
+        if (got % (width * sizeof(double)) != 0){ throw std::runtime_error("the input ends inside a row"); }
+        size_t rows = got / (width * sizeof(double));
+        if (rows == 0){ break; }
+
+        parallel_for(rows, [&](size_t begin, size_t end){
+            std::vector<double> slots;
+            for (size_t r = begin; r < end; r++){
+                calculator.evaluate(values.data() + r * width, results.data() + r * outputs, slots);
+            }
+        }, options.threads);
+
+        write_all(out, reinterpret_cast<const char*>(results.data()), rows * outputs * sizeof(double));
+    }
+}
+
+} // namespace Expressions
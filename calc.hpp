@@ -0,0 +1,46 @@
+#ifndef HEADER_GUARD_CALC_HPP_INCLUDED
+#define HEADER_GUARD_CALC_HPP_INCLUDED
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include "expression.hpp"
+
+namespace Expressions {
+
+// the input is processed in blocks of about CALC_BLOCK_BYTES, every block is parsed, evaluated and
+// formatted on all cores before the next one is read, so memory doesn't grow with the input
+constexpr size_t CALC_BLOCK_BYTES = 1 << 22;
+
+// columnar evaluation of an expression and its derivatives, the engine of exprcalc.exe
+struct CalcOptions
+{
+    std::string expression;
+    // also output the derivatives by these variables
+    std::vector<std::string> derivatives;
+    // worker threads, 0 = all cores
+    size_t threads = 0;
+    // also strength reduce the outputs, see ExpressionGroup<T>; without, the values are those of
+    // Expression<T>::eval_and_resolve bit for bit
+    bool allow_rewrites = false;
+};
+
+// the input has a header line of column names, the columns named like the variables of the expression
+// are used and the others ignored; the output has a header line "f,df/dx,..." followed by the values
+// errors are thrown as std::runtime_error, CSV errors name their line
+
+// fields of a line, the views point into text
+std::vector<std::string_view> split(std::string_view text, char separator);
+// field without surrounding spaces, tabs and '\r'
+std::string_view trim(std::string_view text);
+
+// CSV rows, blank lines are skipped and the last line needs no newline
+void calc_csv(const CalcOptions& options, std::istream& in, std::ostream& out);
+
+// rows of native doubles after the header line, the output values are written alike
+void calc_binary(const CalcOptions& options, std::istream& in, std::ostream& out);
+} // namespace Expressions
+
+#endif // HEADER_GUARD_CALC_HPP_INCLUDED
@@ -0,0 +1,224 @@
+#include <cmath>
+#include <algorithm>
+#include "complex.hpp"
+
+namespace Expressions {
+
+namespace {
+
+// number of rows evaluated together
+constexpr size_t COMPLEX_BLOCK = 256;
+
+} // namespace
+
+template <typename R>
+ComplexBatchEvaluator<R>::ComplexBatchEvaluator(const Expression<std::complex<R>>& expression,
+                                                const std::vector<std::string>& real_variables) :
+expr_(expression), real_() {
+    const std::vector<FlatNode<std::complex<R>>>& nodes = expr_.nodes();
+    real_.resize(nodes.size(), false);
+
+    for (size_t i = 0; i < nodes.size(); i++){
+        const FlatNode<std::complex<R>>& node = nodes[i];
+        switch (node.kind){
+            case NodeKind::Number:
+                real_[i] = node.value.imag() == 0;
+                break;
+            case NodeKind::Variable:
+                real_[i] = std::find(real_variables.begin(), real_variables.end(),
+                                     expr_.variables()[node.left]) != real_variables.end();
+                break;
+            case NodeKind::Plus:
+            case NodeKind::Minus:
+            case NodeKind::Mult:
+            case NodeKind::Div:
+                real_[i] = real_[node.left] && real_[node.right];
+                break;
+            case NodeKind::Pow: {
+                // real base to a constant integer power, other powers may leave the real line
+                const FlatNode<std::complex<R>>& exponent = nodes[node.right];
+                real_[i] = real_[node.left] && exponent.kind == NodeKind::Number && exponent.value.imag() == 0 &&
+                           std::floor(exponent.value.real()) == exponent.value.real();
+                break;
+            }
+            case NodeKind::Sin:
+            case NodeKind::Cos:
+            case NodeKind::Exp:
+                real_[i] = real_[node.left];
+                break;
+            case NodeKind::Ln:
+            case NodeKind::Sqrt:
+                // ln and sqrt of negative numbers are complex
+                real_[i] = false;
+                break;
+            case NodeKind::Polynomial:
+                // lowered to Horner form by FlatExpression
+                break;
+        }
+    }
+}
+
+template <typename R>
+void ComplexBatchEvaluator<R>::evaluate(const std::vector<const R*>& real_columns,
+                                        const std::vector<const R*>& imag_columns,
+                                        size_t rows,
+                                        R* out_real,
+                                        R* out_imag) const {
+    const std::vector<FlatNode<std::complex<R>>>& nodes = expr_.nodes();
+    const size_t count = nodes.size();
+    const size_t B = COMPLEX_BLOCK;
+
+    // real parts of every node, imaginary parts of complex nodes only
+    std::vector<R> re(count * B);
+    std::vector<R> im(count * B);
+    const std::vector<R> zeros(B, R(0));
+
+    auto re_of = [&](uint32_t index) -> R* { return &re[index * B]; };
+    auto im_of = [&](uint32_t index) -> const R* { return real_[index] ? zeros.data() : &im[index * B]; };
+
+    for (size_t begin = 0; begin < rows; begin += B){
+        size_t len = std::min(B, rows - begin);
+
+        for (size_t i = 0; i < count; i++){
+            const FlatNode<std::complex<R>>& node = nodes[i];
+            bool real = real_[i];
+            R* orl = re_of(i);
+            R* oim = &im[i * B];
+            const R* ar = re_of(node.left);
+            const R* ai = im_of(node.left);
+            const R* br = node.kind == NodeKind::Number || node.kind == NodeKind::Variable ? nullptr : re_of(node.right);
+            const R* bi = br ? im_of(node.right) : nullptr;
+
+            switch (node.kind){
+                case NodeKind::Number:
+                    std::fill(orl, orl + len, node.value.real());
+                    if (!real){ std::fill(oim, oim + len, node.value.imag()); }
+                    break;
+                case NodeKind::Variable: {
+                    const R* col_re = node.left < real_columns.size() ? real_columns[node.left] : nullptr;
+                    const R* col_im = node.left < imag_columns.size() ? imag_columns[node.left] : nullptr;
+                    for (size_t k = 0; k < len; k++){ orl[k] = col_re ? col_re[begin + k] : R(0); }
+                    if (!real){
+                        for (size_t k = 0; k < len; k++){ oim[k] = col_im ? col_im[begin + k] : R(0); }
+                    }
+                    break;
+                }
+                case NodeKind::Plus:
+                    for (size_t k = 0; k < len; k++){ orl[k] = ar[k] + br[k]; }
+                    if (!real){ for (size_t k = 0; k < len; k++){ oim[k] = ai[k] + bi[k]; } }
+                    break;
+                case NodeKind::Minus:
+                    for (size_t k = 0; k < len; k++){ orl[k] = ar[k] - br[k]; }
+                    if (!real){ for (size_t k = 0; k < len; k++){ oim[k] = ai[k] - bi[k]; } }
+                    break;
+                case NodeKind::Mult:
+                    if (real){
+                        for (size_t k = 0; k < len; k++){ orl[k] = ar[k] * br[k]; }
+                    } else {
+                        for (size_t k = 0; k < len; k++){
+                            orl[k] = ar[k] * br[k] - ai[k] * bi[k];
+                            oim[k] = ar[k] * bi[k] + ai[k] * br[k];
+                        }
+                    }
+                    break;
+                case NodeKind::Div:
+                    if (real){
+                        for (size_t k = 0; k < len; k++){ orl[k] = ar[k] / br[k]; }
+                    } else {
+                        // Smith's algorithm, avoids overflow of |b|^2
+                        for (size_t k = 0; k < len; k++){
+                            if (std::abs(br[k]) >= std::abs(bi[k])){
+                                R r = bi[k] / br[k];
+                                R d = br[k] + bi[k] * r;
+                                orl[k] = (ar[k] + ai[k] * r) / d;
+                                oim[k] = (ai[k] - ar[k] * r) / d;
+                            } else {
+                                R r = br[k] / bi[k];
+                                R d = bi[k] + br[k] * r;
+                                orl[k] = (ar[k] * r + ai[k]) / d;
+                                oim[k] = (ai[k] * r - ar[k]) / d;
+                            }
+                        }
+                    }
+                    break;
+                case NodeKind::Pow:
+                    if (real){
+                        for (size_t k = 0; k < len; k++){ orl[k] = std::pow(ar[k], br[k]); }
+                    } else {
+                        for (size_t k = 0; k < len; k++){
+                            std::complex<R> res = std::pow(std::complex<R>(ar[k], ai[k]), std::complex<R>(br[k], bi[k]));
+                            orl[k] = res.real();
+                            oim[k] = res.imag();
+                        }
+                    }
+                    break;
+                case NodeKind::Sin:
+                    if (real){
+                        for (size_t k = 0; k < len; k++){ orl[k] = std::sin(ar[k]); }
+                    } else {
+                        // sin(a + bi) = sin a cosh b + i cos a sinh b
+                        for (size_t k = 0; k < len; k++){
+                            orl[k] = std::sin(ar[k]) * std::cosh(ai[k]);
+                            oim[k] = std::cos(ar[k]) * std::sinh(ai[k]);
+                        }
+                    }
+                    break;
+                case NodeKind::Cos:
+                    if (real){
+                        for (size_t k = 0; k < len; k++){ orl[k] = std::cos(ar[k]); }
+                    } else {
+                        // cos(a + bi) = cos a cosh b - i sin a sinh b
+                        for (size_t k = 0; k < len; k++){
+                            orl[k] = std::cos(ar[k]) * std::cosh(ai[k]);
+                            oim[k] = -std::sin(ar[k]) * std::sinh(ai[k]);
+                        }
+                    }
+                    break;
+                case NodeKind::Ln:
+                    // ln(a + bi) = ln |a + bi| + i arg(a + bi)
+                    for (size_t k = 0; k < len; k++){
+                        orl[k] = std::log(std::hypot(ar[k], ai[k]));
+                        oim[k] = std::atan2(ai[k], ar[k]);
+                    }
+                    break;
+                case NodeKind::Exp:
+                    if (real){
+                        for (size_t k = 0; k < len; k++){ orl[k] = std::exp(ar[k]); }
+                    } else {
+                        // exp(a + bi) = e^a (cos b + i sin b)
+                        for (size_t k = 0; k < len; k++){
+                            R e = std::exp(ar[k]);
+                            orl[k] = e * std::cos(ai[k]);
+                            oim[k] = e * std::sin(ai[k]);
+                        }
+                    }
+                    break;
+                case NodeKind::Sqrt:
+                    for (size_t k = 0; k < len; k++){
+                        std::complex<R> res = std::sqrt(std::complex<R>(ar[k], ai[k]));
+                        orl[k] = res.real();
+                        oim[k] = res.imag();
+                    }
+                    break;
+                case NodeKind::Polynomial:
+                    // lowered to Horner form by FlatExpression
+                    break;
+            }
+        }
+
+        uint32_t root = expr_.root();
+        std::copy(re_of(root), re_of(root) + len, out_real + begin);
+        const R* root_im = im_of(root);
+        std::copy(root_im, root_im + len, out_imag + begin);
+    }
+}
+
+template <typename R>
+const std::vector<std::string>& ComplexBatchEvaluator<R>::variables() const { return expr_.variables(); }
+
+template <typename R>
+size_t ComplexBatchEvaluator<R>::real_nodes() const { return std::count(real_.begin(), real_.end(), true); }
+
+template class ComplexBatchEvaluator<long double>;
+
+} // namespace Expressions
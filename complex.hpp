@@ -0,0 +1,40 @@
+#ifndef HEADER_GUARD_COMPLEX_HPP_INCLUDED
+#define HEADER_GUARD_COMPLEX_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <complex>
+#include "expression.hpp"
+#include "flat.hpp"
+
+namespace Expressions {
+
+// batch evaluation of complex expressions on values split into real and imaginary arrays
+// subtrees that are real for any input (real numbers and variables declared real, combined by
+// operations keeping values real) are evaluated in real arithmetic
+template <typename R>
+class ComplexBatchEvaluator
+{
+private:
+    FlatExpression<std::complex<R>> expr_;
+    // node value is real for any input
+    std::vector<bool> real_;
+public:
+    ComplexBatchEvaluator(const Expression<std::complex<R>>& expression, const std::vector<std::string>& real_variables = {});
+    ~ComplexBatchEvaluator() = default;
+
+    // one column per variable in the order of variables(), imaginary columns may be nullptr for real inputs
+    // writes rows values to out_real and out_imag
+    void evaluate(const std::vector<const R*>& real_columns,
+                  const std::vector<const R*>& imag_columns,
+                  size_t rows,
+                  R* out_real,
+                  R* out_imag) const;
+
+    const std::vector<std::string>& variables() const;
+    // number of nodes evaluated in real arithmetic
+    size_t real_nodes() const;
+};
+} // namespace Expressions
+
+#endif // HEADER_GUARD_COMPLEX_HPP_INCLUDED
@@ -0,0 +1,501 @@
+#include <string>
+#include <vector>
+#include <limits>
+#include <complex>
+#include <functional>
+#include <utility>
+#include <stdexcept>
+#include "egraph.hpp"
+#include "flat.hpp"
+#include "polynomial.hpp"
+
+namespace Expressions {
+
+namespace {
+
+template <typename T>
+bool finite(const T& value){ return std::isfinite(value); }
+
+template <typename T>
+bool finite(const std::complex<T>& value){ return std::isfinite(value.real()) && std::isfinite(value.imag()); }
+
+template <typename T>
+struct is_complex : std::false_type {};
+
+template <typename T>
+struct is_complex<std::complex<T>> : std::true_type {};
+
+bool is_unary(NodeKind kind){
+    return kind == NodeKind::Sin || kind == NodeKind::Cos || kind == NodeKind::Ln || kind == NodeKind::Exp ||
+           kind == NodeKind::Sqrt;
+}
+
+// value of an operation on constants, nothing if it isn't a finite number
+template <typename T>
+std::optional<T> fold(NodeKind kind, const T& a, const T& b){
+    T r;
+    switch (kind){
+        case NodeKind::Plus:  r = a + b; break;
+        case NodeKind::Minus: r = a - b; break;
+        case NodeKind::Mult:  r = a * b; break;
+        case NodeKind::Div:   r = a / b; break;
+        case NodeKind::Pow:   r = std::pow(a, b); break;
+        case NodeKind::Sin:   r = std::sin(a); break;
+        case NodeKind::Cos:   r = std::cos(a); break;
+        case NodeKind::Ln:    r = std::log(a); break;
+        case NodeKind::Exp:   r = std::exp(a); break;
+        case NodeKind::Sqrt:  r = std::sqrt(a); break;
+        default:              return std::nullopt;
+    }
+    if (!finite(r)){ return std::nullopt; }
+    return r;
+}
+
+} // namespace
+
+
+/*COST MODEL*/
+
+double CostModel::cost(NodeKind kind) const {
+    switch (kind){
+        case NodeKind::Number:   return number;
+        case NodeKind::Variable: return variable;
+        case NodeKind::Plus:     return plus;
+        case NodeKind::Minus:    return minus;
+        case NodeKind::Mult:     return mult;
+        case NodeKind::Div:      return div;
+        case NodeKind::Pow:
+        case NodeKind::Sqrt:     return pow;
+        case NodeKind::Sin:      return sin;
+        case NodeKind::Cos:      return cos;
+        case NodeKind::Ln:       return ln;
+        case NodeKind::Exp:      return exp;
+        default:                 return 0;
+    }
+}
+
+
+/*E-GRAPH*/
+
+template <typename T>
+size_t EGraph<T>::ENodeHash::operator () (const ENode& node) const {
+    size_t h = static_cast<size_t>(node.kind);
+    h = h * 1000003 + node.left;
+    h = h * 1000003 + node.right;
+    return h * 1000003 + hash_bits(node.value);
+}
+
+template <typename T>
+uint32_t EGraph<T>::find(uint32_t id) const {
+    while (parent_[id] != id){ id = parent_[id]; }
+    return id;
+}
+
+template <typename T>
+typename EGraph<T>::ENode EGraph<T>::canonical(ENode node) const {
+    if (node.kind == NodeKind::Number || node.kind == NodeKind::Variable){ return node; }
+    node.left = find(node.left);
+    node.right = is_unary(node.kind) ? 0 : find(node.right);
+    return node;
+}
+
+template <typename T>
+std::optional<T> EGraph<T>::constant(uint32_t id) const { return constant_[find(id)]; }
+
+template <typename T>
+uint32_t EGraph<T>::add(ENode node){
+    node = canonical(node);
+    auto found = memo_.find(node);
+    if (found != memo_.end()){ return find(found->second); }
+
+    uint32_t id = static_cast<uint32_t>(parent_.size());
+    parent_.push_back(id);
+    classes_.push_back({node});
+    memo_.emplace(node, id);
+
+    std::optional<T> value;
+    if (node.kind == NodeKind::Number){
+        value = node.value;
+    } else if (node.kind != NodeKind::Variable){
+        std::optional<T> left = constant(node.left);
+        std::optional<T> right = is_unary(node.kind) ? T(0) : constant(node.right);
+        if (left && right){ value = fold(node.kind, *left, *right); }
+    }
+    constant_.push_back(value);
+
+    if (value && node.kind != NodeKind::Number){ merge(id, number(*value)); }
+    return find(id);
+}
+
+template <typename T>
+uint32_t EGraph<T>::number(T value){ return add(ENode{NodeKind::Number, 0, 0, value}); }
+
+template <typename T>
+uint32_t EGraph<T>::op(NodeKind kind, uint32_t left, uint32_t right){ return add(ENode{kind, left, right, T(0)}); }
+
+// merges the classes of a and b, returns false if they already were one class
+template <typename T>
+bool EGraph<T>::merge(uint32_t a, uint32_t b){
+    a = find(a);
+    b = find(b);
+    if (a == b){ return false; }
+    // the smaller class is moved into the larger one
+    if (classes_[a].size() < classes_[b].size()){ std::swap(a, b); }
+
+    parent_[b] = a;
+    classes_[a].insert(classes_[a].end(), classes_[b].begin(), classes_[b].end());
+    std::vector<ENode>().swap(classes_[b]);
+    dirty_ = true;
+
+    // a class that became constant gets its number node
+    if (!constant_[a] && constant_[b]){
+        constant_[a] = constant_[b];
+        merge(a, number(*constant_[a]));
+    }
+    return true;
+}
+
+// restores the invariants after merges: nodes refer to canonical classes,
+// and identical nodes, which may now be found in different classes, make those classes one
+template <typename T>
+void EGraph<T>::rebuild(){
+    while (dirty_){
+        dirty_ = false;
+        memo_.clear();
+        std::vector<std::pair<uint32_t, uint32_t>> congruent;
+
+        for (uint32_t id = 0; id < classes_.size(); id++){
+            if (parent_[id] != id){ continue; }
+            std::vector<ENode> kept;
+            for (const ENode& node : classes_[id]){
+                ENode key = canonical(node);
+                auto [found, inserted] = memo_.emplace(key, id);
+                if (inserted){
+                    kept.push_back(key);
+                } else if (found->second != id){
+                    congruent.push_back({found->second, id});
+                }
+            }
+            classes_[id] = std::move(kept);
+        }
+
+        for (const auto& [a, b] : congruent){ merge(a, b); }
+    }
+}
+
+// the class can't have negative values: an exp, a square, a non-negative constant,
+// or sums, products and quotients of those at most depth operations deep
+template <typename T>
+bool EGraph<T>::non_negative(uint32_t id, int depth) const {
+    if constexpr (is_complex<T>::value){
+        return false;
+    } else {
+        std::optional<T> value = constant(id);
+        if (value){ return !(*value < T(0)) && !std::signbit(*value); }
+        for (const ENode& node : classes_[find(id)]){
+            if (node.kind == NodeKind::Exp){ return true; }
+            if (node.kind == NodeKind::Mult && find(node.left) == find(node.right)){ return true; }
+            if ((node.kind == NodeKind::Plus || node.kind == NodeKind::Mult || node.kind == NodeKind::Div) && depth > 0 &&
+                non_negative(node.left, depth - 1) && non_negative(node.right, depth - 1)){ return true; }
+        }
+        return false;
+    }
+}
+
+// applies the rewrite rules to one node of class id
+// without expand only the rules that don't make expressions larger are applied
+template <typename T>
+void EGraph<T>::rewrite(uint32_t id, const ENode& node, bool expand){
+    if (node.kind == NodeKind::Number || node.kind == NodeKind::Variable){ return; }
+
+    uint32_t l = find(node.left);
+    uint32_t r = is_unary(node.kind) ? 0 : find(node.right);
+    std::optional<T> cl = constant(l);
+    std::optional<T> cr;
+    if (!is_unary(node.kind)){ cr = constant(r); }
+
+    // calls f for every node of the given kind in class c
+    // nodes that f adds to the class are left to the next iteration, a class may contain its own operand
+    auto each = [&](uint32_t c, NodeKind kind, const std::function<void(const ENode&)>& f){
+        size_t count = classes_[find(c)].size();
+        for (size_t i = 0; i < count && i < classes_[find(c)].size() && memo_.size() <= node_limit_; i++){
+            ENode m = classes_[find(c)][i];
+            if (m.kind == kind){ f(m); }
+        }
+    };
+    // f(a) for every kind(a) * kind(a) in class c
+    auto squares = [&](uint32_t c, NodeKind kind, const std::function<void(uint32_t)>& f){
+        each(c, NodeKind::Mult, [&](const ENode& m){
+            if (find(m.left) == find(m.right)){ each(m.left, kind, [&](const ENode& s){ f(s.left); }); }
+        });
+    };
+    // f(a) for every -1 * a in class c
+    auto negations = [&](uint32_t c, const std::function<void(uint32_t)>& f){
+        each(c, NodeKind::Mult, [&](const ENode& m){
+            if (constant(m.left) == T(-1)){ f(m.right); }
+        });
+    };
+    // a * b op a * c = a * (b op c)
+    auto factor = [&](NodeKind kind){
+        each(l, NodeKind::Mult, [&](const ENode& a){
+            each(r, NodeKind::Mult, [&](const ENode& b){
+                if (find(a.left) == find(b.left)){ merge(id, op(NodeKind::Mult, a.left, op(kind, a.right, b.right))); }
+            });
+        });
+    };
+
+    // operands that became constant after the node was added
+    if (!constant(id) && cl && (is_unary(node.kind) || cr)){
+        std::optional<T> value = fold(node.kind, *cl, is_unary(node.kind) ? T(0) : *cr);
+        if (value){ merge(id, number(*value)); }
+    }
+
+    switch (node.kind){
+        case NodeKind::Plus:
+            if (cl == T(0)){ merge(id, r); }
+            if (cr == T(0)){ merge(id, l); }
+            if (l == r){ merge(id, op(NodeKind::Mult, number(T(2)), l)); }
+            negations(r, [&](uint32_t b){ merge(id, op(NodeKind::Minus, l, b)); });
+            // sin(a) ^ 2 + cos(a) ^ 2 = 1, the squares are products by now
+            for (auto [first, second] : {std::pair{NodeKind::Sin, NodeKind::Cos}, std::pair{NodeKind::Cos, NodeKind::Sin}}){
+                squares(l, first, [&](uint32_t a){
+                    squares(r, second, [&](uint32_t b){
+                        if (find(a) == find(b)){ merge(id, number(T(1))); }
+                    });
+                });
+            }
+            if (expand){
+                merge(id, op(NodeKind::Plus, r, l));
+                each(l, NodeKind::Plus, [&](const ENode& m){ merge(id, op(NodeKind::Plus, m.left, op(NodeKind::Plus, m.right, r))); });
+                factor(NodeKind::Plus);
+            }
+            break;
+        case NodeKind::Minus:
+            if (cr == T(0)){ merge(id, l); }
+            if (l == r){ merge(id, number(T(0))); }
+            negations(r, [&](uint32_t b){ merge(id, op(NodeKind::Plus, l, b)); });
+            if (expand){ factor(NodeKind::Minus); }
+            break;
+        case NodeKind::Mult:
+            if (cl == T(1)){ merge(id, r); }
+            if (cr == T(1)){ merge(id, l); }
+            if (cl == T(0) || cr == T(0)){ merge(id, number(T(0))); }
+            if (!expand){ break; }
+            merge(id, op(NodeKind::Mult, r, l));
+            each(l, NodeKind::Mult, [&](const ENode& m){ merge(id, op(NodeKind::Mult, m.left, op(NodeKind::Mult, m.right, r))); });
+            each(l, NodeKind::Exp, [&](const ENode& a){
+                each(r, NodeKind::Exp, [&](const ENode& b){ merge(id, op(NodeKind::Exp, op(NodeKind::Plus, a.left, b.left))); });
+            });
+            each(r, NodeKind::Div, [&](const ENode& m){ merge(id, op(NodeKind::Div, op(NodeKind::Mult, l, m.left), m.right)); });
+            break;
+        case NodeKind::Div:
+            if (cr == T(1)){ merge(id, l); }
+            if (cl == T(0)){ merge(id, number(T(0))); }
+            if (!expand){ break; }
+            // (a * b) / (a * c) = b / c
+            each(l, NodeKind::Mult, [&](const ENode& a){
+                each(r, NodeKind::Mult, [&](const ENode& b){
+                    if (find(a.left) == find(b.left)){ merge(id, op(NodeKind::Div, a.right, b.right)); }
+                });
+            });
+            each(l, NodeKind::Div, [&](const ENode& m){ merge(id, op(NodeKind::Div, m.left, op(NodeKind::Mult, m.right, r))); });
+            each(r, NodeKind::Div, [&](const ENode& m){ merge(id, op(NodeKind::Div, op(NodeKind::Mult, l, m.right), m.left)); });
+            break;
+        case NodeKind::Pow:
+            if (cr == T(1)){ merge(id, l); }
+            if (cr == T(0) || cl == T(1)){ merge(id, number(T(1))); }
+            if (cr == T(2)){ merge(id, op(NodeKind::Mult, l, l)); }
+            if (cr == T(-1)){ merge(id, op(NodeKind::Div, number(T(1)), l)); }
+            if (!expand){ break; }
+            // complex powers go through the principal ln, which doesn't undo exp
+            if (!is_complex<T>::value){
+                each(l, NodeKind::Exp, [&](const ENode& m){ merge(id, op(NodeKind::Exp, op(NodeKind::Mult, m.left, r))); });
+            }
+            break;
+        case NodeKind::Sin:
+            negations(l, [&](uint32_t a){ merge(id, op(NodeKind::Mult, number(T(-1)), op(NodeKind::Sin, a))); });
+            break;
+        case NodeKind::Cos:
+            negations(l, [&](uint32_t a){ merge(id, op(NodeKind::Cos, a)); });
+            break;
+        case NodeKind::Exp:
+            // the real ln of a negative number is NaN
+            each(l, NodeKind::Ln, [&](const ENode& m){
+                if (is_complex<T>::value || non_negative(m.left)){ merge(id, m.left); }
+            });
+            break;
+        case NodeKind::Ln:
+            if (!is_complex<T>::value){
+                each(l, NodeKind::Exp, [&](const ENode& m){ merge(id, m.left); });
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+template <typename T>
+uint32_t EGraph<T>::add(const Expression<T>& expression){
+    // polynomials are added in Horner form
+    uint32_t root = post_order<uint32_t>(expression.root(), [&](const std::shared_ptr<ExpressionNode<T>>& node,
+                                                               NodeResults<T, uint32_t>& added){
+        switch (node->kind()){
+            case NodeKind::Number:
+                return number(static_cast<const NumberNode<T>*>(node.get())->value());
+            case NodeKind::Variable: {
+                const std::string& name = static_cast<const VariableNode<T>*>(node.get())->get_name();
+                auto [slot, inserted] = slots_.emplace(name, static_cast<uint32_t>(variables_.size()));
+                if (inserted){ variables_.push_back(name); }
+                return add(ENode{NodeKind::Variable, slot->second, 0, T(0)});
+            }
+            default:
+                return op(node->kind(), added[node->operand(0).get()], node->arity() > 1 ? added[node->operand(1).get()] : 0);
+        }
+    });
+
+    rebuild();
+    return find(root);
+}
+
+template <typename T>
+size_t EGraph<T>::saturate(const SaturationLimits& limits){
+    auto start = std::chrono::steady_clock::now();
+    auto exceeded = [&](){
+        return memo_.size() > limits.max_nodes || std::chrono::steady_clock::now() - start > limits.max_time;
+    };
+
+    // the simplifying rules are saturated first, so commutativity and associativity
+    // don't use up the node limit before zeros and ones are gone
+    node_limit_ = limits.max_nodes;
+    rebuild();
+    size_t iteration = 0;
+    for (bool expand : {false, true}){
+        for (; iteration < limits.max_iterations; iteration++){
+            size_t nodes = size();
+            size_t count = classes();
+
+            // classes added by this iteration are rewritten by the next one
+            size_t existing = classes_.size();
+            for (uint32_t id = 0; id < existing; id++){
+                for (size_t i = 0; parent_[id] == id && i < classes_[id].size(); i++){
+                    ENode node = classes_[id][i];
+                    rewrite(id, node, expand);
+                    if (exceeded()){
+                        rebuild();
+                        return iteration + 1;
+                    }
+                }
+            }
+            rebuild();
+
+            if (size() == nodes && classes() == count){
+                iteration++;
+                break;
+            }
+        }
+    }
+    return iteration;
+}
+
+template <typename T>
+Expression<T> EGraph<T>::extract(uint32_t id, const CostModel& costs) const {
+    // cheapest node of every class, iterated to a fixed point since classes may refer to each other
+    std::vector<double> cost(classes_.size(), std::numeric_limits<double>::infinity());
+    std::vector<ENode> best(classes_.size());
+    for (bool changed = true; changed;){
+        changed = false;
+        for (uint32_t c = 0; c < classes_.size(); c++){
+            if (parent_[c] != c){ continue; }
+            for (const ENode& node : classes_[c]){
+                double total = costs.cost(node.kind);
+                if (node.kind != NodeKind::Number && node.kind != NodeKind::Variable){
+                    total += cost[find(node.left)] + (is_unary(node.kind) ? 0 : cost[find(node.right)]);
+                }
+                if (total < cost[c]){
+                    cost[c] = total;
+                    best[c] = node;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // operations cost more than their operands, so the best nodes form a DAG
+    std::unordered_map<uint32_t, std::shared_ptr<ExpressionNode<T>>> built;
+    std::vector<std::pair<uint32_t, bool>> stack{{find(id), false}};
+    while (!stack.empty()){
+        auto [c, expanded] = stack.back();
+        stack.pop_back();
+        if (built.contains(c)){ continue; }
+
+        const ENode& node = best[c];
+        bool leaf = node.kind == NodeKind::Number || node.kind == NodeKind::Variable;
+        if (!expanded && !leaf){
+            stack.push_back({c, true});
+            if (!is_unary(node.kind)){ stack.push_back({find(node.right), false}); }
+            stack.push_back({find(node.left), false});
+            continue;
+        }
+
+        std::shared_ptr<ExpressionNode<T>> res;
+        switch (node.kind){
+            case NodeKind::Number:
+                res = std::make_shared<NumberNode<T>>(node.value);
+                break;
+            case NodeKind::Variable:
+                res = std::make_shared<VariableNode<T>>(variables_[node.left]);
+                break;
+            default:
+                res = make_node<T>(node.kind, built[find(node.left)], is_unary(node.kind) ? nullptr : built[find(node.right)]);
+        }
+        built.emplace(c, res);
+    }
+
+    return Expression<T>(built[find(id)]);
+}
+
+template <typename T>
+size_t EGraph<T>::size() const { return memo_.size(); }
+
+template <typename T>
+size_t EGraph<T>::classes() const {
+    size_t count = 0;
+    for (uint32_t id = 0; id < parent_.size(); id++){ count += parent_[id] == id; }
+    return count;
+}
+
+
+/*SATURATION*/
+
+template <typename T>
+Expression<T> saturate(const Expression<T>& expression, const CostModel& costs, const SaturationLimits& limits){
+    EGraph<T> graph;
+    uint32_t root = graph.add(expression);
+    graph.saturate(limits);
+    Expression<T> result = graph.extract(root, costs);
+
+    // extraction minimizes the tree cost, which may count shared subtrees more than once
+    return evaluation_cost(result, costs) <= evaluation_cost(expression, costs) ? result : expression;
+}
+
+template <typename T>
+double evaluation_cost(const Expression<T>& expression, const CostModel& costs){
+    FlatExpression<T> flat(expression);
+    double total = 0;
+    for (const FlatNode<T>& node : flat.nodes()){ total += costs.cost(node.kind); }
+    return total;
+}
+
+#define INSTANTIATE_EGRAPH(T) \
+    template class EGraph<T>; \
+    template Expression<T> saturate(const Expression<T>&, const CostModel&, const SaturationLimits&); \
+    template double evaluation_cost(const Expression<T>&, const CostModel&);
+
+INSTANTIATE_EGRAPH(float)
+INSTANTIATE_EGRAPH(double)
+INSTANTIATE_EGRAPH(long double)
+INSTANTIATE_EGRAPH(std::complex<long double>)
+
+#undef INSTANTIATE_EGRAPH
+
+} // namespace Expressions
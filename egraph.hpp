@@ -0,0 +1,131 @@
+#ifndef HEADER_GUARD_EGRAPH_HPP_INCLUDED
+#define HEADER_GUARD_EGRAPH_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include "expression.hpp"
+#include "flat.hpp"
+
+namespace Expressions {
+
+// evaluation cost of every node kind, used to pick the cheapest equivalent expression
+// operation costs have to be positive
+struct CostModel
+{
+    double number = 0;
+    double variable = 0;
+    double plus = 1;
+    double minus = 1;
+    double mult = 1;
+    double div = 4;
+    double pow = 20;
+    double sin = 12;
+    double cos = 12;
+    double ln = 12;
+    double exp = 12;
+
+    double cost(NodeKind kind) const;
+};
+
+// bounds of equality saturation, rewriting stops at the first one reached or when nothing changes
+struct SaturationLimits
+{
+    size_t max_nodes = 20000;
+    size_t max_iterations = 30;
+    std::chrono::milliseconds max_time{2000};
+};
+
+// e-graph: classes of equivalent expressions, every class holds the nodes computing its value
+// node operands are classes, so one graph represents exponentially many equivalent trees
+//
+// saturate() applies the rewrite rules below until nothing changes or a limit is reached:
+//   a + b = b + a, a * b = b * a, (a + b) + c = a + (b + c), (a * b) * c = a * (b * c),
+//   a * b + a * c = a * (b + c), a * b - a * c = a * (b - c), a + a = 2 * a, a + -1 * b = a - b,
+//   a * (b / c) = (a * b) / c, (a / b) / c = a / (b * c), a / (b / c) = (a * c) / b, (a * b) / (a * c) = b / c,
+//   exp(a) * exp(b) = exp(a + b), exp(a) ^ b = exp(a * b) (real T), ln(exp(a)) = a (real T),
+//   exp(ln(a)) = a (complex T, or a can't be negative: an exp, a square, a non-negative constant
+//   and their sums, products and quotients), sin(-a) = -sin(a), cos(-a) = cos(a), sin(a) ^ 2 + cos(a) ^ 2 = 1,
+//   a ^ 2 = a * a, a ^ -1 = 1 / a, the neutral and absorbing elements of + - * / ^,
+//   and folding of operations whose operands are constants
+// a * 0 = 0, 0 / a = 0, a - a = 0, sin(a) ^ 2 + cos(a) ^ 2 = 1 and the cancellation assume finite values
+// and nonzero divisors, like the derivative rules do, and the neutral elements don't keep the sign of zero
+template <typename T>
+class EGraph
+{
+private:
+    struct ENode
+    {
+        NodeKind kind;
+        uint32_t left;      // operand class, or variable slot
+        uint32_t right;     // right operand class of binary operations
+        T value;            // value of numbers
+
+        // numbers are compared bit for bit, so 0 and -0 stay apart
+        bool operator == (const ENode& other) const {
+            return kind == other.kind && left == other.left && right == other.right && same_bits(value, other.value);
+        }
+    };
+
+    struct ENodeHash
+    {
+        size_t operator () (const ENode& node) const;
+    };
+
+    // union-find of classes, a class is canonical if it's its own parent
+    std::vector<uint32_t> parent_;
+    // nodes of every canonical class
+    std::vector<std::vector<ENode>> classes_;
+    // value of classes known to be constant
+    std::vector<std::optional<T>> constant_;
+    // canonical node -> class
+    std::unordered_map<ENode, uint32_t, ENodeHash> memo_;
+    std::vector<std::string> variables_;
+    std::unordered_map<std::string, uint32_t> slots_;
+    // classes were merged since the last rebuild
+    bool dirty_ = false;
+    // node limit of the running saturation, also checked between the matches of a single node
+    size_t node_limit_ = SIZE_MAX;
+
+    ENode canonical(ENode node) const;
+    uint32_t add(ENode node);
+    uint32_t number(T value);
+    uint32_t op(NodeKind kind, uint32_t left, uint32_t right = 0);
+    bool merge(uint32_t a, uint32_t b);
+    void rebuild();
+    std::optional<T> constant(uint32_t id) const;
+    bool non_negative(uint32_t id, int depth = 3) const;
+    void rewrite(uint32_t id, const ENode& node, bool expand);
+
+public:
+    EGraph() = default;
+    ~EGraph() = default;
+
+    // adds an expression, returns the class of its root
+    uint32_t add(const Expression<T>& expression);
+    // canonical class of id
+    uint32_t find(uint32_t id) const;
+
+    // equality saturation, returns the number of rewrite iterations
+    size_t saturate(const SaturationLimits& limits = {});
+    // cheapest expression of the class under the cost model
+    Expression<T> extract(uint32_t id, const CostModel& costs = {}) const;
+
+    // number of nodes and of classes
+    size_t size() const;
+    size_t classes() const;
+};
+
+// equality saturation of a single expression followed by extraction of its cheapest form
+template <typename T>
+Expression<T> saturate(const Expression<T>& expression, const CostModel& costs = {}, const SaturationLimits& limits = {});
+
+// cost of evaluating an expression, identical subtrees are counted once like in FlatExpression<T>
+template <typename T>
+double evaluation_cost(const Expression<T>& expression, const CostModel& costs = {});
+} // namespace Expressions
+
+#endif // HEADER_GUARD_EGRAPH_HPP_INCLUDED
@@ -0,0 +1,94 @@
+#include "calc.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+// evaluates an expression and optionally its derivatives over columns of values
+// usage: exprcalc.exe [-d x,y] [-b] [-r] [-t threads] [-o output] <expression> [input]
+//   -d  also output the derivatives by the given variables
+//   -b  binary columns instead of CSV
+//   -r  strength reduce the expressions, values may differ in the last bits and where they are undefined
+//   -t  worker threads, all cores by default
+//   -o  output file, stdout by default; input is stdin by default
+//
+// CSV input has a header line of column names, the columns named like the variables of the expression
+// are used and the others ignored; output columns are "f" and "df/dx", ...
+// binary input has the same header line followed by rows of native doubles, the output is written alike
+// the input is processed in blocks, see calc.hpp
+
+namespace {
+
+struct Options
+{
+    Expressions::CalcOptions calc;
+    bool binary = false;
+    std::string input;
+    std::string output;
+};
+
+Options parse_options(int argc, char** argv){
+    Options options;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "-d" && has_value){
+            for (std::string_view var : Expressions::split(argv[++i], ',')){
+                options.calc.derivatives.emplace_back(Expressions::trim(var));
+            }
+        } else if (arg == "-b"){
+            options.binary = true;
+        } else if (arg == "-r"){
+            options.calc.allow_rewrites = true;
+        } else if (arg == "-t" && has_value){
+            options.calc.threads = std::stoul(argv[++i]);
+        } else if (arg == "-o" && has_value){
+            options.output = argv[++i];
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.empty() || positional.size() > 2){
+        throw std::invalid_argument("usage: exprcalc.exe [-d x,y] [-b] [-r] [-t threads] [-o output] <expression> [input]");
+    }
+    options.calc.expression = positional[0];
+    if (positional.size() > 1){ options.input = positional[1]; }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char** argv){
+    std::ios::sync_with_stdio(false);
+    try {
+        Options options = parse_options(argc, argv);
+
+        std::ifstream input_file;
+        if (!options.input.empty()){
+            input_file.open(options.input, std::ios::binary);
+            if (!input_file){ throw std::runtime_error("can't open " + options.input); }
+        }
+        std::ofstream output_file;
+        if (!options.output.empty()){
+            output_file.open(options.output, std::ios::binary);
+            if (!output_file){ throw std::runtime_error("can't open " + options.output); }
+        }
+        std::istream& in = options.input.empty() ? std::cin : input_file;
+        std::ostream& out = options.output.empty() ? std::cout : output_file;
+
+        if (options.binary){
+            Expressions::calc_binary(options.calc, in, out);
+        } else {
+            Expressions::calc_csv(options.calc, in, out);
+        }
+        out.flush();
+    } catch (const std::exception& error) {
+        std::cerr << "exprcalc: " << error.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "expression.hpp"
+#include "stream.hpp"
+#include "server.hpp"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <signal.h>
+#include <pthread.h>
+#include <iostream>
+
+// evaluation daemon: loads an expression file once and serves it over a Unix domain socket
+// usage: exprd.exe [-r] <socket> <expressions file> [threads] [batch delay in us]
+//   -r  strength reduce the expressions, see ServerConfig::allow_rewrites
+// expression ids are the statement numbers of the file, runs until SIGINT or SIGTERM
+
+int main(int argc, char** argv){
+    bool allow_rewrites = false;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++){
+        if (std::string(argv[i]) == "-r"){
+            allow_rewrites = true;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (args.size() < 2){
+        std::cerr << "usage: " << argv[0] << " [-r] <socket> <expressions file> [threads] [batch delay in us]\n";
+        return 2;
+    }
+
+    // signals are taken by sigwait below, the server threads inherit the mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    try {
+        std::vector<Expressions::Expression<double>> expressions;
+        auto parsed = Expressions::parse_many_file<double>(args[1]);
+        for (size_t i = 0; i < parsed.size(); i++){
+            if (!parsed[i].ok()){
+                std::cerr << args[1] << ": statement " << i << ": " << parsed[i].error << "\n";
+                return 1;
+            }
+            expressions.push_back(*parsed[i].expression);
+        }
+
+        Expressions::ServerConfig config;
+        config.socket_path = args[0];
+        if (args.size() > 2){ config.threads = std::stoul(args[2]); }
+        if (args.size() > 3){ config.batch_delay = std::chrono::microseconds(std::stoul(args[3])); }
+        config.allow_rewrites = allow_rewrites;
+
+        Expressions::EvaluationServer<double> server(expressions, config);
+        server.start();
+        std::cerr << "serving " << server.size() << " expressions on " << config.socket_path << "\n";
+
+        int signal = 0;
+        sigwait(&signals, &signal);
+
+        server.stop();
+        std::cerr << server.requests() << " requests in " << server.batches() << " batches\n";
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -7,15 +7,118 @@
 #include <algorithm>
 #include <map>
 #include <memory>
+#include <stdexcept>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
 #include "expression.hpp"
 #include "parser.hpp"
+#include "flat.hpp"
+#include "polynomial.hpp"
+#include "budget.hpp"
 
 namespace Expressions {
 
+/*VARIABLES*/
+
+namespace {
+
+// numbers of all variable names seen so far, shared by all threads
+struct VariableNames
+{
+    std::shared_mutex mutex;
+    std::unordered_map<std::string, size_t> numbers;
+    std::vector<std::string> names;
+};
+
+VariableNames& variable_names(){
+    static VariableNames names;
+    return names;
+}
+
+VariableMask bit_of(size_t number){
+    return VariableMask(1) << std::min<size_t>(number, 63);
+}
+
+// known names of this thread, numbers never change so they are looked up once per thread
+thread_local std::unordered_map<std::string, VariableMask> known_names;
+
+// names of the bits of mask but the last one
+std::vector<std::string> names_of(VariableMask mask){
+    VariableNames& names = variable_names();
+    std::shared_lock lock(names.mutex);
+    std::vector<std::string> res;
+    for (size_t i = 0; i < 63 && i < names.names.size(); i++){
+        if (mask & bit_of(i)){ res.push_back(names.names[i]); }
+    }
+    return res;
+}
+
+// evaluated operand, operands without bound variables are shared
+template <typename T>
+std::shared_ptr<ExpressionNode<T>> evaluated(const std::shared_ptr<ExpressionNode<T>>& operand, VariableMask bound,
+                                             const std::vector<std::string>& variables, const std::vector<T>& values){
+    return operand->dependencies() & bound ? operand->evaluate(variables, values) : operand;
+}
+
+} // namespace
+
+VariableMask variable_bit(const std::string& name){
+    auto found = known_names.find(name);
+    if (found != known_names.end()){ return found->second; }
+
+    VariableNames& names = variable_names();
+    std::unique_lock lock(names.mutex);
+    auto [number, added] = names.numbers.emplace(name, names.names.size());
+    if (added){ names.names.push_back(name); }
+    return known_names[name] = bit_of(number->second);
+}
+
+VariableMask variable_mask(const std::string& name){
+    // diff() asks for the same name in every node
+    thread_local std::string last_name;
+    thread_local VariableMask last_mask = 0;
+    if (last_mask && name == last_name){ return last_mask; }
+
+    auto found = known_names.find(name);
+    if (found == known_names.end()){
+        VariableNames& names = variable_names();
+        std::shared_lock lock(names.mutex);
+        auto number = names.numbers.find(name);
+        if (number == names.numbers.end()){ return 0; }
+        found = known_names.emplace(name, bit_of(number->second)).first;
+    }
+    last_name = name;
+    last_mask = found->second;
+    return last_mask;
+}
+
+VariableMask variables_mask(const std::vector<std::string>& names){
+    // evaluate() asks for the same names in every node
+    // only masks of known names are kept, a name seen later gets a bit the kept mask lacks
+    thread_local std::vector<std::string> last_names;
+    thread_local VariableMask last_mask = 0;
+    if (names == last_names){ return last_mask; }
+
+    VariableMask res = 0;
+    bool known = true;
+    for (const std::string& name : names){
+        VariableMask mask = variable_mask(name);
+        known = known && mask;
+        res |= mask;
+    }
+    if (known){
+        last_names = names;
+        last_mask = res;
+    }
+    return res;
+}
+
+
 /*NODES*/
 
 // NUMBER NODE
-template <typename T> NumberNode<T>::NumberNode(T num) : val(num) {}
+template <typename T> NumberNode<T>::NumberNode(T num) : val(num) { BudgetScope::charge(sizeof(*this)); }
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> NumberNode<T>::evaluate(std::vector<std::string> variables, std::vector<T> values) const{
@@ -30,12 +133,13 @@ std::shared_ptr<ExpressionNode<T>> NumberNode<T>::diff(const std::string &var) c
     return std::make_shared<NumberNode<T>>(0);
 }
 
-template <typename T> 
-std::string NumberNode<T>::to_string() const { return std::to_string(val); }
+// text of a number, printing builds no nodes
+template <typename T>
+std::string number_to_string(const T& val){ return std::to_string(val); }
 
-// to_string for complex numbers
+// complex numbers
 template <>
-std::string NumberNode<std::complex<long double>>::to_string() const {
+std::string number_to_string(const std::complex<long double>& val){
     std::string res;
     bool with_both_parts = false;
 
@@ -74,9 +178,29 @@ std::string NumberNode<std::complex<long double>>::to_string() const {
     return res;
 }
 
+template <typename T>
+std::string NumberNode<T>::to_string() const { return number_to_string(val); }
+
+template <typename T>
+NodeKind NumberNode<T>::kind() const { return NodeKind::Number; }
+
+template <typename T>
+size_t NumberNode<T>::arity() const { return 0; }
+
+template <typename T>
+const std::shared_ptr<ExpressionNode<T>>& NumberNode<T>::operand(size_t i) const {
+    throw std::out_of_range("number node has no operands");
+}
+
+template <typename T>
+T NumberNode<T>::value() const { return val; }
+
 
 // VARIABLE NODE
-template <typename T> VariableNode<T>::VariableNode(std::string name) : name(name) {}
+template <typename T> VariableNode<T>::VariableNode(std::string name) : name(name) {
+    this->dependencies_ = variable_bit(this->name);
+    BudgetScope::charge(sizeof(*this));
+}
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> VariableNode<T>::diff(const std::string &var) const{
@@ -91,8 +215,8 @@ std::shared_ptr<ExpressionNode<T>> VariableNode<T>::evaluate(std::vector<std::st
         if (var == name){ return std::make_shared<NumberNode<T>>(values[i]); }
         i++;
     }
-    // variable not found
-    return std::make_shared<NumberNode<T>>(0);
+    // variable not found, it stays
+    return std::make_shared<VariableNode<T>>(name);
 }
 
 template <typename T>
@@ -101,20 +225,40 @@ T VariableNode<T>::resolve() const { return 0; }
 template <typename T>
 std::string VariableNode<T>::to_string() const { return name; }
 
+template <typename T>
+NodeKind VariableNode<T>::kind() const { return NodeKind::Variable; }
+
+template <typename T>
+size_t VariableNode<T>::arity() const { return 0; }
+
+template <typename T>
+const std::shared_ptr<ExpressionNode<T>>& VariableNode<T>::operand(size_t i) const {
+    throw std::out_of_range("variable node has no operands");
+}
+
+template <typename T>
+const std::string& VariableNode<T>::get_name() const { return name; }
+
 
 // PLUS NODE
 template <typename T>
-PlusNode<T>::PlusNode(const std::shared_ptr<ExpressionNode<T>> &left, const std::shared_ptr<ExpressionNode<T>> &right) :
-left(left), right(right) {}
+PlusNode<T>::PlusNode(std::shared_ptr<ExpressionNode<T>> left, std::shared_ptr<ExpressionNode<T>> right) :
+left(std::move(left)), right(std::move(right)) {
+    this->dependencies_ = this->left->dependencies() | this->right->dependencies();
+    BudgetScope::charge(sizeof(*this));
+}
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> PlusNode<T>::diff(const std::string &var) const {
+    // subtrees independent of var have a zero derivative, in every node
+    if (!(this->dependencies_ & variable_mask(var))){ return std::make_shared<NumberNode<T>>(0); }
     return std::make_shared<PlusNode<T>>(left->diff(var), right->diff(var));
 }
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> PlusNode<T>::evaluate(std::vector<std::string> variables, std::vector<T> values) const {
-    return std::make_shared<PlusNode<T>>(left->evaluate(variables, values), right->evaluate(variables, values));
+    VariableMask bound = variables_mask(variables);
+    return std::make_shared<PlusNode<T>>(evaluated(left, bound, variables, values), evaluated(right, bound, variables, values));
 }
 
 template <typename T>
@@ -124,20 +268,38 @@ template <typename T> std::string PlusNode<T>::to_string() const {
     return "(" + left->to_string() + " + " + right->to_string() + ")";
 }
 
+template <typename T>
+NodeKind PlusNode<T>::kind() const { return NodeKind::Plus; }
+
+template <typename T>
+size_t PlusNode<T>::arity() const { return 2; }
+
+template <typename T>
+const std::shared_ptr<ExpressionNode<T>>& PlusNode<T>::operand(size_t i) const {
+    if (i == 0){ return left; }
+    if (i == 1){ return right; }
+    throw std::out_of_range("plus node has two operands");
+}
+
 
 // MINUS NODE
 template <typename T>
-MinusNode<T>::MinusNode(const std::shared_ptr<ExpressionNode<T>> &left, const std::shared_ptr<ExpressionNode<T>> &right) :
-left(left), right(right) {}
+MinusNode<T>::MinusNode(std::shared_ptr<ExpressionNode<T>> left, std::shared_ptr<ExpressionNode<T>> right) :
+left(std::move(left)), right(std::move(right)) {
+    this->dependencies_ = this->left->dependencies() | this->right->dependencies();
+    BudgetScope::charge(sizeof(*this));
+}
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> MinusNode<T>::diff(const std::string &var) const {
+    if (!(this->dependencies_ & variable_mask(var))){ return std::make_shared<NumberNode<T>>(0); }
     return std::make_shared<MinusNode<T>>(left->diff(var), right->diff(var));
 }
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> MinusNode<T>::evaluate(std::vector<std::string> variables, std::vector<T> values) const {
-    return std::make_shared<MinusNode<T>>(left->evaluate(variables, values), right->evaluate(variables, values));
+    VariableMask bound = variables_mask(variables);
+    return std::make_shared<MinusNode<T>>(evaluated(left, bound, variables, values), evaluated(right, bound, variables, values));
 }
 
 template <typename T>
@@ -147,14 +309,31 @@ template <typename T> std::string MinusNode<T>::to_string() const {
     return "(" + left->to_string() + " - "  + right->to_string() + ")";
 }
 
+template <typename T>
+NodeKind MinusNode<T>::kind() const { return NodeKind::Minus; }
+
+template <typename T>
+size_t MinusNode<T>::arity() const { return 2; }
+
+template <typename T>
+const std::shared_ptr<ExpressionNode<T>>& MinusNode<T>::operand(size_t i) const {
+    if (i == 0){ return left; }
+    if (i == 1){ return right; }
+    throw std::out_of_range("minus node has two operands");
+}
+
 
 // MULTIPLICATION NODE
 template <typename T>
-MultNode<T>::MultNode(const std::shared_ptr<ExpressionNode<T>> &left, const std::shared_ptr<ExpressionNode<T>> &right) :
-left(left), right(right) {}
+MultNode<T>::MultNode(std::shared_ptr<ExpressionNode<T>> left, std::shared_ptr<ExpressionNode<T>> right) :
+left(std::move(left)), right(std::move(right)) {
+    this->dependencies_ = this->left->dependencies() | this->right->dependencies();
+    BudgetScope::charge(sizeof(*this));
+}
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> MultNode<T>::diff(const std::string &var) const {
+    if (!(this->dependencies_ & variable_mask(var))){ return std::make_shared<NumberNode<T>>(0); }
     // f'g' = f'g + fg'
     return std::make_shared<PlusNode<T>>(
         std::make_shared<MultNode<T>>(left->diff(var), right),
@@ -163,9 +342,10 @@ std::shared_ptr<ExpressionNode<T>> MultNode<T>::diff(const std::string &var) con
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> MultNode<T>::evaluate(std::vector<std::string> variables, std::vector<T> values) const {
+    VariableMask bound = variables_mask(variables);
     return std::make_shared<MultNode<T>>(
-        left->evaluate(variables, values), 
-        right->evaluate(variables, values));
+        evaluated(left, bound, variables, values), 
+        evaluated(right, bound, variables, values));
 }
 
 template <typename T>
@@ -175,14 +355,31 @@ template <typename T> std::string MultNode<T>::to_string() const {
     return "(" + left->to_string() + " * "  + right->to_string() + ")";
 }
 
+template <typename T>
+NodeKind MultNode<T>::kind() const { return NodeKind::Mult; }
+
+template <typename T>
+size_t MultNode<T>::arity() const { return 2; }
+
+template <typename T>
+const std::shared_ptr<ExpressionNode<T>>& MultNode<T>::operand(size_t i) const {
+    if (i == 0){ return left; }
+    if (i == 1){ return right; }
+    throw std::out_of_range("mult node has two operands");
+}
+
 
 // DIVISION NODE
 template <typename T>
-DivNode<T>::DivNode(const std::shared_ptr<ExpressionNode<T>> &left, const std::shared_ptr<ExpressionNode<T>> &right) :
-left(left), right(right) {}
+DivNode<T>::DivNode(std::shared_ptr<ExpressionNode<T>> left, std::shared_ptr<ExpressionNode<T>> right) :
+left(std::move(left)), right(std::move(right)) {
+    this->dependencies_ = this->left->dependencies() | this->right->dependencies();
+    BudgetScope::charge(sizeof(*this));
+}
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> DivNode<T>::diff(const std::string &var) const {
+    if (!(this->dependencies_ & variable_mask(var))){ return std::make_shared<NumberNode<T>>(0); }
     // (f/g)' = (f'g - fg') / g^2
     auto numerator = std::make_shared<MinusNode<T>>(
         std::make_shared<MultNode<T>>(left->diff(var), right),
@@ -195,7 +392,8 @@ std::shared_ptr<ExpressionNode<T>> DivNode<T>::diff(const std::string &var) cons
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> DivNode<T>::evaluate(std::vector<std::string> variables, std::vector<T> values) const {
-    return std::make_shared<DivNode<T>>(left->evaluate(variables, values), right->evaluate(variables, values));
+    VariableMask bound = variables_mask(variables);
+    return std::make_shared<DivNode<T>>(evaluated(left, bound, variables, values), evaluated(right, bound, variables, values));
 }
 
 template <typename T>
@@ -205,14 +403,31 @@ template <typename T> std::string DivNode<T>::to_string() const {
     return "(" + left->to_string() + " / "  + right->to_string() + ")";
 }
 
+template <typename T>
+NodeKind DivNode<T>::kind() const { return NodeKind::Div; }
+
+template <typename T>
+size_t DivNode<T>::arity() const { return 2; }
+
+template <typename T>
+const std::shared_ptr<ExpressionNode<T>>& DivNode<T>::operand(size_t i) const {
+    if (i == 0){ return left; }
+    if (i == 1){ return right; }
+    throw std::out_of_range("div node has two operands");
+}
+
 
 // POWER NODE
 template <typename T>
-PowNode<T>::PowNode(const std::shared_ptr<ExpressionNode<T>> &left, const std::shared_ptr<ExpressionNode<T>> &right) :
-left(left), right(right) {}
+PowNode<T>::PowNode(std::shared_ptr<ExpressionNode<T>> left, std::shared_ptr<ExpressionNode<T>> right) :
+left(std::move(left)), right(std::move(right)) {
+    this->dependencies_ = this->left->dependencies() | this->right->dependencies();
+    BudgetScope::charge(sizeof(*this));
+}
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> PowNode<T>::diff(const std::string &var) const {
+    if (!(this->dependencies_ & variable_mask(var))){ return std::make_shared<NumberNode<T>>(0); }
     // (f^g)' = (g * f^(g - 1) * f') + (f^(g) * ln(f) * g')
     //                  left_p       +      right_p  
     // f = left, g = right
@@ -238,7 +453,8 @@ std::shared_ptr<ExpressionNode<T>> PowNode<T>::diff(const std::string &var) cons
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> PowNode<T>::evaluate(std::vector<std::string> variables, std::vector<T> values) const {
-    return std::make_shared<PowNode<T>>(left->evaluate(variables, values), right->evaluate(variables, values));
+    VariableMask bound = variables_mask(variables);
+    return std::make_shared<PowNode<T>>(evaluated(left, bound, variables, values), evaluated(right, bound, variables, values));
 }
 
 template <typename T>
@@ -248,13 +464,30 @@ template <typename T> std::string PowNode<T>::to_string() const {
     return "(" + left->to_string() + " ^ "  + right->to_string() + ")";
 }
 
+template <typename T>
+NodeKind PowNode<T>::kind() const { return NodeKind::Pow; }
+
+template <typename T>
+size_t PowNode<T>::arity() const { return 2; }
+
+template <typename T>
+const std::shared_ptr<ExpressionNode<T>>& PowNode<T>::operand(size_t i) const {
+    if (i == 0){ return left; }
+    if (i == 1){ return right; }
+    throw std::out_of_range("pow node has two operands");
+}
+
 
 // SIN NODE
 template <typename T>
-SinNode<T>::SinNode(std::shared_ptr<ExpressionNode<T>> arg) : arg(arg) {}
+SinNode<T>::SinNode(std::shared_ptr<ExpressionNode<T>> arg) : arg(std::move(arg)) {
+    this->dependencies_ = this->arg->dependencies();
+    BudgetScope::charge(sizeof(*this));
+}
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> SinNode<T>::diff(const std::string &var) const {
+    if (!(this->dependencies_ & variable_mask(var))){ return std::make_shared<NumberNode<T>>(0); }
     // (sin f(x))' = (cos f(x)) * f'(x)
     return std::make_shared<MultNode<T>>(
                                          std::make_shared<CosNode<T>>(arg),
@@ -263,7 +496,8 @@ std::shared_ptr<ExpressionNode<T>> SinNode<T>::diff(const std::string &var) cons
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> SinNode<T>::evaluate(std::vector<std::string> variables, std::vector<T> values) const {
-    return std::make_shared<SinNode<T>>(arg->evaluate(variables, values));
+    VariableMask bound = variables_mask(variables);
+    return std::make_shared<SinNode<T>>(evaluated(arg, bound, variables, values));
 }
 
 template <typename T>
@@ -271,13 +505,29 @@ T SinNode<T>::resolve() const { return std::sin(arg->resolve()); }
 
 template <typename T> std::string SinNode<T>::to_string() const { return "sin(" + arg->to_string() + ")"; }
 
+template <typename T>
+NodeKind SinNode<T>::kind() const { return NodeKind::Sin; }
+
+template <typename T>
+size_t SinNode<T>::arity() const { return 1; }
+
+template <typename T>
+const std::shared_ptr<ExpressionNode<T>>& SinNode<T>::operand(size_t i) const {
+    if (i == 0){ return arg; }
+    throw std::out_of_range("sin node has a single operand");
+}
+
 
 // COS NODE
 template <typename T>
-CosNode<T>::CosNode(std::shared_ptr<ExpressionNode<T>> arg) : arg(arg) {}
+CosNode<T>::CosNode(std::shared_ptr<ExpressionNode<T>> arg) : arg(std::move(arg)) {
+    this->dependencies_ = this->arg->dependencies();
+    BudgetScope::charge(sizeof(*this));
+}
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> CosNode<T>::diff(const std::string &var) const {
+    if (!(this->dependencies_ & variable_mask(var))){ return std::make_shared<NumberNode<T>>(0); }
     // (cos f(x))' = (-sin f(x)) * f'(x)
     return std::make_shared<MultNode<T>>(
                                          std::make_shared<SinNode<T>>(arg),
@@ -288,7 +538,8 @@ std::shared_ptr<ExpressionNode<T>> CosNode<T>::diff(const std::string &var) cons
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> CosNode<T>::evaluate(std::vector<std::string> variables, std::vector<T> values) const {
-    return std::make_shared<CosNode<T>>(arg->evaluate(variables, values));
+    VariableMask bound = variables_mask(variables);
+    return std::make_shared<CosNode<T>>(evaluated(arg, bound, variables, values));
 }
 
 template <typename T>
@@ -296,20 +547,37 @@ T CosNode<T>::resolve() const { return std::cos(arg->resolve()); }
 
 template <typename T> std::string CosNode<T>::to_string() const { return "cos(" + arg->to_string() + ")"; }
 
+template <typename T>
+NodeKind CosNode<T>::kind() const { return NodeKind::Cos; }
+
+template <typename T>
+size_t CosNode<T>::arity() const { return 1; }
+
+template <typename T>
+const std::shared_ptr<ExpressionNode<T>>& CosNode<T>::operand(size_t i) const {
+    if (i == 0){ return arg; }
+    throw std::out_of_range("cos node has a single operand");
+}
+
 
 // LN NODE
 template <typename T>
-LnNode<T>::LnNode(std::shared_ptr<ExpressionNode<T>> arg) : arg(arg) {}
+LnNode<T>::LnNode(std::shared_ptr<ExpressionNode<T>> arg) : arg(std::move(arg)) {
+    this->dependencies_ = this->arg->dependencies();
+    BudgetScope::charge(sizeof(*this));
+}
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> LnNode<T>::diff(const std::string &var) const {
+    if (!(this->dependencies_ & variable_mask(var))){ return std::make_shared<NumberNode<T>>(0); }
     // (ln f(x))' = f'(x) / f(x)
     return std::make_shared<DivNode<T>>(arg->diff(var), arg);
 }
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> LnNode<T>::evaluate(std::vector<std::string> variables, std::vector<T> values) const {
-    return std::make_shared<LnNode<T>>(arg->evaluate(variables, values));
+    VariableMask bound = variables_mask(variables);
+    return std::make_shared<LnNode<T>>(evaluated(arg, bound, variables, values));
 }
 
 template <typename T>
@@ -317,13 +585,29 @@ T LnNode<T>::resolve() const { return std::log(arg->resolve()); }
 
 template <typename T> std::string LnNode<T>::to_string() const { return "ln(" + arg->to_string() + ")"; }
 
+template <typename T>
+NodeKind LnNode<T>::kind() const { return NodeKind::Ln; }
+
+template <typename T>
+size_t LnNode<T>::arity() const { return 1; }
+
+template <typename T>
+const std::shared_ptr<ExpressionNode<T>>& LnNode<T>::operand(size_t i) const {
+    if (i == 0){ return arg; }
+    throw std::out_of_range("ln node has a single operand");
+}
+
 
 // EXP NODE
 template <typename T>
-ExpNode<T>::ExpNode(std::shared_ptr<ExpressionNode<T>> arg) : arg(arg) {}
+ExpNode<T>::ExpNode(std::shared_ptr<ExpressionNode<T>> arg) : arg(std::move(arg)) {
+    this->dependencies_ = this->arg->dependencies();
+    BudgetScope::charge(sizeof(*this));
+}
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> ExpNode<T>::diff(const std::string &var) const {
+    if (!(this->dependencies_ & variable_mask(var))){ return std::make_shared<NumberNode<T>>(0); }
     // (exp f(x))' = (exp f(x)) * f'(x)
     return std::make_shared<MultNode<T>>(
                                          std::make_shared<ExpNode<T>>(arg),
@@ -332,7 +616,8 @@ std::shared_ptr<ExpressionNode<T>> ExpNode<T>::diff(const std::string &var) cons
 
 template <typename T>
 std::shared_ptr<ExpressionNode<T>> ExpNode<T>::evaluate(std::vector<std::string> variables, std::vector<T> values) const {
-    return std::make_shared<ExpNode<T>>(arg->evaluate(variables, values));
+    VariableMask bound = variables_mask(variables);
+    return std::make_shared<ExpNode<T>>(evaluated(arg, bound, variables, values));
 }
 
 template <typename T>
@@ -340,6 +625,18 @@ T ExpNode<T>::resolve() const { return std::exp(arg->resolve()); }
 
 template <typename T> std::string ExpNode<T>::to_string() const { return "exp(" + arg->to_string() + ")"; }
 
+template <typename T>
+NodeKind ExpNode<T>::kind() const { return NodeKind::Exp; }
+
+template <typename T>
+size_t ExpNode<T>::arity() const { return 1; }
+
+template <typename T>
+const std::shared_ptr<ExpressionNode<T>>& ExpNode<T>::operand(size_t i) const {
+    if (i == 0){ return arg; }
+    throw std::out_of_range("exp node has a single operand");
+}
+
 
 
 /*EXPRESSIONS*/
@@ -360,15 +657,19 @@ Expression<T>::Expression(const std::string& expression) {
 
 // expression node constructor
 template <typename T>
-Expression<T>::Expression(std::shared_ptr<ExpressionNode<T>> expression) : expr(expression) {}
+Expression<T>::Expression(std::shared_ptr<ExpressionNode<T>> expression) : expr(std::move(expression)) {}
 
 // copy constructor
 template <typename T>
 Expression<T>::Expression(const Expression<T>& other) : expr(other.expr) {}
 
+// move constructor
+template <typename T>
+Expression<T>::Expression(Expression<T>&& other) noexcept : expr(std::move(other.expr)) {}
+
 // copy operator
 template <typename T>
-Expression<T> Expression<T>::operator = (const Expression<T>& other){
+Expression<T>& Expression<T>::operator = (const Expression<T>& other){
     if (this != &other) {
         expr = other.expr;
     }
@@ -377,7 +678,7 @@ Expression<T> Expression<T>::operator = (const Expression<T>& other){
 
 // move operator
 template <typename T>
-Expression<T> Expression<T>::operator = (const Expression<T>&& other){
+Expression<T>& Expression<T>::operator = (Expression<T>&& other) noexcept{
     if (this != &other) {
         expr = std::move(other.expr);
     }
@@ -387,14 +688,23 @@ Expression<T> Expression<T>::operator = (const Expression<T>&& other){
 // differantiates expression by given variable
 template <typename T>
 Expression<T> Expression<T>::diff(const std::string var) const{
+    if (BudgetScope::active()){ BudgetScope::admit(estimate_diff(*this, var), "diff"); }
     return Expression<T>(expr->diff(var));
 }
 
+// lazy derivative by given variable
+template <typename T>
+DiffView<T> Expression<T>::lazy_diff(const std::string& var) const{
+    return DiffView<T>(*this, var);
+}
+
 // evaluates expression with given variable values
 // not all variables may be evaluated
 // returns expression
 template <typename T>
-Expression<T> Expression<T>::evaluate(std::vector<std::string> variables, std::vector<T> values){
+Expression<T> Expression<T>::evaluate(std::vector<std::string> variables, std::vector<T> values) const{
+    if (!(expr->dependencies() & variables_mask(variables))){ return *this; }
+    if (BudgetScope::active()){ BudgetScope::admit(estimate_evaluate(*this, variables), "evaluate"); }
     return Expression<T>(expr->evaluate(variables, values));
 }
 
@@ -402,7 +712,7 @@ Expression<T> Expression<T>::evaluate(std::vector<std::string> variables, std::v
 // !!guaranteed that no variables are unevaluated!!
 // returns type T value
 template <typename T>
-T Expression<T>::resolve(){
+T Expression<T>::resolve() const{
     return expr->resolve();
 }
 
@@ -410,67 +720,493 @@ T Expression<T>::resolve(){
 // all variables evaluated
 // returns type T value
 template <typename T>
-T Expression<T>::eval_and_resolve(std::vector<std::string> variables, std::vector<T> values){
+T Expression<T>::eval_and_resolve(std::vector<std::string> variables, std::vector<T> values) const{
+    if (!(expr->dependencies() & variables_mask(variables))){ return expr->resolve(); }
+    if (BudgetScope::active()){ BudgetScope::admit(estimate_evaluate(*this, variables), "evaluate"); }
     return expr->evaluate(variables, values)->resolve();
 }
 
+// tabulates expression at n evenly spaced values of var from start to stop (both included)
+// other variables may be fixed by variables and values, unset ones are 0
+// writes n values to out
+template <typename T>
+void Expression<T>::sample(const std::string& var, T start, T stop, size_t n, T* out) const{
+    sample(var, start, stop, n, out, {}, {});
+}
+
+template <typename T>
+void Expression<T>::sample(const std::string& var, T start, T stop, size_t n, T* out,
+                           const std::vector<std::string>& variables, const std::vector<T>& values,
+                           bool allow_rewrites) const{
+    FlatExpression<T> flat = FlatExpression<T>(*this).prepared(allow_rewrites);
+    flat.sample(var, start, stop, n, out, flat.slot_values(variables, values));
+}
+
+// tabulates expression over a grid of vars, each swept from starts[i] to stops[i] in counts[i] points
+// writes counts[0] * ... * counts[k] values to out in row-major order (last variable changes fastest)
+template <typename T>
+void Expression<T>::sample_grid(const std::vector<std::string>& vars,
+                                const std::vector<T>& starts,
+                                const std::vector<T>& stops,
+                                const std::vector<size_t>& counts,
+                                T* out) const{
+    sample_grid(vars, starts, stops, counts, out, {}, {});
+}
+
+template <typename T>
+void Expression<T>::sample_grid(const std::vector<std::string>& vars,
+                                const std::vector<T>& starts,
+                                const std::vector<T>& stops,
+                                const std::vector<size_t>& counts,
+                                T* out,
+                                const std::vector<std::string>& variables, const std::vector<T>& values,
+                                bool allow_rewrites) const{
+    FlatExpression<T> flat = FlatExpression<T>(*this).prepared(allow_rewrites);
+    flat.sample_grid(vars, starts, stops, counts, out, flat.slot_values(variables, values));
+}
+
 
 /*operators*/
 
 template <typename T>
-Expression<T> Expression<T>::operator + (const Expression<T>& other) const{
-    return Expression<T>(std::make_shared<PlusNode<T>>(PlusNode<T>(expr, other.expr)));
+Expression<T> Expression<T>::operator + (Expression<T> other) const &{
+    return Expression<T>(std::make_shared<PlusNode<T>>(expr, std::move(other.expr)));
+}
+
+template <typename T>
+Expression<T> Expression<T>::operator + (Expression<T> other) &&{
+    return Expression<T>(std::make_shared<PlusNode<T>>(std::move(expr), std::move(other.expr)));
 }
 
 template <typename T>
-Expression<T> Expression<T>::operator - (const Expression<T>& other) const{
-    return Expression<T>(std::make_shared<MinusNode<T>>(MinusNode<T>(expr, other.expr)));
+Expression<T> Expression<T>::operator - (Expression<T> other) const &{
+    return Expression<T>(std::make_shared<MinusNode<T>>(expr, std::move(other.expr)));
 }
 
 template <typename T>
-Expression<T> Expression<T>::operator * (const Expression<T>& other) const{
-    return Expression<T>(std::make_shared<MultNode<T>>(MultNode<T>(expr, other.expr)));
+Expression<T> Expression<T>::operator - (Expression<T> other) &&{
+    return Expression<T>(std::make_shared<MinusNode<T>>(std::move(expr), std::move(other.expr)));
 }
 
 template <typename T>
-Expression<T> Expression<T>::operator / (const Expression<T>& other) const{
-    return Expression<T>(std::make_shared<DivNode<T>>(expr, other.expr));
+Expression<T> Expression<T>::operator * (Expression<T> other) const &{
+    return Expression<T>(std::make_shared<MultNode<T>>(expr, std::move(other.expr)));
 }
 
 template <typename T>
-Expression<T> Expression<T>::operator ^ (const Expression<T>& other) const{
-    return Expression<T>(std::make_shared<PowNode<T>>(expr, other.expr));
+Expression<T> Expression<T>::operator * (Expression<T> other) &&{
+    return Expression<T>(std::make_shared<MultNode<T>>(std::move(expr), std::move(other.expr)));
+}
+
+template <typename T>
+Expression<T> Expression<T>::operator / (Expression<T> other) const &{
+    return Expression<T>(std::make_shared<DivNode<T>>(expr, std::move(other.expr)));
+}
+
+template <typename T>
+Expression<T> Expression<T>::operator / (Expression<T> other) &&{
+    return Expression<T>(std::make_shared<DivNode<T>>(std::move(expr), std::move(other.expr)));
+}
+
+template <typename T>
+Expression<T> Expression<T>::operator ^ (Expression<T> other) const &{
+    return Expression<T>(std::make_shared<PowNode<T>>(expr, std::move(other.expr)));
+}
+
+template <typename T>
+Expression<T> Expression<T>::operator ^ (Expression<T> other) &&{
+    return Expression<T>(std::make_shared<PowNode<T>>(std::move(expr), std::move(other.expr)));
 }
 
 
 /*functions*/
 
 template <typename T>
-Expression<T> Expression<T>::sin(){
+Expression<T> Expression<T>::sin() const &{
     return Expression<T>(std::make_shared<SinNode<T>>(expr));
 }
 
 template <typename T>
-Expression<T> Expression<T>::cos(){
+Expression<T> Expression<T>::sin() &&{
+    return Expression<T>(std::make_shared<SinNode<T>>(std::move(expr)));
+}
+
+template <typename T>
+Expression<T> Expression<T>::cos() const &{
     return Expression<T>(std::make_shared<CosNode<T>>(expr));
 }
 
 template <typename T>
-Expression<T> Expression<T>::ln(){
+Expression<T> Expression<T>::cos() &&{
+    return Expression<T>(std::make_shared<CosNode<T>>(std::move(expr)));
+}
+
+template <typename T>
+Expression<T> Expression<T>::ln() const &{
     return Expression<T>(std::make_shared<LnNode<T>>(expr));
 }
 
 template <typename T>
-Expression<T> Expression<T>::exp(){
+Expression<T> Expression<T>::ln() &&{
+    return Expression<T>(std::make_shared<LnNode<T>>(std::move(expr)));
+}
+
+template <typename T>
+Expression<T> Expression<T>::exp() const &{
     return Expression<T>(std::make_shared<ExpNode<T>>(expr));
 }
 
+template <typename T>
+Expression<T> Expression<T>::exp() &&{
+    return Expression<T>(std::make_shared<ExpNode<T>>(std::move(expr)));
+}
+
 template <typename T>
 std::string Expression<T>::to_string() const{
     return expr->to_string();
 }
 
-template class Expression<long double>;
-//template class Expression<std::complex<long double>>;
+template <typename T>
+const std::shared_ptr<ExpressionNode<T>>& Expression<T>::root() const{
+    return expr;
+}
+
+// the names of the first 63 bits come from the root, names sharing the last bit
+// are collected from the subtrees where one of them occurs
+template <typename T>
+std::vector<std::string> Expression<T>::free_variables() const{
+    VariableMask mask = expr->dependencies();
+    std::vector<std::string> res = names_of(mask);
+    if (mask & bit_of(63)){
+        std::unordered_map<const ExpressionNode<T>*, bool> visited;
+        std::vector<const ExpressionNode<T>*> stack{expr.get()};
+        while (!stack.empty()){
+            const ExpressionNode<T>* node = stack.back();
+            stack.pop_back();
+            if (!(node->dependencies() & bit_of(63)) || !visited.emplace(node, true).second){ continue; }
+
+            if (node->kind() == NodeKind::Variable && node->dependencies() == bit_of(63)){
+                res.push_back(static_cast<const VariableNode<T>*>(node)->get_name());
+            } else if (node->kind() == NodeKind::Polynomial){
+                stack.push_back(static_cast<const PolynomialNode<T>*>(node)->lowered().get());
+            }
+            for (size_t i = 0; i < node->arity(); i++){ stack.push_back(node->operand(i).get()); }
+        }
+    }
+    std::sort(res.begin(), res.end());
+    res.erase(std::unique(res.begin(), res.end()), res.end());
+    return res;
+}
+
+// substitutes bound variables and folds constants
+template <typename T>
+Expression<T> Expression<T>::specialize(const std::map<std::string, T>& bound_vars) const{
+    auto number = [](const std::shared_ptr<ExpressionNode<T>>& node, T value){
+        return node->kind() == NodeKind::Number && static_cast<const NumberNode<T>*>(node.get())->value() == value;
+    };
+
+    // polynomials are specialized through their Horner form, untouched ones are kept
+    auto kept = [](const std::shared_ptr<ExpressionNode<T>>& node, const std::shared_ptr<ExpressionNode<T>>& res){
+        bool untouched = node->kind() == NodeKind::Polynomial && res == static_cast<const PolynomialNode<T>*>(node.get())->lowered();
+        return untouched ? node : res;
+    };
+
+    auto visit = [&](const std::shared_ptr<ExpressionNode<T>>& node, NodeResults<T, std::shared_ptr<ExpressionNode<T>>>& specialized){
+        size_t arity = node->arity();
+        std::shared_ptr<ExpressionNode<T>> res = node;
+        if (node->kind() == NodeKind::Variable){
+            auto bound = bound_vars.find(static_cast<const VariableNode<T>*>(node.get())->get_name());
+            if (bound != bound_vars.end()){ res = std::make_shared<NumberNode<T>>(bound->second); }
+        } else if (arity > 0){
+            std::shared_ptr<ExpressionNode<T>> left = kept(node->operand(0), specialized[node->operand(0).get()]);
+            std::shared_ptr<ExpressionNode<T>> right = arity > 1 ? kept(node->operand(1), specialized[node->operand(1).get()]) : nullptr;
+            bool constant = left->kind() == NodeKind::Number && (!right || right->kind() == NodeKind::Number);
+            NodeKind kind = node->kind();
+
+            if (constant){
+                res = std::make_shared<NumberNode<T>>(make_node<T>(kind, left, right)->resolve());
+            } else if ((kind == NodeKind::Plus && number(left, T(0))) || (kind == NodeKind::Mult && number(left, T(1)))){
+                res = right;
+            } else if (((kind == NodeKind::Plus || kind == NodeKind::Minus) && number(right, T(0))) ||
+                       ((kind == NodeKind::Mult || kind == NodeKind::Div || kind == NodeKind::Pow) && number(right, T(1)))){
+                res = left;
+            } else if (left != node->operand(0) || (right && right != node->operand(1))){
+                res = make_node<T>(kind, left, right);
+            }
+        }
+        return res;
+    };
+
+    return Expression<T>(kept(expr, post_order<std::shared_ptr<ExpressionNode<T>>>(expr, visit)));
+}
+
+// converts expression to another number type
+template <typename T>
+template <typename U>
+Expression<U> Expression<T>::convert() const{
+    auto visit = [](const std::shared_ptr<ExpressionNode<T>>& node,
+                    NodeResults<T, std::shared_ptr<ExpressionNode<U>>>& converted) -> std::shared_ptr<ExpressionNode<U>> {
+        switch (node->kind()){
+            case NodeKind::Number:
+                return std::make_shared<NumberNode<U>>(static_cast<U>(static_cast<const NumberNode<T>*>(node.get())->value()));
+            case NodeKind::Variable:
+                return std::make_shared<VariableNode<U>>(static_cast<const VariableNode<T>*>(node.get())->get_name());
+            default:
+                return make_node<U>(node->kind(),
+                                    converted[node->operand(0).get()],
+                                    node->arity() > 1 ? converted[node->operand(1).get()] : nullptr);
+        }
+    };
+
+    // polynomials are converted through their Horner form
+    return Expression<U>(post_order<std::shared_ptr<ExpressionNode<U>>>(expr, visit));
+}
+
+
+/*ACCUMULATORS*/
+
+template <typename T>
+ExpressionAccumulator<T>::ExpressionAccumulator(NodeKind kind) : kind_(kind) {
+    if (kind != NodeKind::Plus && kind != NodeKind::Mult){
+        throw std::invalid_argument("an accumulator builds sums or products");
+    }
+}
+
+template <typename T>
+void ExpressionAccumulator<T>::reserve(size_t operands){
+    operands_.reserve(operands);
+}
+
+template <typename T>
+ExpressionAccumulator<T>& ExpressionAccumulator<T>::add(const Expression<T>& operand){
+    operands_.push_back(operand.root());
+    return *this;
+}
+
+template <typename T>
+ExpressionAccumulator<T>& ExpressionAccumulator<T>::add(Expression<T>&& operand){
+    operands_.push_back(std::move(operand.expr));
+    return *this;
+}
+
+template <typename T>
+size_t ExpressionAccumulator<T>::size() const { return operands_.size(); }
+
+// combines neighbours level by level in place, every level halves the operands
+template <typename T>
+Expression<T> ExpressionAccumulator<T>::build(){
+    if (operands_.empty()){ return Expression<T>(T(kind_ == NodeKind::Plus ? 0 : 1)); }
+    for (size_t count = operands_.size(); count > 1; count = (count + 1) / 2){
+        for (size_t i = 0; i < count / 2; i++){
+            std::shared_ptr<ExpressionNode<T>>& left = operands_[2 * i];
+            std::shared_ptr<ExpressionNode<T>>& right = operands_[2 * i + 1];
+            if (kind_ == NodeKind::Plus){
+                operands_[i] = std::make_shared<PlusNode<T>>(std::move(left), std::move(right));
+            } else {
+                operands_[i] = std::make_shared<MultNode<T>>(std::move(left), std::move(right));
+            }
+        }
+        if (count % 2 == 1){ operands_[count / 2] = std::move(operands_[count - 1]); }
+    }
+    Expression<T> res(std::move(operands_[0]));
+    operands_.clear();
+    return res;
+}
+
+
+/*LAZY DERIVATIVES*/
+
+template <typename T>
+DiffView<T>::DiffView(const Expression<T>& expression, const std::string& var) : expr_(expression), var_(var) {}
+
+template <typename T>
+T DiffView<T>::eval_and_resolve(const std::vector<std::string>& variables, const std::vector<T>& values) const{
+    return value_and_derivative(variables, values).second;
+}
+
+// forward mode over the tree: every node yields its value and derivative from those of its operands
+template <typename T>
+std::pair<T, T> DiffView<T>::value_and_derivative(const std::vector<std::string>& variables, const std::vector<T>& values) const{
+    using Dual = std::pair<T, T>;
+    // reused between calls, a pass allocates only when a buffer grows
+    thread_local std::vector<std::pair<const std::shared_ptr<ExpressionNode<T>>*, bool>> stack;
+    thread_local std::vector<Dual> results;
+    // results of subtrees referenced from several places, nodes owned once are computed without a lookup
+    thread_local std::unordered_map<const ExpressionNode<T>*, Dual> shared;
+    stack.clear();
+    results.clear();
+    shared.clear();
+
+    // iterative post-order traversal, operand results are on top of the results stack
+    stack.push_back({&expr_.root(), false});
+    while (!stack.empty()){
+        auto [pointer, expanded] = stack.back();
+        stack.pop_back();
+        const ExpressionNode<T>* node = pointer->get();
+        bool is_shared = pointer->use_count() > 1;
+
+        if (!expanded){
+            if (is_shared){
+                auto found = shared.find(node);
+                if (found != shared.end()){
+                    results.push_back(found->second);
+                    continue;
+                }
+            }
+            if (node->kind() == NodeKind::Polynomial){
+                // polynomials are differentiated through their Horner form
+                stack.push_back({pointer, true});
+                stack.push_back({&static_cast<const PolynomialNode<T>*>(node)->lowered(), false});
+                continue;
+            }
+            if (node->arity() > 0){
+                stack.push_back({pointer, true});
+                for (size_t i = node->arity(); i-- > 0;){
+                    stack.push_back({&node->operand(i), false});
+                }
+                continue;
+            }
+        }
+
+        Dual res;
+        if (node->kind() == NodeKind::Polynomial){
+            res = results.back();
+            results.pop_back();
+        } else if (node->kind() == NodeKind::Number){
+            res = {static_cast<const NumberNode<T>*>(node)->value(), T(0)};
+        } else if (node->kind() == NodeKind::Variable){
+            const std::string& name = static_cast<const VariableNode<T>*>(node)->get_name();
+            auto found = std::find(variables.begin(), variables.end(), name);
+            res = {found == variables.end() ? T(0) : values[found - variables.begin()], T(name == var_ ? 1 : 0)};
+        } else {
+            Dual right = node->arity() > 1 ? results.back() : Dual{};
+            if (node->arity() > 1){ results.pop_back(); }
+            auto [a, da] = results.back();
+            auto [b, db] = right;
+            results.pop_back();
+
+            switch (node->kind()){
+                case NodeKind::Plus:  res = {a + b, da + db}; break;
+                case NodeKind::Minus: res = {a - b, da - db}; break;
+                case NodeKind::Mult:  res = {a * b, da * b + a * db}; break;
+                case NodeKind::Div:   res = {a / b, (da * b - a * db) / (b * b)}; break;
+                case NodeKind::Pow: {
+                    // (f^g)' = g * f^(g - 1) * f' + f^g * ln(f) * g', terms with a zero derivative are left out
+                    T power = std::pow(a, b);
+                    T derivative = T(0);
+                    if (da != T(0)){ derivative += b * std::pow(a, b - T(1)) * da; }
+                    if (db != T(0)){ derivative += power * std::log(a) * db; }
+                    res = {power, derivative};
+                    break;
+                }
+                case NodeKind::Sin: res = {std::sin(a), std::cos(a) * da}; break;
+                case NodeKind::Cos: res = {std::cos(a), -std::sin(a) * da}; break;
+                case NodeKind::Ln:  res = {std::log(a), da / a}; break;
+                case NodeKind::Exp: {
+                    T value = std::exp(a);
+                    res = {value, value * da};
+                    break;
+                }
+                default:
+                    throw std::invalid_argument("lazy derivative of an unsupported node");
+            }
+        }
+        if (is_shared){ shared.emplace(node, res); }
+        results.push_back(res);
+    }
+
+    return results.back();
+}
+
+template <typename T>
+Expression<T> DiffView<T>::expression() const{
+    return expr_.diff(var_);
+}
+
+template <typename T>
+std::string DiffView<T>::to_string() const{
+    return expression().to_string();
+}
+
+template <typename T>
+Expression<T> DiffView<T>::diff(const std::string& var) const{
+    return expression().diff(var);
+}
+
+template <typename T>
+DiffView<T> DiffView<T>::lazy_diff(const std::string& var) const{
+    return DiffView<T>(expression(), var);
+}
+
+template <typename T>
+const Expression<T>& DiffView<T>::base() const{
+    return expr_;
+}
+
+template <typename T>
+const std::string& DiffView<T>::var() const{
+    return var_;
+}
+
+
+/*NODE FACTORY*/
+
+template <typename T>
+std::shared_ptr<ExpressionNode<T>> make_node(NodeKind kind,
+                                             const std::shared_ptr<ExpressionNode<T>> &left,
+                                             const std::shared_ptr<ExpressionNode<T>> &right){
+    switch (kind){
+        case NodeKind::Plus:  return std::make_shared<PlusNode<T>>(left, right);
+        case NodeKind::Minus: return std::make_shared<MinusNode<T>>(left, right);
+        case NodeKind::Mult:  return std::make_shared<MultNode<T>>(left, right);
+        case NodeKind::Div:   return std::make_shared<DivNode<T>>(left, right);
+        case NodeKind::Pow:   return std::make_shared<PowNode<T>>(left, right);
+        case NodeKind::Sin:   return std::make_shared<SinNode<T>>(left);
+        case NodeKind::Cos:   return std::make_shared<CosNode<T>>(left);
+        case NodeKind::Ln:    return std::make_shared<LnNode<T>>(left);
+        case NodeKind::Exp:   return std::make_shared<ExpNode<T>>(left);
+        default:
+            throw std::invalid_argument("make_node can't create leaf or polynomial nodes");
+    }
+}
+
+#define INSTANTIATE_EXPRESSION(T) \
+    template std::string number_to_string(const T&); \
+    template class NumberNode<T>; \
+    template class VariableNode<T>; \
+    template class PlusNode<T>; \
+    template class MinusNode<T>; \
+    template class MultNode<T>; \
+    template class DivNode<T>; \
+    template class PowNode<T>; \
+    template class SinNode<T>; \
+    template class CosNode<T>; \
+    template class LnNode<T>; \
+    template class ExpNode<T>; \
+    template class Expression<T>; \
+    template class ExpressionAccumulator<T>; \
+    template class DiffView<T>; \
+    template std::shared_ptr<ExpressionNode<T>> make_node(NodeKind, \
+                                                          const std::shared_ptr<ExpressionNode<T>>&, \
+                                                          const std::shared_ptr<ExpressionNode<T>>&);
+
+INSTANTIATE_EXPRESSION(float)
+INSTANTIATE_EXPRESSION(double)
+INSTANTIATE_EXPRESSION(long double)
+INSTANTIATE_EXPRESSION(std::complex<long double>)
+
+// conversions between real precisions
+#define INSTANTIATE_CONVERT(T, U) \
+    template Expression<U> Expression<T>::convert<U>() const;
+
+INSTANTIATE_CONVERT(long double, double)
+INSTANTIATE_CONVERT(long double, float)
+INSTANTIATE_CONVERT(double, long double)
+INSTANTIATE_CONVERT(double, float)
+INSTANTIATE_CONVERT(float, long double)
+INSTANTIATE_CONVERT(float, double)
+
+#undef INSTANTIATE_CONVERT
+#undef INSTANTIATE_EXPRESSION
 
 } // namespace Expressions
\ No newline at end of file
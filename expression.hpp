@@ -8,9 +8,44 @@
 #include <complex>
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include <utility>
+#include <unordered_map>
 
 namespace Expressions {
 
+// kinds of expression tree nodes
+enum class NodeKind
+{
+    Number,     // NumberNode
+    Variable,   // VariableNode
+    Plus,       // PlusNode
+    Minus,      // MinusNode
+    Mult,       // MultNode
+    Div,        // DivNode
+    Pow,        // PowNode
+    Sin,        // SinNode
+    Cos,        // CosNode
+    Ln,         // LnNode
+    Exp,        // ExpNode
+    Polynomial, // PolynomialNode, see polynomial.hpp
+    Sqrt,       // square root, only in flat expressions produced by FlatExpression<T>::optimize
+};
+
+// set of variables, one bit per variable name
+// names are numbered in the order the library first sees them, the names from the 64th on share the last bit,
+// so that bit only says one of them may occur
+using VariableMask = uint64_t;
+
+// bit of a variable name, numbers the name if it's new
+VariableMask variable_bit(const std::string& name);
+// bits of known names, a name never seen has none since no node can depend on it
+VariableMask variable_mask(const std::string& name);
+VariableMask variables_mask(const std::vector<std::string>& names);
+
+// thread safety: nodes are immutable once constructed, every operation builds new nodes,
+// so one expression may be evaluated, differentiated and printed from many threads at once
+// an Expression object itself is not synchronized, assigning to it while other threads use it is a race
 template <typename T>
 class ExpressionNode{
 public:
@@ -20,6 +55,20 @@ public:
     virtual T resolve() const = 0;
     virtual std::shared_ptr<ExpressionNode<T>> diff(const std::string &var) const = 0;
     virtual std::string to_string() const = 0;
+
+    // node introspection
+    virtual NodeKind kind() const = 0;
+    // number of operands (0 for numbers and variables)
+    virtual size_t arity() const = 0;
+    // i-th operand, throws std::out_of_range if there is none
+    virtual const std::shared_ptr<ExpressionNode<T>>& operand(size_t i) const = 0;
+
+    // variables the subtree depends on, computed by the constructors
+    // diff() of an independent subtree is 0 and evaluate() shares the operands not depending on bound variables
+    VariableMask dependencies() const { return dependencies_; }
+
+protected:
+    VariableMask dependencies_ = 0;
 };
 
 template <typename T>
@@ -29,10 +78,14 @@ private:
 public:
     explicit NumberNode(T num);
     ~NumberNode() = default;
+    T value() const;
     virtual std::shared_ptr<ExpressionNode<T>> evaluate(std::vector<std::string> variables, std::vector<T> values) const override;
     virtual T resolve() const override;
     virtual std::shared_ptr<ExpressionNode<T>> diff(const std::string &var) const override;
     virtual std::string to_string() const override;
+    virtual NodeKind kind() const override;
+    virtual size_t arity() const override;
+    virtual const std::shared_ptr<ExpressionNode<T>>& operand(size_t i) const override;
 };
 
 template <typename T>
@@ -42,10 +95,14 @@ private:
 public:
     VariableNode(std::string name);
     ~VariableNode() = default;
+    const std::string& get_name() const;
     virtual std::shared_ptr<ExpressionNode<T>> evaluate(std::vector<std::string> variables, std::vector<T> values) const override;
     virtual T resolve() const override;
     virtual std::shared_ptr<ExpressionNode<T>> diff(const std::string &var) const override;
     virtual std::string to_string() const override;
+    virtual NodeKind kind() const override;
+    virtual size_t arity() const override;
+    virtual const std::shared_ptr<ExpressionNode<T>>& operand(size_t i) const override;
 };
 
 template <typename T>
@@ -54,12 +111,15 @@ private:
     std::shared_ptr<ExpressionNode<T>> left;
     std::shared_ptr<ExpressionNode<T>> right;
 public:
-    explicit PlusNode(const std::shared_ptr<ExpressionNode<T>> &left, const std::shared_ptr<ExpressionNode<T>> &right);
+    explicit PlusNode(std::shared_ptr<ExpressionNode<T>> left, std::shared_ptr<ExpressionNode<T>> right);
     ~PlusNode() = default;
     virtual std::shared_ptr<ExpressionNode<T>> evaluate(std::vector<std::string> variables, std::vector<T> values) const override;
     virtual  T resolve() const override;
     virtual std::shared_ptr<ExpressionNode<T>> diff(const std::string &var) const override;
     virtual std::string to_string() const override;
+    virtual NodeKind kind() const override;
+    virtual size_t arity() const override;
+    virtual const std::shared_ptr<ExpressionNode<T>>& operand(size_t i) const override;
 };
 
 template <typename T>
@@ -68,12 +128,15 @@ private:
     std::shared_ptr<ExpressionNode<T>> left;
     std::shared_ptr<ExpressionNode<T>> right;
 public:
-    explicit MinusNode(const std::shared_ptr<ExpressionNode<T>> &left, const std::shared_ptr<ExpressionNode<T>> &right);
+    explicit MinusNode(std::shared_ptr<ExpressionNode<T>> left, std::shared_ptr<ExpressionNode<T>> right);
     ~MinusNode() = default;
     virtual std::shared_ptr<ExpressionNode<T>> evaluate(std::vector<std::string> variables, std::vector<T> values) const override;
     virtual T resolve() const override;
     virtual std::shared_ptr<ExpressionNode<T>> diff(const std::string &var) const override;
     virtual std::string to_string() const override;
+    virtual NodeKind kind() const override;
+    virtual size_t arity() const override;
+    virtual const std::shared_ptr<ExpressionNode<T>>& operand(size_t i) const override;
 };
 
 template <typename T>
@@ -82,12 +145,15 @@ private:
     std::shared_ptr<ExpressionNode<T>> left;
     std::shared_ptr<ExpressionNode<T>> right;
 public:
-    explicit MultNode(const std::shared_ptr<ExpressionNode<T>> &left, const std::shared_ptr<ExpressionNode<T>> &right);
+    explicit MultNode(std::shared_ptr<ExpressionNode<T>> left, std::shared_ptr<ExpressionNode<T>> right);
     ~MultNode() = default;
     virtual std::shared_ptr<ExpressionNode<T>> evaluate(std::vector<std::string> variables, std::vector<T> values) const override;
     virtual T resolve() const override;
     virtual std::shared_ptr<ExpressionNode<T>> diff(const std::string &var) const override;
     virtual std::string to_string() const override;
+    virtual NodeKind kind() const override;
+    virtual size_t arity() const override;
+    virtual const std::shared_ptr<ExpressionNode<T>>& operand(size_t i) const override;
 };
 
 template <typename T>
@@ -96,12 +162,15 @@ private:
     std::shared_ptr<ExpressionNode<T>> left;
     std::shared_ptr<ExpressionNode<T>> right;
 public:
-    explicit DivNode(const std::shared_ptr<ExpressionNode<T>> &left, const std::shared_ptr<ExpressionNode<T>> &right);
+    explicit DivNode(std::shared_ptr<ExpressionNode<T>> left, std::shared_ptr<ExpressionNode<T>> right);
     ~DivNode() = default;
     virtual std::shared_ptr<ExpressionNode<T>> evaluate(std::vector<std::string> variables, std::vector<T> values) const override;
     virtual T resolve() const override;
     virtual std::shared_ptr<ExpressionNode<T>> diff(const std::string &var) const override;
     virtual std::string to_string() const override;
+    virtual NodeKind kind() const override;
+    virtual size_t arity() const override;
+    virtual const std::shared_ptr<ExpressionNode<T>>& operand(size_t i) const override;
 };
 
 template <typename T>
@@ -110,12 +179,15 @@ private:
     std::shared_ptr<ExpressionNode<T>> left;
     std::shared_ptr<ExpressionNode<T>> right;
 public:
-    explicit PowNode(const std::shared_ptr<ExpressionNode<T>> &left, const std::shared_ptr<ExpressionNode<T>> &right);
+    explicit PowNode(std::shared_ptr<ExpressionNode<T>> left, std::shared_ptr<ExpressionNode<T>> right);
     ~PowNode() = default;
     virtual std::shared_ptr<ExpressionNode<T>> evaluate(std::vector<std::string> variables, std::vector<T> values) const override;
     virtual T resolve() const override;
     virtual std::shared_ptr<ExpressionNode<T>> diff(const std::string &var) const override;
     virtual std::string to_string() const override;
+    virtual NodeKind kind() const override;
+    virtual size_t arity() const override;
+    virtual const std::shared_ptr<ExpressionNode<T>>& operand(size_t i) const override;
 };
 
 template <typename T>
@@ -129,6 +201,9 @@ public:
     virtual T resolve() const override;
     virtual std::shared_ptr<ExpressionNode<T>> diff(const std::string &var) const override;
     virtual std::string to_string() const override;
+    virtual NodeKind kind() const override;
+    virtual size_t arity() const override;
+    virtual const std::shared_ptr<ExpressionNode<T>>& operand(size_t i) const override;
 };
 
 template <typename T>
@@ -142,6 +217,9 @@ public:
     virtual T resolve() const override;
     virtual std::shared_ptr<ExpressionNode<T>> diff(const std::string &var) const override;
     virtual std::string to_string() const override;
+    virtual NodeKind kind() const override;
+    virtual size_t arity() const override;
+    virtual const std::shared_ptr<ExpressionNode<T>>& operand(size_t i) const override;
 };
 
 template <typename T>
@@ -155,6 +233,9 @@ public:
     virtual T resolve() const override;
     virtual std::shared_ptr<ExpressionNode<T>> diff(const std::string &var) const override;
     virtual std::string to_string() const override;
+    virtual NodeKind kind() const override;
+    virtual size_t arity() const override;
+    virtual const std::shared_ptr<ExpressionNode<T>>& operand(size_t i) const override;
 };
 
 template <typename T>
@@ -168,38 +249,213 @@ public:
     virtual T resolve() const override;
     virtual std::shared_ptr<ExpressionNode<T>> diff(const std::string &var) const override;
     virtual std::string to_string() const override;
+    virtual NodeKind kind() const override;
+    virtual size_t arity() const override;
+    virtual const std::shared_ptr<ExpressionNode<T>>& operand(size_t i) const override;
 };
 
 
+// text of a number as NumberNode<T>::to_string prints it, without creating a node
+template <typename T>
+std::string number_to_string(const T& value);
+
+template <typename T> class PolynomialNode;
+
+// results of the nodes visited by post_order
+template <typename T, typename R>
+using NodeResults = std::unordered_map<const ExpressionNode<T>*, R>;
+
+// iterative post-order traversal, deep trees don't overflow the stack
+// every node reachable from root is visited once, after its operands: visit(node, results) returns the result
+// of node, results holds those of the nodes visited so far, its operands among them; returns the result of root
+// a polynomial node takes the result of its Horner form without a visit of its own, unless lower_polynomials
+// is false, then it's visited as a leaf; callers include polynomial.hpp
+template <typename R, typename T, typename Visit>
+R post_order(const std::shared_ptr<ExpressionNode<T>>& root, Visit&& visit, bool lower_polynomials = true){
+    NodeResults<T, R> results;
+    std::vector<std::pair<const std::shared_ptr<ExpressionNode<T>>*, bool>> stack{{&root, false}};
+    while (!stack.empty()){
+        auto [pointer, expanded] = stack.back();
+        stack.pop_back();
+        const ExpressionNode<T>* node = pointer->get();
+        if (results.contains(node)){ continue; }
+
+        size_t arity = node->arity();
+        if (!expanded && arity > 0){
+            stack.push_back({pointer, true});
+            for (size_t i = arity; i-- > 0;){
+                stack.push_back({&node->operand(i), false});
+            }
+            continue;
+        }
+        if (lower_polynomials && node->kind() == NodeKind::Polynomial){
+            const std::shared_ptr<ExpressionNode<T>>& lowered = static_cast<const PolynomialNode<T>*>(node)->lowered();
+            if (!expanded){
+                stack.push_back({pointer, true});
+                stack.push_back({&lowered, false});
+            } else {
+                R res = results[lowered.get()];
+                results.emplace(node, std::move(res));
+            }
+            continue;
+        }
+
+        R res = visit(*pointer, results);
+        results.emplace(node, std::move(res));
+    }
+    return std::move(results[root.get()]);
+}
+
+// creates an operation node of the given kind
+// right operand is ignored for functions, leaves can't be created this way
+template <typename T>
+std::shared_ptr<ExpressionNode<T>> make_node(NodeKind kind,
+                                             const std::shared_ptr<ExpressionNode<T>> &left,
+                                             const std::shared_ptr<ExpressionNode<T>> &right = nullptr);
+
+
+template <typename T> class DiffView;
+template <typename T> class ExpressionAccumulator;
+
 template <typename T> class Expression{
 private:
     std::shared_ptr<ExpressionNode<T>> expr; // root of expression tree
+    friend class ExpressionAccumulator<T>;
 public:
     Expression(T num);
     Expression(const std::string& expression);
     Expression(std::shared_ptr<ExpressionNode<T>> expression);
     Expression(const Expression<T>& other);
-    Expression<T> operator = (const Expression<T>& other);
-    Expression<T> operator = (const Expression<T>&& other);
+    // a moved-from expression has no root, it may only be assigned to or destroyed
+    Expression(Expression<T>&& other) noexcept;
+    Expression<T>& operator = (const Expression<T>& other);
+    Expression<T>& operator = (Expression<T>&& other) noexcept;
     ~Expression() = default;
 
     Expression<T> diff(const std::string var) const;
-    Expression<T> evaluate(std::vector<std::string> variables, std::vector<T> values);
-    T resolve();
-    T eval_and_resolve(std::vector<std::string> variables, std::vector<T> values);
+    // derivative by var without building its tree, see DiffView<T>
+    DiffView<T> lazy_diff(const std::string& var) const;
+    // substitutes the given variable values, other variables stay; subtrees without bound variables are shared
+    Expression<T> evaluate(std::vector<std::string> variables, std::vector<T> values) const;
+    T resolve() const;
+    T eval_and_resolve(std::vector<std::string> variables, std::vector<T> values) const;
+
+    // tabulation into caller-provided buffers without rebuilding the tree per point
+    // the values are those of eval_and_resolve unless allow_rewrites also strength reduces
+    // the expression, see FlatExpression<T>::optimize()
+    void sample(const std::string& var, T start, T stop, size_t n, T* out) const;
+    void sample(const std::string& var, T start, T stop, size_t n, T* out,
+                const std::vector<std::string>& variables, const std::vector<T>& values,
+                bool allow_rewrites = false) const;
+    void sample_grid(const std::vector<std::string>& vars,
+                     const std::vector<T>& starts,
+                     const std::vector<T>& stops,
+                     const std::vector<size_t>& counts,
+                     T* out) const;
+    void sample_grid(const std::vector<std::string>& vars,
+                     const std::vector<T>& starts,
+                     const std::vector<T>& stops,
+                     const std::vector<size_t>& counts,
+                     T* out,
+                     const std::vector<std::string>& variables, const std::vector<T>& values,
+                     bool allow_rewrites = false) const;
 
-    Expression<T> operator + (const Expression<T>& other) const;
-    Expression<T> operator - (const Expression<T>& other) const;
-    Expression<T> operator * (const Expression<T>& other) const;
-    Expression<T> operator / (const Expression<T>& other) const;
-    Expression<T> operator ^ (const Expression<T>& other) const;
+    // the new node takes the roots of rvalue operands over instead of copying them,
+    // so a chain like a * b + c moves every intermediate result
+    Expression<T> operator + (Expression<T> other) const &;
+    Expression<T> operator + (Expression<T> other) &&;
+    Expression<T> operator - (Expression<T> other) const &;
+    Expression<T> operator - (Expression<T> other) &&;
+    Expression<T> operator * (Expression<T> other) const &;
+    Expression<T> operator * (Expression<T> other) &&;
+    Expression<T> operator / (Expression<T> other) const &;
+    Expression<T> operator / (Expression<T> other) &&;
+    Expression<T> operator ^ (Expression<T> other) const &;
+    Expression<T> operator ^ (Expression<T> other) &&;
 
-    Expression<T> sin();
-    Expression<T> cos();
-    Expression<T> ln();
-    Expression<T> exp();
+    Expression<T> sin() const &;
+    Expression<T> sin() &&;
+    Expression<T> cos() const &;
+    Expression<T> cos() &&;
+    Expression<T> ln() const &;
+    Expression<T> ln() &&;
+    Expression<T> exp() const &;
+    Expression<T> exp() &&;
 
     std::string to_string() const;
+
+    // root node of the expression tree
+    const std::shared_ptr<ExpressionNode<T>>& root() const;
+
+    // names of the variables of the expression, sorted
+    std::vector<std::string> free_variables() const;
+
+    // partial evaluation: substitutes the bound variables and folds every constant subtree into one number,
+    // along with the identities x + 0, x - 0, x * 1, x / 1 and x ^ 1
+    // unchanged subtrees are shared with this expression
+    Expression<T> specialize(const std::map<std::string, T>& bound_vars) const;
+
+    // copy of the expression with numbers converted to another type, e.g. long double to double
+    // shared subtrees stay shared
+    template <typename U> Expression<U> convert() const;
+};
+
+// sum or product of many operands built in place: the operands are collected first and build()
+// creates the tree once, without an intermediate expression per operand
+// the tree is balanced, its depth grows with log(size()) instead of size(); operands are combined
+// pairwise, so floating point results may differ in the last bits from a left fold
+template <typename T>
+class ExpressionAccumulator
+{
+private:
+    NodeKind kind_;
+    std::vector<std::shared_ptr<ExpressionNode<T>>> operands_;
+
+public:
+    // kind is NodeKind::Plus or NodeKind::Mult, throws std::invalid_argument otherwise
+    explicit ExpressionAccumulator(NodeKind kind = NodeKind::Plus);
+    ~ExpressionAccumulator() = default;
+
+    void reserve(size_t operands);
+    ExpressionAccumulator<T>& add(const Expression<T>& operand);
+    ExpressionAccumulator<T>& add(Expression<T>&& operand);
+    size_t size() const;
+
+    // an empty sum is 0 and an empty product 1, the accumulator is empty afterwards
+    Expression<T> build();
+};
+
+// lazy derivative of an expression by one variable
+// evaluation walks the tree of the expression once, applying the differentiation rules to the values
+// of every node and its operands (forward mode), so no derivative tree is allocated
+// the tree is materialized by expression(), to_string() and diff() only
+// where the base of a power is negative and the exponent constant the value is defined,
+// unlike the ln(f) * g' term of the materialized tree
+template <typename T>
+class DiffView
+{
+private:
+    Expression<T> expr_;
+    std::string var_;
+
+public:
+    DiffView(const Expression<T>& expression, const std::string& var);
+    ~DiffView() = default;
+
+    // value of the derivative, variables not given are 0 like in Expression<T>::eval_and_resolve
+    T eval_and_resolve(const std::vector<std::string>& variables, const std::vector<T>& values) const;
+    // value of the expression and of its derivative from the same pass
+    std::pair<T, T> value_and_derivative(const std::vector<std::string>& variables, const std::vector<T>& values) const;
+
+    // the derivative tree, same as base().diff(var())
+    Expression<T> expression() const;
+    std::string to_string() const;
+    // further derivatives differentiate the materialized tree, lazy_diff() keeps the last step lazy
+    Expression<T> diff(const std::string& var) const;
+    DiffView<T> lazy_diff(const std::string& var) const;
+
+    const Expression<T>& base() const;
+    const std::string& var() const;
 };
 } // namespace Expressions
 
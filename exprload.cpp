@@ -0,0 +1,80 @@
+#include "server.hpp"
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <algorithm>
+
+// load generator for exprd: every client thread sends requests over its own connection,
+// cycling through the served expressions with random variable values
+// usage: exprload.exe <socket> [clients] [requests per client] [rows per request]
+// reports throughput and the p50 and p99 request latency
+
+int main(int argc, char** argv){
+    if (argc < 2){
+        std::cerr << "usage: " << argv[0] << " <socket> [clients] [requests per client] [rows per request]\n";
+        return 2;
+    }
+    std::string socket_path = argv[1];
+    size_t clients = argc > 2 ? std::stoul(argv[2]) : 4;
+    size_t requests = argc > 3 ? std::stoul(argv[3]) : 10000;
+    size_t rows = argc > 4 ? std::stoul(argv[4]) : 1;
+
+    // latencies of every request in ns, one vector per client
+    std::vector<std::vector<double>> latencies(clients);
+    std::vector<std::string> errors(clients);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < clients; c++){
+        threads.emplace_back([&, c](){
+            try {
+                Expressions::EvaluationClient<double> client(socket_path);
+                size_t count = client.count();
+                if (count == 0){ throw std::runtime_error("the server has no expressions"); }
+                std::vector<size_t> columns;
+                for (size_t e = 0; e < count; e++){ columns.push_back(client.variables(e).size()); }
+
+                std::mt19937_64 random(c);
+                std::uniform_real_distribution<double> uniform(0.1, 2);
+                std::vector<double> values;
+                std::vector<double> out(rows);
+                latencies[c].reserve(requests);
+
+                for (size_t r = 0; r < requests; r++){
+                    size_t e = (c + r) % count;
+                    values.resize(rows * columns[e]);
+                    for (double& value : values){ value = uniform(random); }
+
+                    auto sent = std::chrono::steady_clock::now();
+                    client.evaluate(e, rows, columns[e], values.data(), out.data());
+                    auto received = std::chrono::steady_clock::now();
+                    latencies[c].push_back(std::chrono::duration<double, std::nano>(received - sent).count());
+                }
+            } catch (const std::exception& error) {
+                errors[c] = error.what();
+            }
+        });
+    }
+    for (std::thread& thread : threads){ thread.join(); }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (const std::string& error : errors){
+        if (!error.empty()){
+            std::cerr << error << "\n";
+            return 1;
+        }
+    }
+
+    std::vector<double> all;
+    for (const std::vector<double>& client : latencies){ all.insert(all.end(), client.begin(), client.end()); }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p){ return all.empty() ? 0 : all[std::min(all.size() - 1, size_t(p * all.size()))] / 1000; };
+
+    std::cout << clients << " clients, " << all.size() << " requests of " << rows << " rows in " << seconds << " s\n"
+              << "    " << all.size() / seconds << " requests/s, " << all.size() * rows / seconds << " rows/s\n"
+              << "    latency p50 " << percentile(0.5) << " us, p99 " << percentile(0.99) << " us\n";
+    return 0;
+}
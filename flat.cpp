@@ -0,0 +1,750 @@
+#include <string>
+#include <vector>
+#include <complex>
+#include <unordered_map>
+#include <functional>
+#include <stdexcept>
+#include <algorithm>
+#include "flat.hpp"
+#include "polynomial.hpp"
+
+namespace Expressions {
+
+namespace {
+
+// identifies a node by its contents, used to store identical subtrees once
+template <typename T>
+struct NodeKey
+{
+    NodeKind kind;
+    uint32_t left;
+    uint32_t right;
+    T value;
+
+    bool operator == (const NodeKey<T>& other) const {
+        return kind == other.kind && left == other.left && right == other.right && same_bits(value, other.value);
+    }
+};
+
+template <typename T>
+struct NodeKeyHash
+{
+    size_t operator () (const NodeKey<T>& key) const {
+        size_t h = static_cast<size_t>(key.kind);
+        h = h * 1000003 + key.left;
+        h = h * 1000003 + key.right;
+        return h * 1000003 + hash_bits(key.value);
+    }
+};
+
+// appends nodes to a flat expression, reusing identical ones
+template <typename T>
+class FlatBuilder
+{
+public:
+    std::vector<FlatNode<T>> nodes;
+    std::vector<std::string> variables;
+    std::unordered_map<NodeKey<T>, uint32_t, NodeKeyHash<T>> index;
+    std::unordered_map<std::string, uint32_t> slots;
+
+    uint32_t add(NodeKind kind, uint32_t left, uint32_t right, T value){
+        NodeKey<T> key{kind, left, right, value};
+        auto found = index.find(key);
+        if (found != index.end()){ return found->second; }
+
+        uint32_t id = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(FlatNode<T>{kind, left, right, value});
+        index.emplace(key, id);
+        return id;
+    }
+
+    uint32_t number(T value){ return add(NodeKind::Number, 0, 0, value); }
+
+    uint32_t variable(const std::string& name){
+        auto found = slots.find(name);
+        uint32_t slot;
+        if (found != slots.end()){
+            slot = found->second;
+        } else {
+            slot = static_cast<uint32_t>(variables.size());
+            variables.push_back(name);
+            slots.emplace(name, slot);
+        }
+        return add(NodeKind::Variable, slot, 0, T(0));
+    }
+
+    uint32_t op(NodeKind kind, uint32_t left, uint32_t right = 0){ return add(kind, left, right, T(0)); }
+
+    // copies node i of another flat expression whose operands were already mapped
+    uint32_t copy(const FlatNode<T>& node, const std::vector<std::string>& names, const std::vector<uint32_t>& mapped){
+        switch (node.kind){
+            case NodeKind::Number:   return number(node.value);
+            case NodeKind::Variable: return variable(names[node.left]);
+            case NodeKind::Sin:
+            case NodeKind::Cos:
+            case NodeKind::Ln:
+            case NodeKind::Exp:
+            case NodeKind::Sqrt:     return op(node.kind, mapped[node.left]);
+            default:                 return op(node.kind, mapped[node.left], mapped[node.right]);
+        }
+    }
+};
+
+// largest exponent turned into a multiplication chain by optimize
+constexpr int POW_CHAIN_MAX = 32;
+
+bool is_unary(NodeKind kind){
+    return kind == NodeKind::Sin || kind == NodeKind::Cos || kind == NodeKind::Ln || kind == NodeKind::Exp ||
+           kind == NodeKind::Sqrt;
+}
+
+template <typename T>
+struct is_complex : std::false_type {};
+
+template <typename T>
+struct is_complex<std::complex<T>> : std::true_type {};
+
+// checks that a constant is an integer small enough for a multiplication chain
+template <typename T>
+bool small_integer(const T& value, int& n){
+    if (!(std::abs(value) <= T(POW_CHAIN_MAX)) || std::floor(value) != value){ return false; }
+    n = static_cast<int>(value);
+    return true;
+}
+
+template <typename T>
+bool small_integer(const std::complex<T>& value, int& n){
+    return value.imag() == 0 && small_integer(value.real(), n);
+}
+
+// true if the node is >= +0 or NaN for every input, looking at most depth levels down
+// exp(ln(x)) = x holds for these, ln turns negative x into NaN
+template <typename T>
+bool non_negative(const std::vector<FlatNode<T>>& nodes, uint32_t index, int depth = 3){
+    const FlatNode<T>& node = nodes[index];
+    switch (node.kind){
+        case NodeKind::Number: return !(node.value < T(0)) && !std::signbit(node.value);
+        case NodeKind::Exp:    return true;
+        case NodeKind::Mult:
+            if (node.left == node.right){ return true; }
+            [[fallthrough]];
+        case NodeKind::Plus:
+        case NodeKind::Div:
+            return depth > 0 && non_negative(nodes, node.left, depth - 1) && non_negative(nodes, node.right, depth - 1);
+        default:
+            return false;
+    }
+}
+
+template <typename T>
+bool non_negative(const std::vector<FlatNode<std::complex<T>>>&, uint32_t, int = 3){ return false; }
+
+// sin and cos of the same argument, in -O2 builds such as bench.exe and exprcalc.exe the compiler
+// merges the two calls into a single sincos call; the default CXXFLAGS make two calls
+template <typename T>
+void sin_cos(T x, T& s, T& c){
+    s = std::sin(x);
+    c = std::cos(x);
+}
+
+} // namespace
+
+
+/*CONSTRUCTION*/
+
+template <typename T>
+FlatExpression<T>::FlatExpression() : nodes_(), variables_(), root_(0), sincos_() {}
+
+// keeps only the nodes and variables reachable from root, preserving their order
+template <typename T>
+FlatExpression<T> FlatExpression<T>::reachable(const std::vector<FlatNode<T>>& nodes,
+                                               const std::vector<std::string>& variables,
+                                               uint32_t root){
+    std::vector<bool> used(nodes.size(), false);
+    used[root] = true;
+    for (size_t i = nodes.size(); i-- > 0;){
+        if (!used[i] || nodes[i].kind == NodeKind::Number || nodes[i].kind == NodeKind::Variable){ continue; }
+        used[nodes[i].left] = true;
+        if (!is_unary(nodes[i].kind)){ used[nodes[i].right] = true; }
+    }
+
+    FlatExpression<T> result;
+    std::vector<uint32_t> mapped(nodes.size());
+    std::vector<uint32_t> slots(variables.size(), UINT32_MAX);
+    for (size_t i = 0; i < nodes.size(); i++){
+        if (!used[i]){ continue; }
+        FlatNode<T> node = nodes[i];
+        if (node.kind == NodeKind::Variable){
+            if (slots[node.left] == UINT32_MAX){
+                slots[node.left] = static_cast<uint32_t>(result.variables_.size());
+                result.variables_.push_back(variables[node.left]);
+            }
+            node.left = slots[node.left];
+        } else if (node.kind != NodeKind::Number){
+            node.left = mapped[node.left];
+            node.right = is_unary(node.kind) ? 0 : mapped[node.right];
+        }
+        mapped[i] = static_cast<uint32_t>(result.nodes_.size());
+        result.nodes_.push_back(node);
+    }
+    result.root_ = mapped[root];
+    return result;
+}
+
+// flattens a node tree
+template <typename T>
+FlatExpression<T>::FlatExpression(const Expression<T>& expression) : nodes_(), variables_(), root_(0), sincos_() {
+    FlatBuilder<T> builder;
+    root_ = add_nodes(builder, expression);
+    nodes_ = std::move(builder.nodes);
+    variables_ = std::move(builder.variables);
+}
+
+// converts back to a node tree
+template <typename T>
+Expression<T> FlatExpression<T>::to_expression() const {
+    std::vector<std::shared_ptr<ExpressionNode<T>>> built(nodes_.size());
+
+    for (size_t i = 0; i < nodes_.size(); i++){
+        const FlatNode<T>& node = nodes_[i];
+        switch (node.kind){
+            case NodeKind::Number:
+                built[i] = std::make_shared<NumberNode<T>>(node.value);
+                break;
+            case NodeKind::Variable:
+                built[i] = std::make_shared<VariableNode<T>>(variables_[node.left]);
+                break;
+            case NodeKind::Sqrt:
+                built[i] = std::make_shared<PowNode<T>>(built[node.left], std::make_shared<NumberNode<T>>(T(0.5)));
+                break;
+            default:
+                built[i] = make_node<T>(node.kind, built[node.left], is_unary(node.kind) ? nullptr : built[node.right]);
+        }
+    }
+
+    return Expression<T>(built[root_]);
+}
+
+
+/*OPERATIONS*/
+
+// rewrites the expression into cheaper operations, see flat.hpp
+template <typename T>
+FlatExpression<T> FlatExpression<T>::optimize() const {
+    FlatBuilder<T> b;
+    std::vector<uint32_t> mapped(nodes_.size());
+
+    // x^n for n >= 1 by repeated squaring, squares are shared through the builder
+    auto chain = [&](uint32_t x, int n){
+        uint32_t result = UINT32_MAX;
+        for (uint32_t base = x;;){
+            if (n & 1){ result = result == UINT32_MAX ? base : b.op(NodeKind::Mult, result, base); }
+            n >>= 1;
+            if (n == 0){ return result; }
+            base = b.op(NodeKind::Mult, base, base);
+        }
+    };
+
+    for (size_t i = 0; i < nodes_.size(); i++){
+        const FlatNode<T>& node = nodes_[i];
+        // operand of the rewritten node, its kind tells the rewrites of the operand itself
+        const FlatNode<T>* arg = node.kind == NodeKind::Number || node.kind == NodeKind::Variable ? nullptr : &b.nodes[mapped[node.left]];
+        int n = 0;
+
+        if (node.kind == NodeKind::Pow && nodes_[node.right].kind == NodeKind::Number){
+            T exponent = nodes_[node.right].value;
+            uint32_t base = mapped[node.left];
+            if (small_integer(exponent, n)){
+                if (n == 0){
+                    mapped[i] = b.number(T(1));
+                } else {
+                    uint32_t power = chain(base, std::abs(n));
+                    mapped[i] = n > 0 ? power : b.op(NodeKind::Div, b.number(T(1)), power);
+                }
+                continue;
+            }
+            if (exponent == T(0.5) || exponent == T(-0.5)){
+                uint32_t root = b.op(NodeKind::Sqrt, base);
+                mapped[i] = exponent == T(0.5) ? root : b.op(NodeKind::Div, b.number(T(1)), root);
+                continue;
+            }
+        }
+        // exp(ln(x)) = x only where x is known not to be negative, ln(exp(x)) = x for real x only
+        if (node.kind == NodeKind::Exp && arg->kind == NodeKind::Ln && non_negative(b.nodes, arg->left)){
+            mapped[i] = arg->left;
+            continue;
+        }
+        if (node.kind == NodeKind::Ln && arg->kind == NodeKind::Exp && !is_complex<T>::value){
+            mapped[i] = arg->left;
+            continue;
+        }
+        mapped[i] = b.copy(node, variables_, mapped);
+    }
+
+    FlatExpression<T> result = reachable(b.nodes, b.variables, mapped[root_]);
+    result.pair_sincos();
+    return result;
+}
+
+// pairs sin and cos nodes of the same argument
+template <typename T>
+void FlatExpression<T>::pair_sincos(){
+    std::unordered_map<uint32_t, uint32_t> sines;
+    std::unordered_map<uint32_t, uint32_t> cosines;
+    for (uint32_t i = 0; i < nodes_.size(); i++){
+        const FlatNode<T>& node = nodes_[i];
+        if (node.kind == NodeKind::Sin){ sines.emplace(node.left, i); }
+        if (node.kind == NodeKind::Cos){ cosines.emplace(node.left, i); }
+    }
+    sincos_.assign(nodes_.size(), UINT32_MAX);
+    for (const auto& [argument, sine] : sines){
+        auto cosine = cosines.find(argument);
+        if (cosine == cosines.end()){ continue; }
+        sincos_[sine] = cosine->second;
+        sincos_[cosine->second] = sine;
+    }
+}
+
+template <typename T>
+FlatExpression<T> FlatExpression<T>::prepared(bool allow_rewrites) const {
+    if (allow_rewrites){ return optimize(); }
+    FlatExpression<T> result(*this);
+    result.pair_sincos();
+    return result;
+}
+
+// merges flat expressions into one, nodes identical across them are stored once
+// roots receives the node of every merged expression, the result's own root is the last one
+template <typename T>
+FlatExpression<T> FlatExpression<T>::merge(const std::vector<FlatExpression<T>>& parts, std::vector<uint32_t>& roots){
+    FlatBuilder<T> b;
+    roots.clear();
+    for (const FlatExpression<T>& part : parts){
+        std::vector<uint32_t> mapped(part.nodes_.size());
+        for (size_t i = 0; i < part.nodes_.size(); i++){
+            mapped[i] = b.copy(part.nodes_[i], part.variables_, mapped);
+        }
+        roots.push_back(mapped[part.root_]);
+    }
+
+    FlatExpression<T> result;
+    result.nodes_ = std::move(b.nodes);
+    result.variables_ = std::move(b.variables);
+    result.root_ = roots.empty() ? 0 : roots.back();
+    result.pair_sincos();
+    return result;
+}
+
+// differentiates expression by given variable
+// derivative nodes are appended after the nodes of the expression, so primal subtrees are shared
+template <typename T>
+FlatExpression<T> FlatExpression<T>::diff(const std::string& var) const {
+    FlatBuilder<T> b;
+    std::vector<uint32_t> primal(nodes_.size());
+    for (size_t i = 0; i < nodes_.size(); i++){
+        primal[i] = b.copy(nodes_[i], variables_, primal);
+    }
+
+    // subtrees independent of var have a zero derivative, like in the node tree
+    auto slot = std::find(variables_.begin(), variables_.end(), var);
+    std::vector<bool> dependent = slot == variables_.end() ? std::vector<bool>(nodes_.size(), false)
+                                                           : depends_on(static_cast<uint32_t>(slot - variables_.begin()));
+
+    std::vector<uint32_t> d(nodes_.size());
+    for (size_t i = 0; i < nodes_.size(); i++){
+        const FlatNode<T>& node = nodes_[i];
+        uint32_t self = primal[i];
+        uint32_t l = primal[node.left];
+        uint32_t r = primal[node.right];
+        if (!dependent[i]){
+            d[i] = b.number(0);
+            continue;
+        }
+
+        switch (node.kind){
+            case NodeKind::Number:
+                d[i] = b.number(0);
+                break;
+            case NodeKind::Variable:
+                d[i] = b.number(variables_[node.left] == var ? 1 : 0);
+                break;
+            case NodeKind::Plus:
+            case NodeKind::Minus:
+                d[i] = b.op(node.kind, d[node.left], d[node.right]);
+                break;
+            case NodeKind::Mult:
+                // (fg)' = f'g + fg'
+                d[i] = b.op(NodeKind::Plus,
+                            b.op(NodeKind::Mult, d[node.left], r),
+                            b.op(NodeKind::Mult, l, d[node.right]));
+                break;
+            case NodeKind::Div:
+                // (f/g)' = (f'g - fg') / g^2
+                d[i] = b.op(NodeKind::Div,
+                            b.op(NodeKind::Minus,
+                                 b.op(NodeKind::Mult, d[node.left], r),
+                                 b.op(NodeKind::Mult, l, d[node.right])),
+                            b.op(NodeKind::Pow, r, b.number(2)));
+                break;
+            case NodeKind::Pow:
+                // (f^g)' = (g * f' * f^(g - 1)) + (f^g * g' * ln(f))
+                d[i] = b.op(NodeKind::Plus,
+                            b.op(NodeKind::Mult,
+                                 b.op(NodeKind::Mult, r, d[node.left]),
+                                 b.op(NodeKind::Pow, l, b.op(NodeKind::Minus, r, b.number(1)))),
+                            b.op(NodeKind::Mult,
+                                 b.op(NodeKind::Mult, self, d[node.right]),
+                                 b.op(NodeKind::Ln, l)));
+                break;
+            case NodeKind::Sin:
+                // (sin f)' = cos f * f'
+                d[i] = b.op(NodeKind::Mult, b.op(NodeKind::Cos, l), d[node.left]);
+                break;
+            case NodeKind::Cos:
+                // (cos f)' = sin f * (-1 * f')
+                d[i] = b.op(NodeKind::Mult,
+                            b.op(NodeKind::Sin, l),
+                            b.op(NodeKind::Mult, b.number(-1), d[node.left]));
+                break;
+            case NodeKind::Ln:
+                // (ln f)' = f' / f
+                d[i] = b.op(NodeKind::Div, d[node.left], l);
+                break;
+            case NodeKind::Exp:
+                // (exp f)' = exp f * f'
+                d[i] = b.op(NodeKind::Mult, self, d[node.left]);
+                break;
+            case NodeKind::Sqrt:
+                // (sqrt f)' = f' / (2 * sqrt f)
+                d[i] = b.op(NodeKind::Div, d[node.left], b.op(NodeKind::Mult, b.number(2), self));
+                break;
+            case NodeKind::Polynomial:
+                // lowered to Horner form when flattening
+                break;
+        }
+    }
+
+    return reachable(b.nodes, b.variables, d[root_]);
+}
+
+// substitutes given variable values, other variables stay
+template <typename T>
+FlatExpression<T> FlatExpression<T>::evaluate(const std::vector<std::string>& variables, const std::vector<T>& values) const {
+    FlatBuilder<T> b;
+    std::vector<uint32_t> mapped(nodes_.size());
+
+    for (size_t i = 0; i < nodes_.size(); i++){
+        const FlatNode<T>& node = nodes_[i];
+        if (node.kind == NodeKind::Variable){
+            const std::string& name = variables_[node.left];
+            mapped[i] = b.variable(name);
+            for (size_t j = 0; j < variables.size() && j < values.size(); j++){
+                if (variables[j] == name){
+                    mapped[i] = b.number(values[j]);
+                    break;
+                }
+            }
+        } else {
+            mapped[i] = b.copy(node, variables_, mapped);
+        }
+    }
+
+    return reachable(b.nodes, b.variables, mapped[root_]);
+}
+
+// resolves expression, values are given in the order of variables()
+// missing values are taken as 0, like unevaluated variables of a node tree
+template <typename T>
+T FlatExpression<T>::resolve(const std::vector<T>& values) const {
+    return resolve_nodes(values.data(), values.size())[root_];
+}
+
+// values of all nodes, in a thread local buffer valid until the next call on this thread
+template <typename T>
+const T* FlatExpression<T>::resolve_nodes(const T* values, size_t count) const {
+    static thread_local std::vector<T> scratch;
+    scratch.resize(nodes_.size());
+    T* r = scratch.data();
+    bool fused = !sincos_.empty();
+
+    for (size_t i = 0; i < nodes_.size(); i++){
+        const FlatNode<T>& node = nodes_[i];
+        switch (node.kind){
+            case NodeKind::Number:   r[i] = node.value; break;
+            case NodeKind::Variable: r[i] = node.left < count ? values[node.left] : T(0); break;
+            case NodeKind::Plus:     r[i] = r[node.left] + r[node.right]; break;
+            case NodeKind::Minus:    r[i] = r[node.left] - r[node.right]; break;
+            case NodeKind::Mult:     r[i] = r[node.left] * r[node.right]; break;
+            case NodeKind::Div:      r[i] = r[node.left] / r[node.right]; break;
+            case NodeKind::Pow:      r[i] = std::pow(r[node.left], r[node.right]); break;
+            case NodeKind::Sin:
+            case NodeKind::Cos:
+                if (fused && sincos_[i] != UINT32_MAX){
+                    // the first of the pair computes both
+                    if (i < sincos_[i]){
+                        T& s = node.kind == NodeKind::Sin ? r[i] : r[sincos_[i]];
+                        T& c = node.kind == NodeKind::Sin ? r[sincos_[i]] : r[i];
+                        sin_cos(r[node.left], s, c);
+                    }
+                } else {
+                    r[i] = node.kind == NodeKind::Sin ? std::sin(r[node.left]) : std::cos(r[node.left]);
+                }
+                break;
+            case NodeKind::Ln:       r[i] = std::log(r[node.left]); break;
+            case NodeKind::Exp:      r[i] = std::exp(r[node.left]); break;
+            case NodeKind::Sqrt:     r[i] = std::sqrt(r[node.left]); break;
+            case NodeKind::Polynomial:
+                // lowered to Horner form when flattening
+                break;
+        }
+    }
+
+    return r;
+}
+
+// calculates expression with given variable values
+template <typename T>
+T FlatExpression<T>::eval_and_resolve(const std::vector<std::string>& variables, const std::vector<T>& values) const {
+    return resolve(slot_values(variables, values));
+}
+
+// orders given variable values by variable slots, missing values are 0
+template <typename T>
+std::vector<T> FlatExpression<T>::slot_values(const std::vector<std::string>& variables, const std::vector<T>& values) const {
+    std::vector<T> slots(variables_.size(), T(0));
+    for (size_t i = 0; i < variables.size() && i < values.size(); i++){
+        for (size_t slot = 0; slot < variables_.size(); slot++){
+            if (variables_[slot] == variables[i]){ slots[slot] = values[i]; }
+        }
+    }
+    return slots;
+}
+
+
+/*SAMPLING*/
+
+namespace {
+
+// number of points evaluated together by sample
+constexpr size_t SAMPLE_BLOCK = 256;
+
+// out[k] = op(a[k * a_step], b[k * b_step]), a step of 0 broadcasts a constant operand
+template <typename T, typename Op>
+void apply_block(const T* a, size_t a_step, const T* b, size_t b_step, T* out, size_t len, Op op){
+    for (size_t k = 0; k < len; k++){
+        out[k] = op(a[k * a_step], b[k * b_step]);
+    }
+}
+
+} // namespace
+
+// marks nodes whose value depends on the variable in the given slot
+template <typename T>
+std::vector<bool> FlatExpression<T>::depends_on(uint32_t slot) const {
+    std::vector<bool> dependent(nodes_.size(), false);
+    for (size_t i = 0; i < nodes_.size(); i++){
+        const FlatNode<T>& node = nodes_[i];
+        switch (node.kind){
+            case NodeKind::Number:   break;
+            case NodeKind::Variable: dependent[i] = node.left == slot; break;
+            default:
+                dependent[i] = dependent[node.left] || (!is_unary(node.kind) && dependent[node.right]);
+        }
+    }
+    return dependent;
+}
+
+// evaluates one grid line: nodes independent of the swept variable are resolved once,
+// the rest is evaluated in blocks of SAMPLE_BLOCK points
+// dependent comes from depends_on() of the swept variable, its only dependent variable node
+template <typename T>
+void FlatExpression<T>::sweep(const std::vector<bool>& dependent, T start, T stop, size_t n,
+                              const std::vector<T>& values, T* out) const {
+    if (n == 0){ return; }
+    T step = n > 1 ? (stop - start) / T(n - 1) : T(0);
+
+    // constants of the line
+    std::vector<T> scalar(nodes_.size());
+    std::vector<uint32_t> row(nodes_.size(), 0);
+    uint32_t rows = 0;
+    for (size_t i = 0; i < nodes_.size(); i++){
+        const FlatNode<T>& node = nodes_[i];
+        if (dependent[i]){
+            row[i] = rows++;
+            continue;
+        }
+        T l = scalar[node.left];
+        T r = scalar[node.right];
+        switch (node.kind){
+            case NodeKind::Number:   scalar[i] = node.value; break;
+            case NodeKind::Variable: scalar[i] = node.left < values.size() ? values[node.left] : T(0); break;
+            case NodeKind::Plus:     scalar[i] = l + r; break;
+            case NodeKind::Minus:    scalar[i] = l - r; break;
+            case NodeKind::Mult:     scalar[i] = l * r; break;
+            case NodeKind::Div:      scalar[i] = l / r; break;
+            case NodeKind::Pow:      scalar[i] = std::pow(l, r); break;
+            case NodeKind::Sin:      scalar[i] = std::sin(l); break;
+            case NodeKind::Cos:      scalar[i] = std::cos(l); break;
+            case NodeKind::Ln:       scalar[i] = std::log(l); break;
+            case NodeKind::Exp:      scalar[i] = std::exp(l); break;
+            case NodeKind::Sqrt:     scalar[i] = std::sqrt(l); break;
+            case NodeKind::Polynomial:
+                // lowered to Horner form when flattening
+                break;
+        }
+    }
+
+    if (!dependent[root_]){
+        std::fill(out, out + n, scalar[root_]);
+        return;
+    }
+
+    std::vector<T> block(static_cast<size_t>(rows) * SAMPLE_BLOCK);
+    auto operand = [&](uint32_t index) -> const T* {
+        return dependent[index] ? &block[row[index] * SAMPLE_BLOCK] : &scalar[index];
+    };
+    auto step_of = [&](uint32_t index) -> size_t { return dependent[index] ? 1 : 0; };
+
+    for (size_t begin = 0; begin < n; begin += SAMPLE_BLOCK){
+        size_t len = std::min(SAMPLE_BLOCK, n - begin);
+
+        for (size_t i = 0; i < nodes_.size(); i++){
+            if (!dependent[i]){ continue; }
+            const FlatNode<T>& node = nodes_[i];
+            T* dst = &block[row[i] * SAMPLE_BLOCK];
+            const T* a = operand(node.left);
+            size_t sa = step_of(node.left);
+            const T* b = is_unary(node.kind) ? a : operand(node.right);
+            size_t sb = is_unary(node.kind) ? sa : step_of(node.right);
+
+            switch (node.kind){
+                case NodeKind::Number:
+                    break;
+                case NodeKind::Variable:
+                    for (size_t k = 0; k < len; k++){
+                        size_t point = begin + k;
+                        dst[k] = point + 1 == n && n > 1 ? stop : start + step * T(point);
+                    }
+                    break;
+                case NodeKind::Plus:  apply_block(a, sa, b, sb, dst, len, [](T x, T y){ return x + y; }); break;
+                case NodeKind::Minus: apply_block(a, sa, b, sb, dst, len, [](T x, T y){ return x - y; }); break;
+                case NodeKind::Mult:  apply_block(a, sa, b, sb, dst, len, [](T x, T y){ return x * y; }); break;
+                case NodeKind::Div:   apply_block(a, sa, b, sb, dst, len, [](T x, T y){ return x / y; }); break;
+                case NodeKind::Pow:   apply_block(a, sa, b, sb, dst, len, [](T x, T y){ return std::pow(x, y); }); break;
+                case NodeKind::Sin:   apply_block(a, sa, b, sb, dst, len, [](T x, T){ return std::sin(x); }); break;
+                case NodeKind::Cos:   apply_block(a, sa, b, sb, dst, len, [](T x, T){ return std::cos(x); }); break;
+                case NodeKind::Ln:    apply_block(a, sa, b, sb, dst, len, [](T x, T){ return std::log(x); }); break;
+                case NodeKind::Exp:   apply_block(a, sa, b, sb, dst, len, [](T x, T){ return std::exp(x); }); break;
+                case NodeKind::Sqrt:  apply_block(a, sa, b, sb, dst, len, [](T x, T){ return std::sqrt(x); }); break;
+                case NodeKind::Polynomial:
+                    // lowered to Horner form when flattening
+                    break;
+            }
+        }
+
+        const T* res = &block[row[root_] * SAMPLE_BLOCK];
+        std::copy(res, res + len, out + begin);
+    }
+}
+
+// tabulates the expression at n evenly spaced values of var from start to stop (both included)
+// values of the other variables are given in the order of variables()
+template <typename T>
+void FlatExpression<T>::sample(const std::string& var, T start, T stop, size_t n, T* out, const std::vector<T>& values) const {
+    auto found = std::find(variables_.begin(), variables_.end(), var);
+    uint32_t slot = static_cast<uint32_t>(found - variables_.begin());
+    sweep(depends_on(slot), start, stop, n, values, out);
+}
+
+// tabulates the expression over a grid in row-major order, the last variable changes fastest
+// the parts of the expression independent of the last variable are resolved once per grid line
+template <typename T>
+void FlatExpression<T>::sample_grid(const std::vector<std::string>& vars,
+                                    const std::vector<T>& starts,
+                                    const std::vector<T>& stops,
+                                    const std::vector<size_t>& counts,
+                                    T* out,
+                                    const std::vector<T>& values) const {
+    size_t dims = vars.size();
+    if (dims == 0 || starts.size() < dims || stops.size() < dims || counts.size() < dims){
+        throw std::invalid_argument("sample_grid needs a start, stop and count for every variable");
+    }
+    for (size_t count : counts){
+        if (count == 0){ return; }
+    }
+
+    std::vector<uint32_t> slots;
+    for (const std::string& var : vars){
+        slots.push_back(static_cast<uint32_t>(std::find(variables_.begin(), variables_.end(), var) - variables_.begin()));
+    }
+    std::vector<bool> dependent = depends_on(slots.back());
+
+    std::vector<T> line_values(values);
+    line_values.resize(variables_.size(), T(0));
+
+    // position on the outer dimensions
+    std::vector<size_t> index(dims - 1, 0);
+    size_t line = counts.back();
+    for (T* dst = out;; dst += line){
+        for (size_t d = 0; d + 1 < dims; d++){
+            if (slots[d] >= line_values.size()){ continue; }
+            T step = counts[d] > 1 ? (stops[d] - starts[d]) / T(counts[d] - 1) : T(0);
+            line_values[slots[d]] = index[d] + 1 == counts[d] && counts[d] > 1 ? stops[d] : starts[d] + step * T(index[d]);
+        }
+        sweep(dependent, starts.back(), stops.back(), line, line_values, dst);
+
+        // next grid line
+        size_t d = dims - 1;
+        while (d > 0 && ++index[d - 1] == counts[d - 1]){
+            index[d - 1] = 0;
+            d--;
+        }
+        if (d == 0){ return; }
+    }
+}
+
+template <typename T>
+std::string FlatExpression<T>::to_string(uint32_t index) const {
+    const FlatNode<T>& node = nodes_[index];
+    switch (node.kind){
+        case NodeKind::Number:   return number_to_string(node.value);
+        case NodeKind::Variable: return variables_[node.left];
+        case NodeKind::Plus:     return "(" + to_string(node.left) + " + " + to_string(node.right) + ")";
+        case NodeKind::Minus:    return "(" + to_string(node.left) + " - " + to_string(node.right) + ")";
+        case NodeKind::Mult:     return "(" + to_string(node.left) + " * " + to_string(node.right) + ")";
+        case NodeKind::Div:      return "(" + to_string(node.left) + " / " + to_string(node.right) + ")";
+        case NodeKind::Pow:      return "(" + to_string(node.left) + " ^ " + to_string(node.right) + ")";
+        case NodeKind::Sin:      return "sin(" + to_string(node.left) + ")";
+        case NodeKind::Cos:      return "cos(" + to_string(node.left) + ")";
+        case NodeKind::Ln:       return "ln(" + to_string(node.left) + ")";
+        case NodeKind::Exp:      return "exp(" + to_string(node.left) + ")";
+        case NodeKind::Sqrt:     return "(" + to_string(node.left) + " ^ " + number_to_string(T(0.5)) + ")";
+        case NodeKind::Polynomial:
+            // lowered to Horner form when flattening
+            break;
+    }
+    return "";
+}
+
+// same format as Expression<T>::to_string
+template <typename T>
+std::string FlatExpression<T>::to_string() const { return to_string(root_); }
+
+template <typename T>
+const std::vector<FlatNode<T>>& FlatExpression<T>::nodes() const { return nodes_; }
+
+template <typename T>
+const std::vector<std::string>& FlatExpression<T>::variables() const { return variables_; }
+
+template <typename T>
+uint32_t FlatExpression<T>::root() const { return root_; }
+
+template <typename T>
+size_t FlatExpression<T>::size() const { return nodes_.size(); }
+
+template class FlatExpression<float>;
+template class FlatExpression<double>;
+template class FlatExpression<long double>;
+template class FlatExpression<std::complex<long double>>;
+
+} // namespace Expressions
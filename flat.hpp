@@ -0,0 +1,151 @@
+#ifndef HEADER_GUARD_FLAT_HPP_INCLUDED
+#define HEADER_GUARD_FLAT_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <complex>
+#include <limits>
+#include <functional>
+#include <string_view>
+#include "expression.hpp"
+
+namespace Expressions {
+
+template <typename T> class ExpressionBuilder;
+template <typename T> class ExpressionGroup;
+template <typename T> class TieredEvaluator;
+
+// bytes holding the value of a number, x87 extended precision pads its 10 bytes to sizeof(long double)
+template <typename T>
+constexpr size_t value_bytes = std::numeric_limits<T>::digits == 64 ? 10 : sizeof(T);
+
+// identical subtrees are found by comparing number constants bit for bit, == would merge 0 and -0
+template <typename T>
+bool same_bits(const T& a, const T& b){ return std::memcmp(&a, &b, value_bytes<T>) == 0; }
+
+template <typename T>
+bool same_bits(const std::complex<T>& a, const std::complex<T>& b){
+    return same_bits(a.real(), b.real()) && same_bits(a.imag(), b.imag());
+}
+
+template <typename T>
+size_t hash_bits(const T& value){
+    return std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char*>(&value), value_bytes<T>));
+}
+
+template <typename T>
+size_t hash_bits(const std::complex<T>& value){ return hash_bits(value.real()) * 31 + hash_bits(value.imag()); }
+
+// adds the nodes of a tree to a builder of flat nodes, one with number(value), variable(name) and
+// op(kind, left, right) members returning node indices; returns the index of the root
+// polynomials are added in Horner form
+template <typename T, typename Builder>
+uint32_t add_nodes(Builder& builder, const Expression<T>& expression){
+    return post_order<uint32_t>(expression.root(), [&](const std::shared_ptr<ExpressionNode<T>>& node,
+                                                       NodeResults<T, uint32_t>& added){
+        switch (node->kind()){
+            case NodeKind::Number:   return builder.number(static_cast<const NumberNode<T>*>(node.get())->value());
+            case NodeKind::Variable: return builder.variable(static_cast<const VariableNode<T>*>(node.get())->get_name());
+            default:                 return builder.op(node->kind(),
+                                                       added[node->operand(0).get()],
+                                                       node->arity() > 1 ? added[node->operand(1).get()] : 0);
+        }
+    });
+}
+
+// node of a flat expression
+// operands are indices of nodes stored earlier in the same flat expression
+template <typename T>
+struct FlatNode
+{
+    NodeKind kind;
+    uint32_t left;      // left operand, function argument or variable slot
+    uint32_t right;     // right operand of binary operations
+    T value;            // value of number nodes
+};
+
+// compact expression representation:
+// nodes live in one contiguous vector in topological order (operands first),
+// every operation is dispatched with a switch on the node kind,
+// identical subtrees are stored once
+template <typename T>
+class FlatExpression
+{
+private:
+    std::vector<FlatNode<T>> nodes_;
+    // variable names, VariableNode slots index this vector
+    std::vector<std::string> variables_;
+    // index of the root node
+    uint32_t root_;
+    // for sin and cos nodes of the same argument, index of the other one (UINT32_MAX if there is none)
+    // both are computed by a single sincos call, set by optimize
+    std::vector<uint32_t> sincos_;
+
+    friend class ExpressionBuilder<T>;
+    friend class ExpressionGroup<T>;
+    friend class TieredEvaluator<T>;
+
+    FlatExpression();
+    static FlatExpression<T> reachable(const std::vector<FlatNode<T>>& nodes,
+                                       const std::vector<std::string>& variables,
+                                       uint32_t root);
+    static FlatExpression<T> merge(const std::vector<FlatExpression<T>>& parts, std::vector<uint32_t>& roots);
+
+    // sets sincos_, every pair is then computed by one sin_cos call (flat.cpp); that calls std::sin
+    // and std::cos, so the values are those of separate sin and cos nodes bit for bit
+    void pair_sincos();
+    const T* resolve_nodes(const T* values, size_t count) const;
+
+    std::string to_string(uint32_t node) const;
+    std::vector<bool> depends_on(uint32_t slot) const;
+    void sweep(const std::vector<bool>& dependent, T start, T stop, size_t n,
+               const std::vector<T>& values, T* out) const;
+public:
+    explicit FlatExpression(const Expression<T>& expression);
+    ~FlatExpression() = default;
+
+    // converts back to a node tree, shared subtrees stay shared
+    Expression<T> to_expression() const;
+
+    // strength reduction: constant integer powers become multiplication chains, x^0.5 becomes sqrt,
+    // x^-1 becomes a division, exp(ln(x)) becomes x where x can't be negative (exp, squares, positive
+    // constants and their sums, products and quotients), ln(exp(x)) becomes x for real x,
+    // and sin and cos of the same argument are computed together
+    // results may differ in the last bits, sqrt(-inf) is NaN where (-inf)^0.5 is inf,
+    // and ln(exp(x)) stays finite where exp(x) overflows
+    FlatExpression<T> optimize() const;
+    // form for repeated evaluation: optimize() with allow_rewrites, otherwise this expression with sin and
+    // cos of one argument computed together, which keeps the values of Expression<T>::eval_and_resolve
+    FlatExpression<T> prepared(bool allow_rewrites = false) const;
+
+    FlatExpression<T> diff(const std::string& var) const;
+    FlatExpression<T> evaluate(const std::vector<std::string>& variables, const std::vector<T>& values) const;
+    // values are given in the order of variables()
+    T resolve(const std::vector<T>& values) const;
+    T eval_and_resolve(const std::vector<std::string>& variables, const std::vector<T>& values) const;
+    // orders given variable values by variable slots
+    std::vector<T> slot_values(const std::vector<std::string>& variables, const std::vector<T>& values) const;
+
+    // tabulation into caller-provided buffers, see Expression<T>::sample
+    // values of the other variables are given in the order of variables()
+    void sample(const std::string& var, T start, T stop, size_t n, T* out,
+                const std::vector<T>& values = {}) const;
+    void sample_grid(const std::vector<std::string>& vars,
+                     const std::vector<T>& starts,
+                     const std::vector<T>& stops,
+                     const std::vector<size_t>& counts,
+                     T* out,
+                     const std::vector<T>& values = {}) const;
+
+    std::string to_string() const;
+
+    const std::vector<FlatNode<T>>& nodes() const;
+    const std::vector<std::string>& variables() const;
+    uint32_t root() const;
+    size_t size() const;
+};
+} // namespace Expressions
+
+#endif // HEADER_GUARD_FLAT_HPP_INCLUDED
@@ -0,0 +1,73 @@
+#include <string>
+#include <vector>
+#include <complex>
+#include "group.hpp"
+#include "parallel.hpp"
+
+namespace Expressions {
+
+namespace {
+
+template <typename T>
+std::vector<FlatExpression<T>> flattened(const std::vector<Expression<T>>& expressions, bool allow_rewrites){
+    std::vector<FlatExpression<T>> parts;
+    parts.reserve(expressions.size());
+    for (const Expression<T>& expression : expressions){
+        FlatExpression<T> flat(expression);
+        parts.push_back(allow_rewrites ? flat.optimize() : std::move(flat));
+    }
+    return parts;
+}
+
+} // namespace
+
+// merge pairs sin and cos of the same argument
+template <typename T>
+ExpressionGroup<T>::ExpressionGroup(const std::vector<Expression<T>>& expressions, bool allow_rewrites)
+    : graph_(FlatExpression<T>::merge(flattened(expressions, allow_rewrites), outputs_)) {}
+
+template <typename T>
+size_t ExpressionGroup<T>::size() const { return outputs_.size(); }
+
+template <typename T>
+size_t ExpressionGroup<T>::nodes() const { return graph_.size(); }
+
+template <typename T>
+const std::vector<std::string>& ExpressionGroup<T>::variables() const { return graph_.variables(); }
+
+template <typename T>
+std::vector<T> ExpressionGroup<T>::slot_values(const std::vector<std::string>& variables, const std::vector<T>& values) const {
+    return graph_.slot_values(variables, values);
+}
+
+template <typename T>
+void ExpressionGroup<T>::resolve(const std::vector<T>& values, T* out) const {
+    const T* r = graph_.resolve_nodes(values.data(), values.size());
+    for (size_t i = 0; i < outputs_.size(); i++){ out[i] = r[outputs_[i]]; }
+}
+
+template <typename T>
+std::vector<T> ExpressionGroup<T>::resolve(const std::vector<T>& values) const {
+    std::vector<T> out(outputs_.size());
+    resolve(values, out.data());
+    return out;
+}
+
+template <typename T>
+void ExpressionGroup<T>::resolve_rows(const T* values, size_t rows, T* out, size_t threads) const {
+    size_t width = graph_.variables().size();
+    parallel_for(rows, [&](size_t begin, size_t end){
+        for (size_t row = begin; row < end; row++){
+            const T* r = graph_.resolve_nodes(values + row * width, width);
+            T* o = out + row * outputs_.size();
+            for (size_t i = 0; i < outputs_.size(); i++){ o[i] = r[outputs_[i]]; }
+        }
+    }, threads);
+}
+
+template class ExpressionGroup<float>;
+template class ExpressionGroup<double>;
+template class ExpressionGroup<long double>;
+template class ExpressionGroup<std::complex<long double>>;
+
+} // namespace Expressions
@@ -0,0 +1,47 @@
+#ifndef HEADER_GUARD_GROUP_HPP_INCLUDED
+#define HEADER_GUARD_GROUP_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "expression.hpp"
+#include "flat.hpp"
+
+namespace Expressions {
+
+// several expressions evaluated together for the same variable values,
+// e.g. a function, its partial derivatives and quantities derived from them:
+// all outputs are merged into one flat graph, so a subtree common to several outputs
+// is computed once per row instead of once per output, and sin and cos of one argument
+// are computed together; the outputs are those of Expression<T>::eval_and_resolve bit for bit
+// unless allow_rewrites also strength reduces them, see FlatExpression<T>::optimize()
+template <typename T>
+class ExpressionGroup
+{
+private:
+    // node of every output in graph_, filled while graph_ is constructed
+    std::vector<uint32_t> outputs_;
+    FlatExpression<T> graph_;
+public:
+    explicit ExpressionGroup(const std::vector<Expression<T>>& expressions, bool allow_rewrites = false);
+    ~ExpressionGroup() = default;
+
+    // number of outputs
+    size_t size() const;
+    // number of nodes of the shared graph
+    size_t nodes() const;
+    // variables of all outputs, values are given in this order
+    const std::vector<std::string>& variables() const;
+    // orders given variable values by variables(), missing values are 0
+    std::vector<T> slot_values(const std::vector<std::string>& variables, const std::vector<T>& values) const;
+
+    // writes the size() outputs for the given values to out
+    void resolve(const std::vector<T>& values, T* out) const;
+    std::vector<T> resolve(const std::vector<T>& values) const;
+    // rows of variables().size() values each, row-major; writes rows * size() outputs, row-major
+    // rows are split over threads worker threads (0 = all cores)
+    void resolve_rows(const T* values, size_t rows, T* out, size_t threads = 1) const;
+};
+} // namespace Expressions
+
+#endif // HEADER_GUARD_GROUP_HPP_INCLUDED
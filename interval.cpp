@@ -0,0 +1,328 @@
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <algorithm>
+#include "interval.hpp"
+
+namespace Expressions {
+
+/*INTERVAL*/
+
+template <typename T>
+Interval<T>::Interval() : lower(0), upper(0) {}
+
+template <typename T>
+Interval<T>::Interval(T point) : lower(point), upper(point) {}
+
+template <typename T>
+Interval<T>::Interval(T lower, T upper) : lower(lower), upper(upper) {}
+
+template <typename T>
+bool Interval<T>::empty() const { return std::isnan(lower) || std::isnan(upper); }
+
+template <typename T>
+bool Interval<T>::contains(T value) const { return lower <= value && value <= upper; }
+
+template <typename T>
+T Interval<T>::width() const { return upper - lower; }
+
+template <typename T>
+T Interval<T>::mid() const { return lower + (upper - lower) / 2; }
+
+
+namespace {
+
+template <typename T>
+Interval<T> empty_interval(){
+    return Interval<T>(std::numeric_limits<T>::quiet_NaN(), std::numeric_limits<T>::quiet_NaN());
+}
+
+template <typename T>
+Interval<T> entire(){
+    return Interval<T>(-std::numeric_limits<T>::infinity(), std::numeric_limits<T>::infinity());
+}
+
+// moves bounds outwards by the given number of ulps to cover rounding errors
+// arithmetic is correctly rounded (1 ulp is enough), library functions get 2 ulps
+template <typename T>
+Interval<T> outward(T lower, T upper, int ulps){
+    for (int i = 0; i < ulps; i++){
+        lower = std::nextafter(lower, -std::numeric_limits<T>::infinity());
+        upper = std::nextafter(upper, std::numeric_limits<T>::infinity());
+    }
+    return Interval<T>(lower, upper);
+}
+
+// product where 0 * inf is 0, as the infinite bound is never reached
+template <typename T>
+T mul_bound(T a, T b){
+    if (a == 0 || b == 0){ return 0; }
+    return a * b;
+}
+
+// true if [lower, upper] may contain a point p + 2k * pi
+// near misses count as hits, so the enclosure stays guaranteed
+template <typename T>
+bool hits_period_point(T lower, T upper, T p){
+    const T two_pi = 2 * std::numbers::pi_v<T>;
+    T slack = (std::abs(lower) + std::abs(upper) + 1) * 16 * std::numeric_limits<T>::epsilon();
+    T k = std::floor((upper + slack - p) / two_pi);
+    return p + k * two_pi >= lower - slack;
+}
+
+// encloses sin or cos over a, max_at / min_at are the extremum points in [-pi, pi)
+template <typename T>
+Interval<T> periodic(const Interval<T>& a, T (*f)(T), T max_at, T min_at){
+    if (a.empty()){ return empty_interval<T>(); }
+    if (!std::isfinite(a.lower) || !std::isfinite(a.upper) || a.width() >= 2 * std::numbers::pi_v<T>){
+        return Interval<T>(-1, 1);
+    }
+
+    T fl = f(a.lower);
+    T fu = f(a.upper);
+    Interval<T> res = outward(std::min(fl, fu), std::max(fl, fu), 2);
+    if (hits_period_point(a.lower, a.upper, max_at)){ res.upper = 1; }
+    if (hits_period_point(a.lower, a.upper, min_at)){ res.lower = -1; }
+
+    return Interval<T>(std::max(res.lower, T(-1)), std::min(res.upper, T(1)));
+}
+
+template <typename T> T sin_of(T x){ return std::sin(x); }
+template <typename T> T cos_of(T x){ return std::cos(x); }
+
+} // namespace
+
+
+/*OPERATIONS*/
+
+template <typename T>
+Interval<T> operator + (const Interval<T>& a, const Interval<T>& b){
+    if (a.empty() || b.empty()){ return empty_interval<T>(); }
+    return outward(a.lower + b.lower, a.upper + b.upper, 1);
+}
+
+template <typename T>
+Interval<T> operator - (const Interval<T>& a, const Interval<T>& b){
+    if (a.empty() || b.empty()){ return empty_interval<T>(); }
+    return outward(a.lower - b.upper, a.upper - b.lower, 1);
+}
+
+template <typename T>
+Interval<T> operator * (const Interval<T>& a, const Interval<T>& b){
+    if (a.empty() || b.empty()){ return empty_interval<T>(); }
+    T p[4] = {mul_bound(a.lower, b.lower), mul_bound(a.lower, b.upper),
+              mul_bound(a.upper, b.lower), mul_bound(a.upper, b.upper)};
+    return outward(*std::min_element(p, p + 4), *std::max_element(p, p + 4), 1);
+}
+
+template <typename T>
+Interval<T> operator / (const Interval<T>& a, const Interval<T>& b){
+    if (a.empty() || b.empty()){ return empty_interval<T>(); }
+    // division by an interval containing zero is unbounded
+    if (b.contains(0)){ return entire<T>(); }
+
+    T q[4] = {a.lower / b.lower, a.lower / b.upper, a.upper / b.lower, a.upper / b.upper};
+    for (T& v : q){
+        // inf / inf happens only for unbounded a, the quotient is unbounded as well
+        if (std::isnan(v)){ return entire<T>(); }
+    }
+    return outward(*std::min_element(q, q + 4), *std::max_element(q, q + 4), 1);
+}
+
+template <typename T>
+Interval<T> pow(const Interval<T>& base, const Interval<T>& exponent){
+    if (base.empty() || exponent.empty()){ return empty_interval<T>(); }
+
+    // constant integer exponent: exact monotonicity rules
+    T n = exponent.lower;
+    if (exponent.lower == exponent.upper && std::isfinite(n) && std::floor(n) == n){
+        if (n == 0){ return Interval<T>(1); }
+        if (n < 0){ return Interval<T>(1) / pow(base, Interval<T>(-n)); }
+
+        T pl = std::pow(base.lower, n);
+        T pu = std::pow(base.upper, n);
+        if (std::fmod(n, T(2)) != 0){ return outward(pl, pu, 2); }
+        if (base.lower >= 0){ return outward(pl, pu, 2); }
+        if (base.upper <= 0){ return outward(pu, pl, 2); }
+        Interval<T> res = outward(T(0), std::max(pl, pu), 2);
+        res.lower = 0;
+        return res;
+    }
+
+    // f^g = exp(g * ln(f)) for positive bases
+    if (base.lower > 0){ return exp(exponent * ln(base)); }
+
+    // negative bases with real exponents are not bounded here
+    return entire<T>();
+}
+
+template <typename T>
+Interval<T> sin(const Interval<T>& a){
+    const T half_pi = std::numbers::pi_v<T> / 2;
+    return periodic(a, &sin_of<T>, half_pi, -half_pi);
+}
+
+template <typename T>
+Interval<T> cos(const Interval<T>& a){
+    return periodic(a, &cos_of<T>, T(0), -std::numbers::pi_v<T>);
+}
+
+template <typename T>
+Interval<T> ln(const Interval<T>& a){
+    if (a.empty() || a.upper < 0){ return empty_interval<T>(); }
+    T lower = a.lower > 0 ? std::log(a.lower) : -std::numeric_limits<T>::infinity();
+    return outward(lower, std::log(a.upper), 2);
+}
+
+template <typename T>
+Interval<T> exp(const Interval<T>& a){
+    if (a.empty()){ return empty_interval<T>(); }
+    Interval<T> res = outward(std::exp(a.lower), std::exp(a.upper), 2);
+    res.lower = std::max(res.lower, T(0));
+    return res;
+}
+
+template <typename T>
+Interval<T> sqrt(const Interval<T>& a){
+    if (a.empty() || a.upper < 0){ return empty_interval<T>(); }
+    // sqrt is correctly rounded
+    Interval<T> res = outward(std::sqrt(std::max(a.lower, T(0))), std::sqrt(a.upper), 1);
+    res.lower = std::max(res.lower, T(0));
+    return res;
+}
+
+template <typename T>
+Interval<T> intersect(const Interval<T>& a, const Interval<T>& b){
+    if (a.empty() || b.empty()){ return empty_interval<T>(); }
+    T lower = std::max(a.lower, b.lower);
+    T upper = std::min(a.upper, b.upper);
+    if (lower > upper){ return empty_interval<T>(); }
+    return Interval<T>(lower, upper);
+}
+
+
+/*EVALUATOR*/
+
+template <typename T>
+IntervalEvaluator<T>::IntervalEvaluator(const Expression<T>& expression, bool mean_value) :
+expr_(expression), partials_(), partial_slots_() {
+    if (!mean_value){ return; }
+
+    for (const std::string& var : expr_.variables()){
+        partials_.push_back(expr_.diff(var));
+
+        // variables of a derivative are a subset of the variables of the expression
+        std::vector<size_t> slots;
+        for (const std::string& name : partials_.back().variables()){
+            slots.push_back(std::find(expr_.variables().begin(), expr_.variables().end(), name) - expr_.variables().begin());
+        }
+        partial_slots_.push_back(std::move(slots));
+    }
+}
+
+// natural interval extension: every node is replaced by its interval operation
+template <typename T>
+Interval<T> IntervalEvaluator<T>::bounds(const FlatExpression<T>& expr, const std::vector<Interval<T>>& ranges){
+    static thread_local std::vector<Interval<T>> scratch;
+    const std::vector<FlatNode<T>>& nodes = expr.nodes();
+    scratch.resize(nodes.size());
+    Interval<T>* r = scratch.data();
+
+    for (size_t i = 0; i < nodes.size(); i++){
+        const FlatNode<T>& node = nodes[i];
+        switch (node.kind){
+            case NodeKind::Number:   r[i] = Interval<T>(node.value); break;
+            case NodeKind::Variable: r[i] = node.left < ranges.size() ? ranges[node.left] : Interval<T>(0); break;
+            case NodeKind::Plus:     r[i] = r[node.left] + r[node.right]; break;
+            case NodeKind::Minus:    r[i] = r[node.left] - r[node.right]; break;
+            case NodeKind::Mult:     r[i] = r[node.left] * r[node.right]; break;
+            case NodeKind::Div:      r[i] = r[node.left] / r[node.right]; break;
+            case NodeKind::Pow:      r[i] = pow(r[node.left], r[node.right]); break;
+            case NodeKind::Sin:      r[i] = sin(r[node.left]); break;
+            case NodeKind::Cos:      r[i] = cos(r[node.left]); break;
+            case NodeKind::Ln:       r[i] = ln(r[node.left]); break;
+            case NodeKind::Exp:      r[i] = exp(r[node.left]); break;
+            case NodeKind::Sqrt:     r[i] = sqrt(r[node.left]); break;
+            case NodeKind::Polynomial:
+                // lowered to Horner form by FlatExpression
+                break;
+        }
+    }
+
+    return r[expr.root()];
+}
+
+template <typename T>
+Interval<T> IntervalEvaluator<T>::bounds(const std::vector<Interval<T>>& ranges) const {
+    std::vector<Interval<T>> box(ranges);
+    box.resize(expr_.variables().size(), Interval<T>(0));
+
+    Interval<T> natural = bounds(expr_, box);
+    if (partials_.empty() || natural.empty()){ return natural; }
+
+    // mean-value form needs a bounded box
+    std::vector<Interval<T>> center;
+    for (const Interval<T>& range : box){
+        if (!std::isfinite(range.width())){ return natural; }
+        center.push_back(Interval<T>(range.mid()));
+    }
+
+    Interval<T> mean_value = bounds(expr_, center);
+    for (size_t i = 0; i < partials_.size(); i++){
+        std::vector<Interval<T>> partial_box;
+        for (size_t slot : partial_slots_[i]){ partial_box.push_back(box[slot]); }
+        mean_value = mean_value + bounds(partials_[i], partial_box) * (box[i] - center[i]);
+    }
+
+    Interval<T> res = intersect(natural, mean_value);
+    // an empty intersection can only come from an unbounded derivative, fall back to the natural bounds
+    return res.empty() ? natural : res;
+}
+
+template <typename T>
+Interval<T> IntervalEvaluator<T>::bounds(const std::vector<std::string>& variables, const std::vector<Interval<T>>& ranges) const {
+    std::vector<Interval<T>> box(expr_.variables().size(), Interval<T>(0));
+    for (size_t i = 0; i < variables.size() && i < ranges.size(); i++){
+        for (size_t slot = 0; slot < box.size(); slot++){
+            if (expr_.variables()[slot] == variables[i]){ box[slot] = ranges[i]; }
+        }
+    }
+    return bounds(box);
+}
+
+template <typename T>
+const std::vector<std::string>& IntervalEvaluator<T>::variables() const { return expr_.variables(); }
+
+template <typename T>
+Interval<T> eval_interval(const Expression<T>& expression,
+                          const std::vector<std::string>& variables,
+                          const std::vector<Interval<T>>& ranges){
+    return IntervalEvaluator<T>(expression).bounds(variables, ranges);
+}
+
+
+#define INSTANTIATE_INTERVAL(T) \
+    template struct Interval<T>; \
+    template Interval<T> operator + (const Interval<T>&, const Interval<T>&); \
+    template Interval<T> operator - (const Interval<T>&, const Interval<T>&); \
+    template Interval<T> operator * (const Interval<T>&, const Interval<T>&); \
+    template Interval<T> operator / (const Interval<T>&, const Interval<T>&); \
+    template Interval<T> pow(const Interval<T>&, const Interval<T>&); \
+    template Interval<T> sin(const Interval<T>&); \
+    template Interval<T> cos(const Interval<T>&); \
+    template Interval<T> ln(const Interval<T>&); \
+    template Interval<T> exp(const Interval<T>&); \
+    template Interval<T> sqrt(const Interval<T>&); \
+    template Interval<T> intersect(const Interval<T>&, const Interval<T>&); \
+    template class IntervalEvaluator<T>; \
+    template Interval<T> eval_interval(const Expression<T>&, \
+                                       const std::vector<std::string>&, \
+                                       const std::vector<Interval<T>>&);
+
+INSTANTIATE_INTERVAL(float)
+INSTANTIATE_INTERVAL(double)
+INSTANTIATE_INTERVAL(long double)
+
+#undef INSTANTIATE_INTERVAL
+
+} // namespace Expressions
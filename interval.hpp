@@ -0,0 +1,74 @@
+#ifndef HEADER_GUARD_INTERVAL_HPP_INCLUDED
+#define HEADER_GUARD_INTERVAL_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include "expression.hpp"
+#include "flat.hpp"
+
+namespace Expressions {
+
+// closed interval [lower, upper]
+// an empty interval (e.g. ln of negative numbers) has NaN bounds
+template <typename T>
+struct Interval
+{
+    T lower;
+    T upper;
+
+    Interval();
+    Interval(T point);
+    Interval(T lower, T upper);
+
+    bool empty() const;
+    bool contains(T value) const;
+    T width() const;
+    T mid() const;
+};
+
+// interval operations, results are rounded outwards so they always enclose the exact range
+template <typename T> Interval<T> operator + (const Interval<T>& a, const Interval<T>& b);
+template <typename T> Interval<T> operator - (const Interval<T>& a, const Interval<T>& b);
+template <typename T> Interval<T> operator * (const Interval<T>& a, const Interval<T>& b);
+template <typename T> Interval<T> operator / (const Interval<T>& a, const Interval<T>& b);
+template <typename T> Interval<T> pow(const Interval<T>& base, const Interval<T>& exponent);
+template <typename T> Interval<T> sin(const Interval<T>& a);
+template <typename T> Interval<T> cos(const Interval<T>& a);
+template <typename T> Interval<T> ln(const Interval<T>& a);
+template <typename T> Interval<T> exp(const Interval<T>& a);
+template <typename T> Interval<T> sqrt(const Interval<T>& a);
+template <typename T> Interval<T> intersect(const Interval<T>& a, const Interval<T>& b);
+
+// bounds an expression over a box of variable ranges in one pass over the expression
+// with mean_value set, the bounds are also tightened with the mean-value form
+// f(X) in f(c) + sum f'_i(X) * (X_i - c_i), c being the center of the box
+template <typename T>
+class IntervalEvaluator
+{
+private:
+    FlatExpression<T> expr_;
+    // partial derivatives by every variable, used by the mean-value form
+    std::vector<FlatExpression<T>> partials_;
+    // variable slots of every partial derivative mapped to slots of expr_
+    std::vector<std::vector<size_t>> partial_slots_;
+
+    static Interval<T> bounds(const FlatExpression<T>& expr, const std::vector<Interval<T>>& ranges);
+public:
+    explicit IntervalEvaluator(const Expression<T>& expression, bool mean_value = false);
+    ~IntervalEvaluator() = default;
+
+    // ranges are given in the order of variables(), missing ranges are taken as 0
+    Interval<T> bounds(const std::vector<Interval<T>>& ranges) const;
+    Interval<T> bounds(const std::vector<std::string>& variables, const std::vector<Interval<T>>& ranges) const;
+
+    const std::vector<std::string>& variables() const;
+};
+
+// bounds an expression over given variable ranges
+template <typename T>
+Interval<T> eval_interval(const Expression<T>& expression,
+                          const std::vector<std::string>& variables,
+                          const std::vector<Interval<T>>& ranges);
+} // namespace Expressions
+
+#endif // HEADER_GUARD_INTERVAL_HPP_INCLUDED
@@ -0,0 +1,148 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "mixed.hpp"
+
+namespace Expressions {
+
+template <typename F>
+MixedPrecisionEvaluator<F>::MixedPrecisionEvaluator(const Expression<long double>& expression, long double tolerance) :
+fast_(expression.convert<F>()), reference_(expression), tolerance_(tolerance), reference_slots_() {
+    const std::vector<std::string>& names = reference_.variables();
+    for (const std::string& var : fast_.variables()){
+        reference_slots_.push_back(std::find(names.begin(), names.end(), var) - names.begin());
+    }
+}
+
+// first order error propagation: every node adds the error of its operands scaled by the
+// sensitivity of the operation, plus its own rounding (1 ulp for arithmetic, 2 ulps for library functions)
+template <typename F>
+EstimatedValue<F> MixedPrecisionEvaluator<F>::resolve_with_error(const std::vector<F>& values) const {
+    static thread_local std::vector<F> value_scratch;
+    static thread_local std::vector<F> error_scratch;
+    const std::vector<FlatNode<F>>& nodes = fast_.nodes();
+    value_scratch.resize(nodes.size());
+    error_scratch.resize(nodes.size());
+    F* v = value_scratch.data();
+    F* e = error_scratch.data();
+
+    const F u = std::numeric_limits<F>::epsilon();
+    const F inf = std::numeric_limits<F>::infinity();
+
+    for (size_t i = 0; i < nodes.size(); i++){
+        const FlatNode<F>& node = nodes[i];
+        F a = v[node.left];
+        F b = v[node.right];
+        F ea = e[node.left];
+        F eb = e[node.right];
+        F r = 0;
+        F err = 0;
+
+        switch (node.kind){
+            case NodeKind::Number:
+                r = node.value;
+                err = std::abs(r) * u;
+                break;
+            case NodeKind::Variable:
+                // inputs are rounded to F
+                r = node.left < values.size() ? values[node.left] : F(0);
+                err = std::abs(r) * u;
+                break;
+            case NodeKind::Plus:
+                r = a + b;
+                err = ea + eb + std::abs(r) * u;
+                break;
+            case NodeKind::Minus:
+                r = a - b;
+                err = ea + eb + std::abs(r) * u;
+                break;
+            case NodeKind::Mult:
+                r = a * b;
+                err = std::abs(a) * eb + std::abs(b) * ea + ea * eb + std::abs(r) * u;
+                break;
+            case NodeKind::Div:
+                r = a / b;
+                err = std::abs(b) > eb ? (ea + std::abs(r) * eb) / (std::abs(b) - eb) + std::abs(r) * u : inf;
+                break;
+            case NodeKind::Pow:
+                // d(a^b) = b a^(b-1) da + a^b ln(a) db
+                r = std::pow(a, b);
+                err = std::abs(a) > ea ? std::abs(r) * (std::abs(b) * ea / (std::abs(a) - ea) +
+                                                        std::abs(std::log(std::abs(a))) * eb + 2 * u)
+                                       : inf;
+                break;
+            case NodeKind::Sin:
+                r = std::sin(a);
+                err = ea + 2 * u;
+                break;
+            case NodeKind::Cos:
+                r = std::cos(a);
+                err = ea + 2 * u;
+                break;
+            case NodeKind::Ln:
+                // ill-conditioned near a = 1, where the result is close to 0
+                r = std::log(a);
+                err = std::abs(a) > ea ? ea / (std::abs(a) - ea) + 2 * std::abs(r) * u : inf;
+                break;
+            case NodeKind::Exp:
+                r = std::exp(a);
+                err = std::abs(r) * (std::expm1(ea) + 2 * u);
+                break;
+            case NodeKind::Sqrt:
+                // sqrt(a) - sqrt(a - ea) = ea / (sqrt(a) + sqrt(a - ea))
+                r = std::sqrt(a);
+                err = a > ea ? ea / (r + std::sqrt(a - ea)) + r * u : inf;
+                break;
+            case NodeKind::Polynomial:
+                // lowered to Horner form by FlatExpression
+                break;
+        }
+
+        v[i] = r;
+        e[i] = std::isnan(err) ? inf : err;
+    }
+
+    return EstimatedValue<F>{v[fast_.root()], e[fast_.root()]};
+}
+
+template <typename F>
+size_t MixedPrecisionEvaluator<F>::evaluate(const std::vector<long double>& rows, std::vector<long double>& out) const {
+    size_t width = fast_.variables().size();
+    size_t count = width == 0 ? std::min<size_t>(rows.size(), 1) : rows.size() / width;
+    out.resize(count);
+
+    std::vector<F> values(width);
+    std::vector<long double> reference_values(reference_.variables().size(), 0);
+    size_t fallbacks = 0;
+
+    for (size_t row = 0; row < count; row++){
+        for (size_t slot = 0; slot < width; slot++){
+            values[slot] = static_cast<F>(rows[row * width + slot]);
+        }
+
+        EstimatedValue<F> res = resolve_with_error(values);
+        if (std::isfinite(res.value) && res.error <= tolerance_ * std::abs(static_cast<long double>(res.value))){
+            out[row] = res.value;
+            continue;
+        }
+
+        // reference path
+        for (size_t slot = 0; slot < width; slot++){
+            if (reference_slots_[slot] < reference_values.size()){
+                reference_values[reference_slots_[slot]] = rows[row * width + slot];
+            }
+        }
+        out[row] = reference_.resolve(reference_values);
+        fallbacks++;
+    }
+
+    return fallbacks;
+}
+
+template <typename F>
+const std::vector<std::string>& MixedPrecisionEvaluator<F>::variables() const { return fast_.variables(); }
+
+template class MixedPrecisionEvaluator<float>;
+template class MixedPrecisionEvaluator<double>;
+
+} // namespace Expressions
@@ -0,0 +1,45 @@
+#ifndef HEADER_GUARD_MIXED_HPP_INCLUDED
+#define HEADER_GUARD_MIXED_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include "expression.hpp"
+#include "flat.hpp"
+
+namespace Expressions {
+
+// value with a bound on its absolute rounding error
+template <typename T>
+struct EstimatedValue
+{
+    T value;
+    T error;
+};
+
+// evaluates in a fast precision F (double or float) while tracking a running error bound per node,
+// rows whose relative error bound exceeds the tolerance are recomputed in long double
+template <typename F>
+class MixedPrecisionEvaluator
+{
+private:
+    FlatExpression<F> fast_;
+    FlatExpression<long double> reference_;
+    long double tolerance_;
+    // slots of the reference expression for every slot of the fast one
+    std::vector<size_t> reference_slots_;
+public:
+    MixedPrecisionEvaluator(const Expression<long double>& expression, long double tolerance = 1e-12L);
+    ~MixedPrecisionEvaluator() = default;
+
+    // values are given in the order of variables()
+    EstimatedValue<F> resolve_with_error(const std::vector<F>& values) const;
+
+    // rows hold variables().size() values each, results are written to out
+    // returns the number of rows evaluated in long double
+    size_t evaluate(const std::vector<long double>& rows, std::vector<long double>& out) const;
+
+    const std::vector<std::string>& variables() const;
+};
+} // namespace Expressions
+
+#endif // HEADER_GUARD_MIXED_HPP_INCLUDED
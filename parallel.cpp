@@ -0,0 +1,54 @@
+#include <thread>
+#include <vector>
+#include <exception>
+#include <algorithm>
+#include "parallel.hpp"
+#include "budget.hpp"
+
+namespace Expressions {
+
+size_t default_threads(){
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+void parallel_for(size_t count, const std::function<void(size_t, size_t)>& body, size_t threads){
+    if (count == 0){ return; }
+    if (threads == 0){ threads = default_threads(); }
+    threads = std::min(threads, count);
+
+    // budget scopes are per thread, workers would run unchecked
+    if (threads == 1 || BudgetScope::active()){
+        body(0, count);
+        return;
+    }
+
+    // first exception of a worker is rethrown on the calling thread
+    std::vector<std::exception_ptr> errors(threads);
+    std::vector<std::thread> workers;
+    size_t chunk = (count + threads - 1) / threads;
+
+    for (size_t t = 1; t < threads; t++){
+        size_t begin = std::min(count, t * chunk);
+        size_t end = std::min(count, begin + chunk);
+        workers.emplace_back([&body, &errors, t, begin, end](){
+            try {
+                body(begin, end);
+            } catch (...) {
+                errors[t] = std::current_exception();
+            }
+        });
+    }
+
+    try {
+        body(0, std::min(count, chunk));
+    } catch (...) {
+        errors[0] = std::current_exception();
+    }
+
+    for (std::thread& worker : workers){ worker.join(); }
+    for (std::exception_ptr& error : errors){
+        if (error){ std::rethrow_exception(error); }
+    }
+}
+
+} // namespace Expressions
@@ -0,0 +1,19 @@
+#ifndef HEADER_GUARD_PARALLEL_HPP_INCLUDED
+#define HEADER_GUARD_PARALLEL_HPP_INCLUDED
+
+#include <cstddef>
+#include <functional>
+
+namespace Expressions {
+
+// number of worker threads used when 0 is requested
+size_t default_threads();
+
+// splits [0, count) into contiguous chunks and runs body(begin, end) for each chunk on its own thread
+// threads = 0 uses default_threads(), the calling thread takes the first chunk
+// while a BudgetScope is active on the calling thread everything runs there, so all the work is charged
+// to that scope and the results don't depend on the number of threads
+void parallel_for(size_t count, const std::function<void(size_t, size_t)>& body, size_t threads = 0);
+} // namespace Expressions
+
+#endif // HEADER_GUARD_PARALLEL_HPP_INCLUDED
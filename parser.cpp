@@ -1,12 +1,15 @@
 #include "parser.hpp"
+#include "budget.hpp"
+#include <cctype>
+#include <charconv>
 #include <stdexcept>
 
 namespace Expressions{
 
 /*LEXER*/
 
-// see next symbol
-char Lexer::peek() const { return *pos_; }
+// see symbol at the given offset, '\0' past the end
+char Lexer::peek(size_t offset) const { return pos_ + offset < end_ ? pos_[offset] : '\0'; }
 
 // get next symbol
 char Lexer::get(){
@@ -15,69 +18,49 @@ char Lexer::get(){
     return c;
 }
 
-// gets token from analyzed string based on a regular expression
-Token Lexer::getTokenByPattern(const std::regex& regexp, TokenType expectedTokenType){
-    std::cmatch matchResult{};
-
-    // searching for pattern in string
-    bool matchStatus = std::regex_search(pos_, end_, matchResult, regexp, std::regex_constants::match_continuous);
-    
-    if (!matchStatus) // pattern not found
-    {
-        throw std::runtime_error(
-            std::string("Unexpected subexpression on pos ") + std::to_string(column_));
-    }
-
-    // moving current position in string
-    pos_ = matchResult[0].second;
-
-    // the found matching regexp string
-    std::string lexemeStr = std::string(matchResult[0].first, matchResult[0].second);
-
-    // return found token
-    return Token{expectedTokenType, std::move(lexemeStr), column_};
-}
-
-// skips given token (interpreted as a regexp) in analyzed string
-void Lexer::skipTokenByPattern(const std::regex& regexp){
-    std::cmatch matchResult{};
-
-    // searching for pattern in string
-    bool matchStatus = std::regex_search(pos_, end_, matchResult, regexp, std::regex_constants::match_continuous);
-    if (matchStatus){
-        // moving current position
-        pos_ = matchResult[0].second;
-    }
-}
-
 // skips unnecessary spaces
 void Lexer::skipSpaceSequence(){
-    static const std::regex spacePattern{REGEXP_SPACE_SEQUENCE};
-    skipTokenByPattern(spacePattern);
+    while (pos_ < end_ && (*pos_ == ' ' || *pos_ == '\t' || *pos_ == '\r')){
+        pos_++;
+    }
 }
 
 // gets next variable in string
 Token Lexer::getVariable(){
-    static const std::regex variablePattern{REGEXP_VARIABLE};
-    return getTokenByPattern(variablePattern, Variable);
+    const char* start = pos_;
+    while (pos_ < end_ && (std::isalpha(static_cast<unsigned char>(*pos_)) || *pos_ == '_')){
+        pos_++;
+    }
+    return Token{Variable, std::string_view(start, pos_ - start), column_};
 }
 
 // gets next number in string
 Token Lexer::getNumber(){
-    static const std::regex numberPattern{REGEXP_NUMBER};
-    return getTokenByPattern(numberPattern, Number);
+    auto digit = [](char c){ return std::isdigit(static_cast<unsigned char>(c)) != 0; };
+    const char* start = pos_;
+    while (digit(peek())){ pos_++; }
+    // fraction
+    if (peek() == '.' && digit(peek(1))){
+        pos_++;
+        while (digit(peek())){ pos_++; }
+    }
+    // exponent
+    size_t sign = peek(1) == '+' || peek(1) == '-' ? 1 : 0;
+    if ((peek() == 'e' || peek() == 'E') && digit(peek(1 + sign))){
+        pos_ += 1 + sign;
+        while (digit(peek())){ pos_++; }
+    }
+    return Token{Number, std::string_view(start, pos_ - start), column_};
 }
 
 // constructor
-Lexer::Lexer(const std::string& input) : input_(input), pos_(), end_(), column_(0){
-    pos_ = input_.c_str();
-    end_ = pos_ + input_.size();
-}
+Lexer::Lexer(std::string_view input) : input_(input), pos_(input.data()), end_(input.data() + input.size()), column_(0) {}
 
 // gets next token of the string
 Token Lexer::getNextToken()
 {
     skipSpaceSequence();
+    column_ = pos_ - input_.data();
 
     // reached EOF
     if (pos_ >= end_)
@@ -88,66 +71,47 @@ Token Lexer::getNextToken()
     // getting next symbol to identify the lexem
     char currentChar = peek();
 
-    if (isalpha(currentChar) || currentChar == '_')
+    if (std::isalpha(static_cast<unsigned char>(currentChar)) || currentChar == '_')
     {
         Token token = getVariable();
         if (token.lexeme == "sin") {
-            return Token{Sin, "sin", column_};
+            token.type = Sin;
         } else if (token.lexeme == "cos") {
-            return Token{Cos, "cos", column_};
+            token.type = Cos;
         } else if (token.lexeme == "ln") {
-            return Token{Ln, "ln", column_};
+            token.type = Ln;
         } else if (token.lexeme == "exp") {
-            return Token{Exp, "exp", column_};
+            token.type = Exp;
         } else if (token.lexeme == "i") {
-            return Token{Number, "i", column_};
-        } else {
-            // variable
-            return token;
+            token.type = Number;
         }
+        return token;
     }
-    else if (isdigit(currentChar) || currentChar == '+' || currentChar == '-'){
+    else if (std::isdigit(static_cast<unsigned char>(currentChar))){
         Token token = getNumber();
         // check if complex
         if (peek() == 'i') {
             get(); // skip 'i'
-            token.lexeme += "i";
-            token.type = Number;
+            token.lexeme = std::string_view(token.lexeme.data(), token.lexeme.size() + 1);
         }
         return token;
     }
-    else if (currentChar == '+'){
-        get();
-        return Token{Plus, "+", column_};
-    }
-    else if (currentChar == '-'){
-        get();
-        return Token{Minus, "-", column_};
-    }
-    else if (currentChar == '*'){
-        get();
-        return Token{Mult, "*", column_};
-    }
-    else if (currentChar == '/'){
-        get();
-        return Token{Div, "/", column_};
-    }
-    else if (currentChar == '^'){
-        get();
-        return Token{Pow, "^", column_};
-    }
-    else if (currentChar == '('){
-        get();
-        return Token{Left_bracket, "(", column_};
-    }
-    else if (currentChar == ')'){
-        get();
-        return Token{Right_bracket, ")", column_};
-    }
-    else{
-        throw std::runtime_error(
-            std::string("Unexpected subexpression on pos ") + std::to_string(column_));
+
+    TokenType type;
+    switch (currentChar){
+        case '+': type = Plus; break;
+        case '-': type = Minus; break;
+        case '*': type = Mult; break;
+        case '/': type = Div; break;
+        case '^': type = Pow; break;
+        case '(': type = Left_bracket; break;
+        case ')': type = Right_bracket; break;
+        default:
+            throw std::runtime_error(
+                std::string("Unexpected subexpression on pos ") + std::to_string(column_));
     }
+    get();
+    return Token{type, std::string_view(pos_ - 1, 1), column_};
 }
 
 
@@ -176,7 +140,7 @@ void Parser<T>::expect(std::set<TokenType> types){
     if (!types.contains(currentToken_.type)){
         // expected token not found in given set
         throw std::runtime_error(
-            "Got unexpected token \"" + currentToken_.lexeme +
+            "Got unexpected token \"" + std::string(currentToken_.lexeme) +
             "\" of type " + std::to_string(currentToken_.type));
     }
 
@@ -195,231 +159,160 @@ bool Parser<T>::match(TokenType type){
     return false;
 }
 
+namespace {
+
+// binding power of binary operators, 0 for other tokens
+int precedence(TokenType type){
+    switch (type){
+        case Plus:
+        case Minus: return 1;
+        case Mult:
+        case Div:   return 2;
+        case Pow:   return 4;
+        default:    return 0;
+    }
+}
+
+// binding power of unary plus and minus, between "*" and "^"
+constexpr int UNARY_PRECEDENCE = 3;
+
+NodeKind kind_of(TokenType type){
+    switch (type){
+        case Plus:  return NodeKind::Plus;
+        case Minus: return NodeKind::Minus;
+        case Mult:  return NodeKind::Mult;
+        case Div:   return NodeKind::Div;
+        case Pow:   return NodeKind::Pow;
+        case Sin:   return NodeKind::Sin;
+        case Cos:   return NodeKind::Cos;
+        case Ln:    return NodeKind::Ln;
+        default:    return NodeKind::Exp;
+    }
+}
+
+} // namespace
+
+// "+", "-", "*" and "/" are left associative, "^" is right associative: a ^ b ^ c = a ^ (b ^ c)
 template<typename T>
-Expression<T> Parser<T>::parseExpr(){
-    Expression<T> expr = parseTerm();
-    while (currentToken_.type == Plus){
-        // getting '+'
-        advance();
+std::shared_ptr<ExpressionNode<T>> Parser<T>::parseBinary(int min_precedence){
+    // brackets, functions, unary signs and "^" nest the recursion
+    BudgetScope::check_depth(++depth_, "parsing");
+    std::shared_ptr<ExpressionNode<T>> left = parseUnary();
 
-        // getting next operand
-        Expression term = parseTerm();
+    for (int prec = precedence(currentToken_.type); prec > 0 && prec >= min_precedence; prec = precedence(currentToken_.type)){
+        TokenType op = currentToken_.type;
+        advance();
 
-        // updating expression
-        expr = expr + term;
+        std::shared_ptr<ExpressionNode<T>> right = parseBinary(op == Pow ? prec : prec + 1);
+        left = make_node<T>(kind_of(op), left, right);
     }
 
-    return expr;
+    depth_--;
+    return left;
 }
 
-// template<typename T>
-// Expression<T> Parser<T>::parseFactor()
-// {
-//     if (match(Left_bracket)){
-//         Expression<T> expr = parseExpr();
-//         expect({Right_bracket});
-//         return expr;
-//     }
-
-//     if (match(Number))
-//     {
-//         std::string lexeme = previousToken_.lexeme;
-//         if (lexeme == "i") {
-//             // single 'i'
-//             return Expression<T>(std::complex<double>(0, 1)); // 0 + 1i
-//         } else if (lexeme.find('i') != std::string::npos) {
-//             // complex with coef
-//             lexeme.pop_back(); // deleting 'i'
-//             double imagPart = std::stod(lexeme);
-//             return Expression<T>(std::complex<double>(0, imagPart)); // 0 + bi
-//         } else {
-//             // not complex
-//             return Expression<T>(std::stold(lexeme));
-//         }
-//     }
-
-//     if (match(Variable)){
-//         return Expression<T>(previousToken_.lexeme);
-//     }
-
-//     if (match(Sin)){
-//         expect({Left_bracket});
-//         Expression<T> arg = parseExpr();
-//         expect({Right_bracket});
-//         return arg.sin();
-//     }
-
-//     if (match(Cos)){
-//         expect({Left_bracket});
-//         Expression<T> arg = parseExpr();
-//         expect({Right_bracket});
-//         return arg.cos();
-//     }
-
-//     if (match(Ln)){
-//         expect({Left_bracket});
-//         Expression<T> arg = parseExpr();
-//         expect({Right_bracket});
-//         return arg.ln();
-//     }
-
-//     if (match(Exp)){
-//         expect({Left_bracket});
-//         Expression<T> arg = parseExpr();
-//         expect({Right_bracket});
-//         return arg.exp();
-//     }
-
-
-//     throw std::runtime_error(
-//         "Got unexpected token \"" + currentToken_.lexeme +
-//         "\" of type " + std::to_string(currentToken_.type));
-// }
-
-// template<>
-// Expression<std::complex<double>> Parser<std::complex<double>>::parseFactor()
-// {
-//     if (match(Left_bracket)){
-//         Expression<std::complex<double>> expr = parseExpr();
-//         expect({Right_bracket});
-//         return expr;
-//     }
-
-//     if (match(Number))
-//     {
-//         std::string lexeme = previousToken_.lexeme;
-//         if (lexeme == "i") {
-//             // single 'i'
-//             return Expression<std::complex<double>>(std::complex<double>(0, 1)); // 0 + 1i
-//         } else if (lexeme.find('i') != std::string::npos) {
-//             // complex with coef
-//             lexeme.pop_back(); // deleting 'i'
-//             double imagPart = std::stod(lexeme);
-//             return Expression<std::complex<double>>(std::complex<double>(0, imagPart)); // 0 + bi
-//         } else {
-//             // not complex
-//             return Expression<std::complex<double>>(static_cast<std::complex<double>>(std::stod(lexeme), 0));
-//         }
-//     }
-
-//     if (match(Variable)){
-//         return Expression<std::complex<double>>(std::complex<double>(std::stod(previousToken_.lexeme), 0));
-//     }
-
-//     if (match(Sin)){
-//         expect({Left_bracket});
-//         Expression<std::complex<double>> arg = parseExpr();
-//         expect({Right_bracket});
-//         return arg.sin();
-//     }
-
-//     if (match(Cos)){
-//         expect({Left_bracket});
-//         Expression<std::complex<double>> arg = parseExpr();
-//         expect({Right_bracket});
-//         return arg.cos();
-//     }
-
-//     if (match(Ln)){
-//         expect({Left_bracket});
-//         Expression<std::complex<double>> arg = parseExpr();
-//         expect({Right_bracket});
-//         return arg.ln();
-//     }
-
-//     if (match(Exp)){
-//         expect({Left_bracket});
-//         Expression<std::complex<double>> arg = parseExpr();
-//         expect({Right_bracket});
-//         return arg.exp();
-//     }
-
-
-//     throw std::runtime_error(
-//         "Got unexpected token \"" + currentToken_.lexeme +
-//         "\" of type " + std::to_string(currentToken_.type));
-// }
-
-template<>
-Expression<long double> Parser<long double>::parseFactor()
-{
-    if (match(Left_bracket)){
-        Expression<long double> expr = parseExpr();
-        expect({Right_bracket});
-        return expr;
+template<typename T>
+std::shared_ptr<ExpressionNode<T>> Parser<T>::parseUnary(){
+    // unary plus leaves its operand as it is, +3 is the number 3
+    if (match(Plus)){
+        return parseBinary(UNARY_PRECEDENCE + 1);
     }
-
-    if (match(Number)){
-        return Expression<long double>(std::stold(previousToken_.lexeme));
+    if (!match(Minus)){
+        return parsePrimary();
     }
 
-    if (match(Variable)){
-        return Expression<long double>(previousToken_.lexeme);
+    std::shared_ptr<ExpressionNode<T>> arg = parseBinary(UNARY_PRECEDENCE + 1);
+    // negative literals stay numbers, so x ^ -1 has a constant exponent
+    if (arg->kind() == NodeKind::Number){
+        return std::make_shared<NumberNode<T>>(-static_cast<const NumberNode<T>*>(arg.get())->value());
     }
+    return std::make_shared<MultNode<T>>(std::make_shared<NumberNode<T>>(T(-1)), arg);
+}
 
-    if (match(Sin)){
-        expect({Left_bracket});
-        Expression<long double> arg = parseExpr();
+template<typename T>
+std::shared_ptr<ExpressionNode<T>> Parser<T>::parsePrimary(){
+    if (match(Left_bracket)){
+        std::shared_ptr<ExpressionNode<T>> expr = parseBinary(1);
         expect({Right_bracket});
-        return arg.sin();
+        return expr;
     }
 
-    if (match(Cos)){
-        expect({Left_bracket});
-        Expression<long double> arg = parseExpr();
-        expect({Right_bracket});
-        return arg.cos();
+    if (match(Number)){
+        return parseNumber(previousToken_.lexeme);
     }
 
-    if (match(Ln)){
-        expect({Left_bracket});
-        Expression<long double> arg = parseExpr();
-        expect({Right_bracket});
-        return arg.ln();
+    if (match(Variable)){
+        return std::make_shared<VariableNode<T>>(std::string(previousToken_.lexeme));
     }
 
-    if (match(Exp)){
+    if (currentToken_.type == Sin || currentToken_.type == Cos || currentToken_.type == Ln || currentToken_.type == Exp){
+        NodeKind function = kind_of(currentToken_.type);
+        advance();
         expect({Left_bracket});
-        Expression<long double> arg = parseExpr();
+        std::shared_ptr<ExpressionNode<T>> arg = parseBinary(1);
         expect({Right_bracket});
-        return arg.exp();
+        return make_node<T>(function, arg);
     }
 
     throw std::runtime_error(
-        "Got unexpected token \"" + currentToken_.lexeme +
+        "Got unexpected token \"" + std::string(currentToken_.lexeme) +
         "\" of type " + std::to_string(currentToken_.type));
 }
 
-template<typename T>
-Expression<T> Parser<T>::parseTerm(){
-    Expression<T> term = parseFactor();
+namespace {
 
-    while (currentToken_.type == Mult){
-        // reading "*"
-        advance();
+// reads a number lexeme in long double precision
+long double to_number(std::string_view lexeme){
+    long double value = 0;
+    auto [end, error] = std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), value);
+    if (error != std::errc() || end != lexeme.data() + lexeme.size()){
+        throw std::runtime_error("Invalid number \"" + std::string(lexeme) + "\"");
+    }
+    return value;
+}
 
-        // getting next multiplicand
-        Expression factor = parseFactor();
+} // namespace
 
-        // updating expression
-        term = term * factor;
+// numbers of real expressions are read in long double precision and then rounded to T
+template<typename T>
+std::shared_ptr<ExpressionNode<T>> Parser<T>::parseNumber(std::string_view lexeme){
+    if (lexeme.back() == 'i'){
+        throw std::runtime_error("Imaginary number \"" + std::string(lexeme) + "\" in a real expression");
     }
+    return std::make_shared<NumberNode<T>>(static_cast<T>(to_number(lexeme)));
+}
 
-    return term;
+template<>
+std::shared_ptr<ExpressionNode<std::complex<long double>>> Parser<std::complex<long double>>::parseNumber(std::string_view lexeme){
+    using Complex = std::complex<long double>;
+    if (lexeme == "i"){
+        // single 'i'
+        return std::make_shared<NumberNode<Complex>>(Complex(0, 1)); // 0 + 1i
+    }
+    if (lexeme.back() == 'i'){
+        // complex with coef
+        return std::make_shared<NumberNode<Complex>>(Complex(0, to_number(lexeme.substr(0, lexeme.size() - 1)))); // 0 + bi
+    }
+    // not complex
+    return std::make_shared<NumberNode<Complex>>(Complex(to_number(lexeme), 0));
 }
 
 
 // parses full expression
 template<typename T>
 Expression<T> Parser<T>::parseExpression(){
-    Expression<T> expr = parseExpr();
+    Expression<T> expr(parseBinary(1));
 
     expect({Eof});
 
+    // left associative chains are deep without nesting
+    if (BudgetScope::active()){ BudgetScope::check_depth(static_cast<size_t>(estimate_size(expr).depth), "parsing"); }
     return expr;
 }
 
+template class Parser<float>;
+template class Parser<double>;
 template class Parser<long double>;
-//template class Parser<std::complex<long double>>;
+template class Parser<std::complex<long double>>;
 
 } // namespace Expressions
\ No newline at end of file
@@ -3,7 +3,7 @@
 
 #include <iostream>
 #include <string>
-#include <regex>
+#include <string_view>
 #include <set>
 #include "expression.hpp"
 
@@ -27,42 +27,39 @@ enum TokenType
     Eof,            // "/n"
 };
 
-// regular expressions for some token types
-constexpr const char* REGEXP_SPACE_SEQUENCE = "[ \t]+";
-constexpr const char* REGEXP_VARIABLE       = "[a-zA-Z_]+";
-constexpr const char* REGEXP_NUMBER        = "(\\+|-)?(0|[1-9][0-9]*)(\\.[0-9]+)?";
+// characters of the token types read by the lexer:
+// spaces are " \t\r", variables are [a-zA-Z_]+,
+// numbers are [0-9]+(\.[0-9]+)?([eE][+-]?[0-9]+)? with an optional "i" suffix
 
+// lexemes point into the analyzed text, which has to outlive the tokens
 struct Token
 {
     TokenType type;
-    std::string lexeme;
+    std::string_view lexeme;
     size_t column;
 };
 
 class Lexer
 {
 private:
-    // string to be analyzed
-    std::string input_;
+    // text to be analyzed, not copied
+    std::string_view input_;
     // current position in analyzed string
     const char* pos_;
     // final position in analyzed string
     const char* end_;
-    // current index of analyzed string
+    // index of the current token in analyzed string
     size_t column_;
 
-    char peek() const;
+    char peek(size_t offset = 0) const;
     char get();
 
-    Token getTokenByPattern(const std::regex& regexp, TokenType expectedTokenType);
-    void skipTokenByPattern(const std::regex& regexp);
-
     void skipSpaceSequence();
     Token getVariable();
     Token getNumber();
 
 public:
-    Lexer(const std::string& input);
+    explicit Lexer(std::string_view input);
     ~Lexer() = default;
 
     Token getNextToken();
@@ -77,6 +74,8 @@ private:
     Token currentToken_;
     // previous lexem
     Token previousToken_;
+    // nesting of parseBinary calls, bounded by an active BudgetScope
+    size_t depth_ = 0;
 
     // move to next lexem
     void advance();
@@ -85,11 +84,16 @@ private:
     // move to next lexem if token types match
     bool match(TokenType type);
 
-    Expression<T> parseExpr();
-    Expression<T> parseTerm();
-    Expression<T> parseFactor();
+    // precedence climbing: parses operands and binary operators binding at least as tight as min_precedence
+    std::shared_ptr<ExpressionNode<T>> parseBinary(int min_precedence);
+    // unary plus and minus, bind looser than "^": -x ^ 2 = -(x ^ 2)
+    std::shared_ptr<ExpressionNode<T>> parseUnary();
+    // numbers, variables, brackets and functions
+    std::shared_ptr<ExpressionNode<T>> parsePrimary();
+    std::shared_ptr<ExpressionNode<T>> parseNumber(std::string_view lexeme);
 public:
     Parser(Lexer& lexer);
+    // checks the depth of the parsed tree against the active budgets, see BudgetScope
     Expression<T> parseExpression();
 };
 } // namespace Expressions
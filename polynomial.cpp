@@ -0,0 +1,519 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <complex>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include "polynomial.hpp"
+#include "budget.hpp"
+
+namespace Expressions {
+
+namespace {
+
+// x^n by repeated squaring
+template <typename T>
+T ipow(T x, unsigned n){
+    T result(1);
+    while (n > 0){
+        if (n & 1){ result *= x; }
+        x *= x;
+        n >>= 1;
+    }
+    return result;
+}
+
+// checks that a constant is a natural number small enough to expand a power
+template <typename T>
+bool natural_exponent(const T& value, unsigned& n){
+    if (!(value >= T(0)) || value > T(POLYNOMIAL_MAX_POWER) || std::floor(value) != value){ return false; }
+    n = static_cast<unsigned>(value);
+    return true;
+}
+
+template <typename T>
+bool natural_exponent(const std::complex<T>& value, unsigned& n){
+    return value.imag() == 0 && natural_exponent(value.real(), n);
+}
+
+} // namespace
+
+
+/*POLYNOMIAL*/
+
+template <typename T>
+Polynomial<T>::Polynomial(T constant) : variables_(), terms_(), dense_() {
+    if (constant != T(0)){ terms_.push_back({{}, constant}); }
+}
+
+// canonical polynomial: zero terms and variables with zero exponents in every term are dropped
+template <typename T>
+Polynomial<T>::Polynomial(std::vector<std::string> variables, const std::map<std::vector<unsigned>, T>& terms) :
+variables_(), terms_(), dense_() {
+    std::vector<bool> used(variables.size(), false);
+    for (const auto& [exponents, coefficient] : terms){
+        if (coefficient == T(0)){ continue; }
+        for (size_t k = 0; k < exponents.size(); k++){
+            used[k] = used[k] || exponents[k] > 0;
+        }
+    }
+    for (size_t k = 0; k < variables.size(); k++){
+        if (used[k]){ variables_.push_back(variables[k]); }
+    }
+
+    // exponent vectors over the used variables keep their relative order
+    for (const auto& [exponents, coefficient] : terms){
+        if (coefficient == T(0)){ continue; }
+        std::vector<unsigned> reduced;
+        for (size_t k = 0; k < exponents.size(); k++){
+            if (used[k]){ reduced.push_back(exponents[k]); }
+        }
+        terms_.push_back({reduced, coefficient});
+    }
+
+    // mostly dense univariate polynomials of high degree are evaluated with Estrin's scheme
+    unsigned deg = degree();
+    if (variables_.size() == 1 && deg >= ESTRIN_MIN_DEGREE && 2 * terms_.size() > deg){
+        dense_.assign(deg + 1, T(0));
+        for (const auto& [exponents, coefficient] : terms_){
+            dense_[exponents[0]] = coefficient;
+        }
+    }
+}
+
+template <typename T>
+Polynomial<T> Polynomial<T>::variable(const std::string& name){
+    return Polynomial<T>({name}, {{{1}, T(1)}});
+}
+
+template <typename T>
+std::map<std::vector<unsigned>, T> Polynomial<T>::terms_over(const std::vector<std::string>& variables) const {
+    std::vector<size_t> position;
+    for (const std::string& var : variables_){
+        position.push_back(std::lower_bound(variables.begin(), variables.end(), var) - variables.begin());
+    }
+
+    std::map<std::vector<unsigned>, T> terms;
+    for (const auto& [exponents, coefficient] : terms_){
+        std::vector<unsigned> widened(variables.size(), 0);
+        for (size_t k = 0; k < exponents.size(); k++){
+            widened[position[k]] = exponents[k];
+        }
+        terms.emplace(widened, coefficient);
+    }
+    return terms;
+}
+
+namespace {
+
+std::vector<std::string> merge_variables(const std::vector<std::string>& a, const std::vector<std::string>& b){
+    std::vector<std::string> merged;
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(merged));
+    return merged;
+}
+
+} // namespace
+
+template <typename T>
+Polynomial<T> Polynomial<T>::operator + (const Polynomial<T>& other) const {
+    std::vector<std::string> vars = merge_variables(variables_, other.variables_);
+    std::map<std::vector<unsigned>, T> terms = terms_over(vars);
+    for (const auto& [exponents, coefficient] : other.terms_over(vars)){
+        terms[exponents] += coefficient;
+    }
+    return Polynomial<T>(vars, terms);
+}
+
+template <typename T>
+Polynomial<T> Polynomial<T>::operator - (const Polynomial<T>& other) const {
+    std::vector<std::string> vars = merge_variables(variables_, other.variables_);
+    std::map<std::vector<unsigned>, T> terms = terms_over(vars);
+    for (const auto& [exponents, coefficient] : other.terms_over(vars)){
+        terms[exponents] -= coefficient;
+    }
+    return Polynomial<T>(vars, terms);
+}
+
+template <typename T>
+Polynomial<T> Polynomial<T>::operator * (const Polynomial<T>& other) const {
+    std::vector<std::string> vars = merge_variables(variables_, other.variables_);
+    std::map<std::vector<unsigned>, T> left = terms_over(vars);
+    std::map<std::vector<unsigned>, T> right = other.terms_over(vars);
+
+    std::map<std::vector<unsigned>, T> terms;
+    for (const auto& [a, ca] : left){
+        for (const auto& [b, cb] : right){
+            std::vector<unsigned> exponents(vars.size());
+            for (size_t k = 0; k < vars.size(); k++){
+                exponents[k] = a[k] + b[k];
+            }
+            terms[exponents] += ca * cb;
+        }
+    }
+    return Polynomial<T>(vars, terms);
+}
+
+template <typename T>
+Polynomial<T> Polynomial<T>::pow(unsigned n) const {
+    Polynomial<T> result(T(1));
+    Polynomial<T> base = *this;
+    while (n > 0){
+        if (n & 1){ result = result * base; }
+        n >>= 1;
+        if (n > 0){ base = base * base; }
+    }
+    return result;
+}
+
+template <typename T>
+Polynomial<T> Polynomial<T>::diff(const std::string& var) const {
+    auto found = std::find(variables_.begin(), variables_.end(), var);
+    if (found == variables_.end()){ return Polynomial<T>(T(0)); }
+    size_t k = found - variables_.begin();
+
+    std::map<std::vector<unsigned>, T> terms;
+    for (const auto& [exponents, coefficient] : terms_){
+        if (exponents[k] == 0){ continue; }
+        std::vector<unsigned> reduced = exponents;
+        reduced[k]--;
+        terms[reduced] += coefficient * T(exponents[k]);
+    }
+    return Polynomial<T>(variables_, terms);
+}
+
+template <typename T>
+Polynomial<T> Polynomial<T>::evaluate(const std::vector<std::string>& variables, const std::vector<T>& values) const {
+    std::vector<std::optional<T>> bound(variables_.size());
+    for (size_t i = 0; i < variables.size() && i < values.size(); i++){
+        auto found = std::find(variables_.begin(), variables_.end(), variables[i]);
+        if (found != variables_.end()){ bound[found - variables_.begin()] = values[i]; }
+    }
+
+    std::map<std::vector<unsigned>, T> terms;
+    for (const auto& [exponents, coefficient] : terms_){
+        std::vector<unsigned> reduced = exponents;
+        T c = coefficient;
+        for (size_t k = 0; k < reduced.size(); k++){
+            if (!bound[k]){ continue; }
+            c *= ipow(*bound[k], reduced[k]);
+            reduced[k] = 0;
+        }
+        terms[reduced] += c;
+    }
+    return Polynomial<T>(variables_, terms);
+}
+
+// recursive Horner scheme over terms [begin, end), which share the exponents of the variables before var
+// terms are sorted, so the exponents of var are ascending within the range
+template <typename T>
+T Polynomial<T>::horner(size_t begin, size_t end, size_t var, const T* values) const {
+    if (var == variables_.size()){ return terms_[begin].second; }
+
+    T x = values[var];
+    T result(0);
+    unsigned previous = 0;
+    bool first = true;
+    // groups of equal exponents of var, highest first
+    for (size_t group_end = end; group_end > begin;){
+        unsigned e = terms_[group_end - 1].first[var];
+        size_t group_begin = group_end - 1;
+        while (group_begin > begin && terms_[group_begin - 1].first[var] == e){ group_begin--; }
+
+        T c = horner(group_begin, group_end, var + 1, values);
+        result = first ? c : result * ipow(x, previous - e) + c;
+        first = false;
+        previous = e;
+        group_end = group_begin;
+    }
+    return result * ipow(x, previous);
+}
+
+// Estrin's scheme, pairs of coefficients are combined independently, which shortens dependency chains
+template <typename T>
+T Polynomial<T>::estrin(T x) const {
+    static thread_local std::vector<T> scratch;
+    scratch.assign(dense_.begin(), dense_.end());
+    T* s = scratch.data();
+
+    for (size_t n = scratch.size(); n > 1; n = (n + 1) / 2){
+        for (size_t i = 0; i < n / 2; i++){
+            s[i] = s[2 * i] + s[2 * i + 1] * x;
+        }
+        if (n % 2 == 1){ s[n / 2] = s[n - 1]; }
+        x *= x;
+    }
+    return s[0];
+}
+
+// values are given in the order of variables(), missing values are 0
+template <typename T>
+T Polynomial<T>::resolve(const std::vector<T>& values) const {
+    if (terms_.empty()){ return T(0); }
+
+    const T* v = values.data();
+    std::vector<T> padded;
+    if (values.size() < variables_.size()){
+        padded = values;
+        padded.resize(variables_.size(), T(0));
+        v = padded.data();
+    }
+
+    if (!dense_.empty()){ return estrin(v[0]); }
+    return horner(0, terms_.size(), 0, v);
+}
+
+template <typename T>
+bool Polynomial<T>::is_constant() const { return variables_.empty(); }
+
+template <typename T>
+T Polynomial<T>::constant() const {
+    if (!terms_.empty() && terms_.front().first == std::vector<unsigned>(variables_.size(), 0)){
+        return terms_.front().second;
+    }
+    return T(0);
+}
+
+template <typename T>
+size_t Polynomial<T>::size() const { return terms_.size(); }
+
+// total degree
+template <typename T>
+unsigned Polynomial<T>::degree() const {
+    unsigned deg = 0;
+    for (const auto& [exponents, coefficient] : terms_){
+        unsigned sum = 0;
+        for (unsigned e : exponents){ sum += e; }
+        deg = std::max(deg, sum);
+    }
+    return deg;
+}
+
+template <typename T>
+const std::vector<std::string>& Polynomial<T>::variables() const { return variables_; }
+
+// same recursion as horner, building nodes instead of values
+template <typename T>
+std::shared_ptr<ExpressionNode<T>> Polynomial<T>::horner_tree(size_t begin, size_t end, size_t var,
+                                                              const std::vector<std::shared_ptr<ExpressionNode<T>>>& vars) const {
+    if (var == variables_.size()){ return std::make_shared<NumberNode<T>>(terms_[begin].second); }
+
+    auto power = [&](unsigned n) -> std::shared_ptr<ExpressionNode<T>> {
+        if (n == 1){ return vars[var]; }
+        return std::make_shared<PowNode<T>>(vars[var], std::make_shared<NumberNode<T>>(T(n)));
+    };
+    // node * var^n without multiplications by 1
+    auto scaled = [&](const std::shared_ptr<ExpressionNode<T>>& node, unsigned n) -> std::shared_ptr<ExpressionNode<T>> {
+        if (node->kind() == NodeKind::Number && static_cast<const NumberNode<T>*>(node.get())->value() == T(1)){
+            return power(n);
+        }
+        return std::make_shared<MultNode<T>>(node, power(n));
+    };
+
+    std::shared_ptr<ExpressionNode<T>> result;
+    unsigned previous = 0;
+    for (size_t group_end = end; group_end > begin;){
+        unsigned e = terms_[group_end - 1].first[var];
+        size_t group_begin = group_end - 1;
+        while (group_begin > begin && terms_[group_begin - 1].first[var] == e){ group_begin--; }
+
+        std::shared_ptr<ExpressionNode<T>> c = horner_tree(group_begin, group_end, var + 1, vars);
+        result = result ? std::make_shared<PlusNode<T>>(scaled(result, previous - e), c) : c;
+        previous = e;
+        group_end = group_begin;
+    }
+    return previous > 0 ? scaled(result, previous) : result;
+}
+
+template <typename T>
+std::shared_ptr<ExpressionNode<T>> Polynomial<T>::to_node() const {
+    if (terms_.empty()){ return std::make_shared<NumberNode<T>>(T(0)); }
+
+    std::vector<std::shared_ptr<ExpressionNode<T>>> vars;
+    for (const std::string& var : variables_){
+        vars.push_back(std::make_shared<VariableNode<T>>(var));
+    }
+    return horner_tree(0, terms_.size(), 0, vars);
+}
+
+template <typename T>
+std::string Polynomial<T>::to_string() const {
+    if (terms_.empty()){ return number_to_string(T(0)); }
+
+    std::string res;
+    for (size_t i = terms_.size(); i-- > 0;){
+        const auto& [exponents, coefficient] = terms_[i];
+        std::string term;
+        bool has_variables = false;
+        for (size_t k = 0; k < exponents.size(); k++){
+            if (exponents[k] == 0){ continue; }
+            term += (has_variables ? " * " : "") + variables_[k];
+            if (exponents[k] > 1){ term += " ^ " + std::to_string(exponents[k]); }
+            has_variables = true;
+        }
+        if (!has_variables){
+            term = number_to_string(coefficient);
+        } else if (coefficient != T(1)){
+            term = number_to_string(coefficient) + " * " + term;
+        }
+        res += (res.empty() ? "" : " + ") + term;
+    }
+    return terms_.size() > 1 ? "(" + res + ")" : res;
+}
+
+
+// POLYNOMIAL NODE
+template <typename T>
+PolynomialNode<T>::PolynomialNode(const Polynomial<T>& poly) : poly(poly), horner(poly.to_node()) {
+    this->dependencies_ = horner->dependencies();
+    BudgetScope::charge(sizeof(*this));
+}
+
+template <typename T>
+const Polynomial<T>& PolynomialNode<T>::polynomial() const { return poly; }
+
+template <typename T>
+const std::shared_ptr<ExpressionNode<T>>& PolynomialNode<T>::lowered() const { return horner; }
+
+template <typename T>
+std::shared_ptr<ExpressionNode<T>> PolynomialNode<T>::evaluate(std::vector<std::string> variables, std::vector<T> values) const {
+    Polynomial<T> res = poly.evaluate(variables, values);
+    if (res.is_constant()){ return std::make_shared<NumberNode<T>>(res.constant()); }
+    return std::make_shared<PolynomialNode<T>>(res);
+}
+
+// unevaluated variables are 0, like VariableNode<T>::resolve
+template <typename T>
+T PolynomialNode<T>::resolve() const { return poly.resolve({}); }
+
+template <typename T>
+std::shared_ptr<ExpressionNode<T>> PolynomialNode<T>::diff(const std::string &var) const {
+    if (!(this->dependencies_ & variable_mask(var))){ return std::make_shared<NumberNode<T>>(0); }
+    return std::make_shared<PolynomialNode<T>>(poly.diff(var));
+}
+
+template <typename T>
+std::string PolynomialNode<T>::to_string() const { return poly.to_string(); }
+
+template <typename T>
+NodeKind PolynomialNode<T>::kind() const { return NodeKind::Polynomial; }
+
+template <typename T>
+size_t PolynomialNode<T>::arity() const { return 0; }
+
+template <typename T>
+const std::shared_ptr<ExpressionNode<T>>& PolynomialNode<T>::operand(size_t i) const {
+    throw std::out_of_range("polynomial node has no operands");
+}
+
+
+/*POLYNOMIAL FORM*/
+
+namespace {
+
+// polynomial value of a node that is a polynomial, and the node with its polynomial operands wrapped
+template <typename T>
+struct PolynomialForm
+{
+    std::optional<Polynomial<T>> poly;
+    std::shared_ptr<ExpressionNode<T>> rebuilt;
+};
+
+} // namespace
+
+template <typename T>
+Expression<T> polynomial_form(const Expression<T>& expression){
+    // polynomial subtrees other than leaves become polynomial nodes
+    auto wrap = [](const std::shared_ptr<ExpressionNode<T>>& node, const PolynomialForm<T>& form) -> std::shared_ptr<ExpressionNode<T>> {
+        if (!form.poly || node->arity() == 0){ return form.rebuilt; }
+        if (form.poly->is_constant()){ return std::make_shared<NumberNode<T>>(form.poly->constant()); }
+        return std::make_shared<PolynomialNode<T>>(*form.poly);
+    };
+    std::unordered_map<const ExpressionNode<T>*, std::shared_ptr<ExpressionNode<T>>> wrapped;
+    auto wrapped_of = [&](const std::shared_ptr<ExpressionNode<T>>& node, const PolynomialForm<T>& form) -> std::shared_ptr<ExpressionNode<T>> {
+        auto found = wrapped.find(node.get());
+        if (found != wrapped.end()){ return found->second; }
+        return wrapped.emplace(node.get(), wrap(node, form)).first->second;
+    };
+
+    auto visit = [&](const std::shared_ptr<ExpressionNode<T>>& node, NodeResults<T, PolynomialForm<T>>& forms){
+        size_t arity = node->arity();
+        const std::optional<Polynomial<T>>* a = arity > 0 ? &forms[node->operand(0).get()].poly : nullptr;
+        const std::optional<Polynomial<T>>* b = arity > 1 ? &forms[node->operand(1).get()].poly : nullptr;
+        bool both = a && b && *a && *b;
+
+        std::optional<Polynomial<T>> poly;
+        unsigned n = 0;
+        switch (node->kind()){
+            case NodeKind::Number:
+                poly = Polynomial<T>(static_cast<const NumberNode<T>*>(node.get())->value());
+                break;
+            case NodeKind::Variable:
+                poly = Polynomial<T>::variable(static_cast<const VariableNode<T>*>(node.get())->get_name());
+                break;
+            case NodeKind::Polynomial:
+                poly = static_cast<const PolynomialNode<T>*>(node.get())->polynomial();
+                break;
+            case NodeKind::Plus:
+                if (both){ poly = **a + **b; }
+                break;
+            case NodeKind::Minus:
+                if (both){ poly = **a - **b; }
+                break;
+            case NodeKind::Mult:
+                if (both && (*a)->size() * (*b)->size() <= POLYNOMIAL_MAX_TERMS){ poly = **a * **b; }
+                break;
+            case NodeKind::Div:
+                // division by a constant, quotients of polynomials stay rational
+                if (both && (*b)->is_constant() && (*b)->constant() != T(0)){
+                    poly = **a * Polynomial<T>(T(1) / (*b)->constant());
+                }
+                break;
+            case NodeKind::Pow:
+                if (both && (*b)->is_constant() && natural_exponent((*b)->constant(), n)){
+                    // expanded step by step, so oversized powers are left alone
+                    Polynomial<T> res(T(1));
+                    bool fits = true;
+                    for (unsigned k = 0; k < n && fits; k++){
+                        fits = res.size() * (*a)->size() <= POLYNOMIAL_MAX_TERMS;
+                        if (fits){ res = res * **a; }
+                    }
+                    if (fits){ poly = res; }
+                }
+                break;
+            default:
+                break;
+        }
+        if (poly && poly->size() > POLYNOMIAL_MAX_TERMS){ poly.reset(); }
+
+        // operands that are polynomials are wrapped, unchanged subtrees are reused
+        std::shared_ptr<ExpressionNode<T>> res = node;
+        if (!poly && arity > 0){
+            std::shared_ptr<ExpressionNode<T>> l = wrapped_of(node->operand(0), forms[node->operand(0).get()]);
+            std::shared_ptr<ExpressionNode<T>> r = arity > 1 ? wrapped_of(node->operand(1), forms[node->operand(1).get()]) : nullptr;
+            if (l != node->operand(0) || (arity > 1 && r != node->operand(1))){
+                res = make_node<T>(node->kind(), l, r);
+            }
+        }
+        return PolynomialForm<T>{std::move(poly), std::move(res)};
+    };
+
+    // polynomial nodes already in the tree are leaves holding their polynomial
+    PolynomialForm<T> root = post_order<PolynomialForm<T>>(expression.root(), visit, false);
+    return Expression<T>(wrapped_of(expression.root(), root));
+}
+
+#define INSTANTIATE_POLYNOMIAL(T) \
+    template class Polynomial<T>; \
+    template class PolynomialNode<T>; \
+    template Expression<T> polynomial_form(const Expression<T>&);
+
+INSTANTIATE_POLYNOMIAL(float)
+INSTANTIATE_POLYNOMIAL(double)
+INSTANTIATE_POLYNOMIAL(long double)
+INSTANTIATE_POLYNOMIAL(std::complex<long double>)
+
+#undef INSTANTIATE_POLYNOMIAL
+
+} // namespace Expressions
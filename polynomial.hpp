@@ -0,0 +1,98 @@
+#ifndef HEADER_GUARD_POLYNOMIAL_HPP_INCLUDED
+#define HEADER_GUARD_POLYNOMIAL_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include "expression.hpp"
+
+namespace Expressions {
+
+// limits of the polynomial recognition, bigger expansions stay as they are
+constexpr size_t POLYNOMIAL_MAX_TERMS = 4096;
+constexpr unsigned POLYNOMIAL_MAX_POWER = 64;
+// univariate polynomials of at least this degree are evaluated with Estrin's scheme
+constexpr size_t ESTRIN_MIN_DEGREE = 8;
+
+// sparse multivariate polynomial in canonical form:
+// variables are sorted by name, terms are sorted by exponent vectors and have non-zero coefficients
+template <typename T>
+class Polynomial
+{
+private:
+    std::vector<std::string> variables_;
+    // exponent vector (one exponent per variable) and coefficient of every term
+    std::vector<std::pair<std::vector<unsigned>, T>> terms_;
+    // all coefficients of dense univariate polynomials, lowest degree first (empty otherwise)
+    std::vector<T> dense_;
+
+    Polynomial(std::vector<std::string> variables, const std::map<std::vector<unsigned>, T>& terms);
+    // terms of this polynomial over a superset of its variables
+    std::map<std::vector<unsigned>, T> terms_over(const std::vector<std::string>& variables) const;
+
+    T horner(size_t begin, size_t end, size_t var, const T* values) const;
+    T estrin(T x) const;
+    std::shared_ptr<ExpressionNode<T>> horner_tree(size_t begin, size_t end, size_t var,
+                                                   const std::vector<std::shared_ptr<ExpressionNode<T>>>& vars) const;
+public:
+    Polynomial(T constant = T(0));
+    static Polynomial<T> variable(const std::string& name);
+    ~Polynomial() = default;
+
+    Polynomial<T> operator + (const Polynomial<T>& other) const;
+    Polynomial<T> operator - (const Polynomial<T>& other) const;
+    Polynomial<T> operator * (const Polynomial<T>& other) const;
+    Polynomial<T> pow(unsigned n) const;
+
+    // derivative stays in coefficient form
+    Polynomial<T> diff(const std::string& var) const;
+    // substitutes given variable values, other variables stay
+    Polynomial<T> evaluate(const std::vector<std::string>& variables, const std::vector<T>& values) const;
+    // values are given in the order of variables(), missing values are 0
+    T resolve(const std::vector<T>& values) const;
+
+    bool is_constant() const;
+    T constant() const;
+    size_t size() const;
+    unsigned degree() const;
+    const std::vector<std::string>& variables() const;
+
+    // Horner form built from Plus, Mult and Pow nodes
+    std::shared_ptr<ExpressionNode<T>> to_node() const;
+    // sum of monomials, highest exponents first
+    std::string to_string() const;
+};
+
+// node holding a polynomial subtree in coefficient form
+template <typename T>
+class PolynomialNode : public ExpressionNode<T>{
+private:
+    Polynomial<T> poly;
+    // the same polynomial in Horner form built from ordinary nodes
+    std::shared_ptr<ExpressionNode<T>> horner;
+public:
+    explicit PolynomialNode(const Polynomial<T>& poly);
+    ~PolynomialNode() = default;
+    const Polynomial<T>& polynomial() const;
+    const std::shared_ptr<ExpressionNode<T>>& lowered() const;
+    virtual std::shared_ptr<ExpressionNode<T>> evaluate(std::vector<std::string> variables, std::vector<T> values) const override;
+    virtual T resolve() const override;
+    virtual std::shared_ptr<ExpressionNode<T>> diff(const std::string &var) const override;
+    virtual std::string to_string() const override;
+    virtual NodeKind kind() const override;
+    virtual size_t arity() const override;
+    virtual const std::shared_ptr<ExpressionNode<T>>& operand(size_t i) const override;
+};
+
+// replaces every maximal polynomial subtree (numbers and variables combined by +, -, *,
+// division by constants and constant natural powers) with a PolynomialNode
+// quotients of polynomials become DivNodes of two PolynomialNodes
+// the rewrite is exact algebra and assumes finite values: terms whose coefficients cancel are dropped,
+// so x - x and x * 0 become 0 where the tree gives NaN for infinite or NaN x; expanded products and
+// divisions turned into multiplications by the reciprocal may also differ in the last bits or overflow
+template <typename T>
+Expression<T> polynomial_form(const Expression<T>& expression);
+} // namespace Expressions
+
+#endif // HEADER_GUARD_POLYNOMIAL_HPP_INCLUDED
@@ -0,0 +1,227 @@
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include "profile.hpp"
+#include "polynomial.hpp"
+
+namespace Expressions {
+
+namespace {
+
+// subtree strings are cut to this length in reports and frames
+constexpr size_t LABEL_LENGTH = 60;
+
+std::string label(std::string text){
+    if (text.size() > LABEL_LENGTH){
+        text.resize(LABEL_LENGTH - 3);
+        text += "...";
+    }
+    return text;
+}
+
+} // namespace
+
+template <typename T>
+ExpressionProfiler<T>::ExpressionProfiler(const Expression<T>& expression){
+    // every node gets its id after its operands, polynomials are profiled as a whole
+    auto visit = [&](const std::shared_ptr<ExpressionNode<T>>& node, NodeResults<T, uint32_t>& ids){
+        ProfiledNode profiled;
+        profiled.node = node;
+        profiled.arity = static_cast<uint32_t>(node->arity());
+        for (uint32_t i = 0; i < profiled.arity; i++){ profiled.operands[i] = ids[node->operand(i).get()]; }
+        nodes_.push_back(std::move(profiled));
+        return static_cast<uint32_t>(nodes_.size() - 1);
+    };
+    post_order<uint32_t>(expression.root(), visit, false);
+
+    // parents come after their operands, so every node has its paths before passing them on
+    nodes_.back().paths = 1;
+    for (size_t i = nodes_.size(); i-- > 0;){
+        for (uint32_t k = 0; k < nodes_[i].arity; k++){ nodes_[nodes_[i].operands[k]].paths += nodes_[i].paths; }
+    }
+}
+
+template <typename T>
+T ExpressionProfiler<T>::eval_and_resolve(const std::vector<std::string>& variables, const std::vector<T>& values){
+    using Clock = std::chrono::steady_clock;
+    struct Frame
+    {
+        uint32_t id;
+        bool expanded;
+        Clock::time_point start;
+    };
+    // reused between calls, value and inclusive time of every finished operand
+    thread_local std::vector<Frame> stack;
+    thread_local std::vector<std::pair<T, int64_t>> results;
+    stack.clear();
+    results.clear();
+
+    // the tree evaluation visits shared subtrees once per parent, so does this traversal
+    stack.push_back({static_cast<uint32_t>(nodes_.size() - 1), false, {}});
+    while (!stack.empty()){
+        Frame frame = stack.back();
+        stack.pop_back();
+        ProfiledNode& profiled = nodes_[frame.id];
+        const ExpressionNode<T>* node = profiled.node.get();
+
+        if (!frame.expanded){
+            frame.start = Clock::now();
+            if (profiled.arity > 0){
+                stack.push_back({frame.id, true, frame.start});
+                for (uint32_t i = profiled.arity; i-- > 0;){
+                    stack.push_back({profiled.operands[i], false, {}});
+                }
+                continue;
+            }
+        }
+
+        T res = T(0);
+        int64_t operands_ns = 0;
+        switch (node->kind()){
+            case NodeKind::Number:
+                res = static_cast<const NumberNode<T>*>(node)->value();
+                break;
+            case NodeKind::Variable: {
+                // unset variables are 0, like in VariableNode<T>::resolve
+                auto found = std::find(variables.begin(), variables.end(), static_cast<const VariableNode<T>*>(node)->get_name());
+                res = found == variables.end() ? T(0) : values[found - variables.begin()];
+                break;
+            }
+            case NodeKind::Polynomial:
+                res = node->evaluate(variables, values)->resolve();
+                break;
+            default: {
+                T right = T(0);
+                if (profiled.arity > 1){
+                    right = results.back().first;
+                    operands_ns += results.back().second;
+                    results.pop_back();
+                }
+                T left = results.back().first;
+                operands_ns += results.back().second;
+                results.pop_back();
+
+                switch (node->kind()){
+                    case NodeKind::Plus:  res = left + right; break;
+                    case NodeKind::Minus: res = left - right; break;
+                    case NodeKind::Mult:  res = left * right; break;
+                    case NodeKind::Div:   res = left / right; break;
+                    case NodeKind::Pow:   res = std::pow(left, right); break;
+                    case NodeKind::Sin:   res = std::sin(left); break;
+                    case NodeKind::Cos:   res = std::cos(left); break;
+                    case NodeKind::Ln:    res = std::log(left); break;
+                    case NodeKind::Exp:   res = std::exp(left); break;
+                    default:
+                        throw std::invalid_argument("can't profile a node of this kind");
+                }
+            }
+        }
+
+        int64_t inclusive = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - frame.start).count();
+        profiled.calls++;
+        profiled.inclusive_ns += inclusive;
+        profiled.self_ns += std::max<int64_t>(0, inclusive - operands_ns);
+        results.push_back({res, inclusive});
+    }
+
+    runs_++;
+    return results.back().first;
+}
+
+template <typename T>
+size_t ExpressionProfiler<T>::runs() const { return runs_; }
+
+template <typename T>
+void ExpressionProfiler<T>::reset(){
+    runs_ = 0;
+    for (ProfiledNode& profiled : nodes_){
+        profiled.calls = 0;
+        profiled.self_ns = 0;
+        profiled.inclusive_ns = 0;
+    }
+}
+
+template <typename T>
+ProfileEntry ExpressionProfiler<T>::entry(size_t i) const {
+    ProfileEntry res;
+    res.expression = nodes_[i].node->to_string();
+    res.kind = nodes_[i].node->kind();
+    res.calls = nodes_[i].calls;
+    res.self_ns = static_cast<double>(nodes_[i].self_ns);
+    res.inclusive_ns = static_cast<double>(nodes_[i].inclusive_ns);
+    return res;
+}
+
+template <typename T>
+std::vector<ProfileEntry> ExpressionProfiler<T>::top(size_t count, bool inclusive) const {
+    std::vector<size_t> order(nodes_.size());
+    for (size_t i = 0; i < order.size(); i++){ order[i] = i; }
+    count = std::min(count, order.size());
+    std::partial_sort(order.begin(), order.begin() + count, order.end(), [&](size_t a, size_t b){
+        return inclusive ? nodes_[a].inclusive_ns > nodes_[b].inclusive_ns : nodes_[a].self_ns > nodes_[b].self_ns;
+    });
+
+    std::vector<ProfileEntry> res;
+    for (size_t i = 0; i < count; i++){ res.push_back(entry(order[i])); }
+    return res;
+}
+
+template <typename T>
+void ExpressionProfiler<T>::report(std::ostream& out, size_t count) const {
+    double runs = static_cast<double>(std::max<size_t>(runs_, 1));
+    double total = static_cast<double>(nodes_.back().inclusive_ns) / runs;
+    out << runs_ << " evaluations, " << total << " ns each\n"
+        << "  self %   self ns   incl ns  calls  subtree\n";
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(1);
+    for (const ProfileEntry& e : top(count)){
+        out << std::setw(8) << (total > 0 ? 100 * e.self_ns / runs / total : 0)
+            << std::setw(10) << e.self_ns / runs
+            << std::setw(10) << e.inclusive_ns / runs
+            << std::setw(7) << static_cast<double>(e.calls) / runs
+            << "  " << label(e.expression) << "\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+template <typename T>
+void ExpressionProfiler<T>::write_folded(std::ostream& out) const {
+    std::vector<std::string> labels;
+    for (const ProfiledNode& profiled : nodes_){ labels.push_back(label(profiled.node->to_string())); }
+
+    // depth-first over all paths from the root, path holds the frames of the current one
+    // a shared node's self time is split evenly over its paths, each of them evaluates it equally often
+    std::string path;
+    std::vector<std::pair<uint32_t, size_t>> stack{{static_cast<uint32_t>(nodes_.size() - 1), 0}};
+    while (!stack.empty()){
+        auto [id, prefix] = stack.back();
+        stack.pop_back();
+        const ProfiledNode& profiled = nodes_[id];
+
+        path.resize(prefix);
+        if (prefix > 0){ path += ';'; }
+        path += labels[id];
+        long long self = std::llround(static_cast<double>(profiled.self_ns) / profiled.paths);
+        if (self > 0){ out << path << ' ' << self << '\n'; }
+
+        for (uint32_t i = profiled.arity; i-- > 0;){
+            stack.push_back({profiled.operands[i], path.size()});
+        }
+    }
+}
+
+template class ExpressionProfiler<float>;
+template class ExpressionProfiler<double>;
+template class ExpressionProfiler<long double>;
+template class ExpressionProfiler<std::complex<long double>>;
+
+} // namespace Expressions
@@ -0,0 +1,73 @@
+#ifndef HEADER_GUARD_PROFILE_HPP_INCLUDED
+#define HEADER_GUARD_PROFILE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include "expression.hpp"
+
+namespace Expressions {
+
+// accumulated cost of one subtree over all profiled evaluations
+struct ProfileEntry
+{
+    std::string expression;     // to_string() of the subtree
+    NodeKind kind;
+    uint64_t calls = 0;
+    double self_ns = 0;         // time in the node itself, operands excluded
+    double inclusive_ns = 0;    // time in the node and its operands
+};
+
+// evaluates an expression the way eval_and_resolve() does, with the same results,
+// while timing every node and counting its calls
+// a subtree shared by several parents is one entry, it's evaluated once per path from the root
+// like in the tree evaluation; polynomials are timed as a whole
+// the clock is read twice per node visit, that overhead is part of the self time of cheap nodes
+// not synchronized, profile from one thread at a time
+template <typename T>
+class ExpressionProfiler
+{
+private:
+    struct ProfiledNode
+    {
+        std::shared_ptr<ExpressionNode<T>> node;
+        uint32_t arity = 0;
+        uint32_t operands[2] = {0, 0};
+        // number of paths from the root, the node is visited once per path and evaluation
+        double paths = 0;
+        uint64_t calls = 0;
+        int64_t self_ns = 0;
+        int64_t inclusive_ns = 0;
+    };
+
+    // unique nodes of the expression, operands before their parents, root last
+    std::vector<ProfiledNode> nodes_;
+    size_t runs_ = 0;
+
+    ProfileEntry entry(size_t i) const;
+
+public:
+    explicit ExpressionProfiler(const Expression<T>& expression);
+    ~ExpressionProfiler() = default;
+
+    // profiled evaluation, returns the same value as expression.eval_and_resolve(variables, values)
+    T eval_and_resolve(const std::vector<std::string>& variables, const std::vector<T>& values);
+
+    // number of profiled evaluations
+    size_t runs() const;
+    // clears the collected costs
+    void reset();
+
+    // count most expensive subtrees by self time, or by inclusive time
+    std::vector<ProfileEntry> top(size_t count, bool inclusive = false) const;
+    // table of the count most expensive subtrees by self time, costs per evaluation
+    void report(std::ostream& out, size_t count = 10) const;
+    // folded stacks for flame graph tools: one line per path from the root, frames separated by ';',
+    // followed by the self time of the last frame in ns
+    void write_folded(std::ostream& out) const;
+};
+} // namespace Expressions
+
+#endif // HEADER_GUARD_PROFILE_HPP_INCLUDED
@@ -0,0 +1,425 @@
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include "server.hpp"
+#include "parallel.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#define EXPRESSIONS_POSIX 1
+#endif
+
+namespace Expressions {
+
+#ifdef EXPRESSIONS_POSIX
+
+namespace {
+
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;   // a closed peer is an error, not SIGPIPE
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+// how often blocked server threads check whether the server is stopping, in ms
+constexpr int POLL_INTERVAL = 100;
+
+bool send_all(int fd, const void* data, size_t size){
+    const char* p = static_cast<const char*>(data);
+    while (size > 0){
+        ssize_t sent = ::send(fd, p, size, SEND_FLAGS);
+        if (sent < 0){
+            if (errno == EINTR){ continue; }
+            return false;
+        }
+        p += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+// false if the peer closed the connection, or running is given and became false
+bool receive_all(int fd, void* data, size_t size, const std::atomic<bool>* running = nullptr){
+    char* p = static_cast<char*>(data);
+    while (size > 0){
+        if (running){
+            pollfd ready{fd, POLLIN, 0};
+            int polled = ::poll(&ready, 1, POLL_INTERVAL);
+            if (!*running){ return false; }
+            if (polled == 0 || (polled < 0 && errno == EINTR)){ continue; }
+        }
+        ssize_t got = ::recv(fd, p, size, 0);
+        if (got < 0 && errno == EINTR){ continue; }
+        if (got <= 0){ return false; }
+        p += got;
+        size -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+bool reply(int fd, ResponseStatus status, uint32_t size, const void* payload, size_t bytes){
+    ResponseHeader response{static_cast<uint32_t>(status), size};
+    return send_all(fd, &response, sizeof(response)) && send_all(fd, payload, bytes);
+}
+
+bool reply_error(int fd, const std::string& message){
+    return reply(fd, ResponseStatus::Error, static_cast<uint32_t>(message.size()), message.data(), message.size());
+}
+
+sockaddr_un socket_address(const std::string& path){
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)){ throw std::invalid_argument("socket path is too long: " + path); }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+} // namespace
+
+#endif
+
+
+/*SERVER*/
+
+template <typename T>
+EvaluationServer<T>::EvaluationServer(const std::vector<Expression<T>>& expressions, ServerConfig config) : config_(std::move(config)) {
+    expressions_.reserve(expressions.size());
+    for (const Expression<T>& expression : expressions){
+        expressions_.push_back(FlatExpression<T>(expression).prepared(config_.allow_rewrites));
+    }
+}
+
+template <typename T>
+EvaluationServer<T>::~EvaluationServer(){ stop(); }
+
+template <typename T>
+void EvaluationServer<T>::start(){
+#ifdef EXPRESSIONS_POSIX
+    if (running_){ return; }
+    sockaddr_un address = socket_address(config_.socket_path);
+
+    listener_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener_ < 0){ throw std::runtime_error(std::string("can't create socket: ") + std::strerror(errno)); }
+    ::unlink(config_.socket_path.c_str());
+    if (::bind(listener_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(listener_, SOMAXCONN) < 0){
+        std::string error = std::strerror(errno);
+        ::close(listener_);
+        listener_ = -1;
+        throw std::runtime_error("can't listen on " + config_.socket_path + ": " + error);
+    }
+
+    running_ = true;
+    pool_stopping_ = false;
+    size_t threads = config_.threads ? config_.threads : default_threads();
+    for (size_t i = 1; i < threads; i++){ workers_.emplace_back(&EvaluationServer<T>::work, this); }
+    dispatcher_ = std::thread(&EvaluationServer<T>::dispatch_loop, this);
+    acceptor_ = std::thread(&EvaluationServer<T>::accept_loop, this);
+#else
+    throw std::runtime_error("the evaluation server needs a POSIX system");
+#endif
+}
+
+template <typename T>
+void EvaluationServer<T>::stop(){
+#ifdef EXPRESSIONS_POSIX
+    if (!running_.exchange(false)){ return; }
+    acceptor_.join();
+    {
+        // wakes the connections blocked in send() or recv(), they close once their job is done
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int fd : clients_){ ::shutdown(fd, SHUT_RDWR); }
+        queued_.notify_all();
+    }
+    // the dispatcher finishes the queued jobs and waits for the connections to close
+    dispatcher_.join();
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        pool_stopping_ = true;
+        chunk_queued_.notify_all();
+    }
+    for (std::thread& worker : workers_){ worker.join(); }
+    workers_.clear();
+    ::close(listener_);
+    listener_ = -1;
+    ::unlink(config_.socket_path.c_str());
+#endif
+}
+
+template <typename T>
+void EvaluationServer<T>::accept_loop(){
+#ifdef EXPRESSIONS_POSIX
+    while (running_){
+        pollfd ready{listener_, POLLIN, 0};
+        if (::poll(&ready, 1, POLL_INTERVAL) <= 0){ continue; }
+        int fd = ::accept(listener_, nullptr, nullptr);
+        if (fd < 0){ continue; }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_++;
+        clients_.push_back(fd);
+        std::thread(&EvaluationServer<T>::serve, this, fd).detach();
+    }
+#endif
+}
+
+template <typename T>
+void EvaluationServer<T>::serve(int fd){
+#ifdef EXPRESSIONS_POSIX
+    std::vector<T> values;
+    std::vector<T> out;
+
+    for (;;){
+        RequestHeader request;
+        if (!receive_all(fd, &request, sizeof(request), &running_)){ break; }
+
+        bool known = request.expression < expressions_.size();
+        RequestOp op = static_cast<RequestOp>(request.op);
+        bool sent = true;
+
+        if (op == RequestOp::Count){
+            sent = reply(fd, ResponseStatus::Ok, static_cast<uint32_t>(expressions_.size()), nullptr, 0);
+        } else if (op == RequestOp::Describe && !known){
+            sent = reply_error(fd, "unknown expression " + std::to_string(request.expression));
+        } else if (op == RequestOp::Describe){
+            std::string names;
+            for (const std::string& name : expressions_[request.expression].variables()){
+                names += (names.empty() ? "" : "\n") + name;
+            }
+            sent = reply(fd, ResponseStatus::Ok, static_cast<uint32_t>(names.size()), names.data(), names.size());
+        } else if (op == RequestOp::Evaluate){
+            uint64_t count = uint64_t(request.rows) * request.columns;
+            if (count > SERVER_MAX_VALUES){
+                // the payload can't be skipped safely, the connection is closed
+                reply_error(fd, "request has more than " + std::to_string(SERVER_MAX_VALUES) + " values");
+                break;
+            }
+            values.resize(count);
+            if (!receive_all(fd, values.data(), count * sizeof(T), &running_)){ break; }
+
+            if (!known){
+                sent = reply_error(fd, "unknown expression " + std::to_string(request.expression));
+            } else if (request.columns != expressions_[request.expression].variables().size()){
+                sent = reply_error(fd, "expression " + std::to_string(request.expression) + " has " +
+                                       std::to_string(expressions_[request.expression].variables().size()) + " variables");
+            } else {
+                out.resize(request.rows);
+                Job job{request.expression, request.rows, values.data(), out.data()};
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    queue_.push_back(&job);
+                    queued_rows_ += job.rows;
+                    queued_.notify_one();
+                    finished_.wait(lock, [&]{ return job.done; });
+                }
+                sent = reply(fd, ResponseStatus::Ok, request.rows, out.data(), out.size() * sizeof(T));
+            }
+        } else {
+            sent = reply_error(fd, "unknown request " + std::to_string(request.op));
+        }
+        if (!sent){ break; }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // closed under the lock, stop() must not shut down a reused descriptor
+    clients_.erase(std::find(clients_.begin(), clients_.end(), fd));
+    ::close(fd);
+    connections_--;
+    queued_.notify_all();
+#else
+    (void)fd;
+#endif
+}
+
+template <typename T>
+void EvaluationServer<T>::dispatch_loop(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;){
+        queued_.wait(lock, [&]{ return !queue_.empty() || (!running_ && connections_ == 0); });
+        if (queue_.empty()){ break; }
+
+        // give the other connections a moment to join the batch
+        queued_.wait_for(lock, config_.batch_delay, [&]{
+            return queued_rows_ >= config_.batch_rows || queue_.size() >= connections_ || !running_;
+        });
+
+        std::vector<Job*> batch(queue_.begin(), queue_.end());
+        queue_.clear();
+        queued_rows_ = 0;
+
+        lock.unlock();
+        evaluate(batch);
+        lock.lock();
+
+        for (Job* job : batch){ job->done = true; }
+        requests_ += batch.size();
+        batches_++;
+        finished_.notify_all();
+    }
+}
+
+template <typename T>
+void EvaluationServer<T>::work(){
+    std::unique_lock<std::mutex> lock(pool_mutex_);
+    for (;;){
+        chunk_queued_.wait(lock, [&]{ return pool_stopping_ || !chunks_.empty(); });
+        if (chunks_.empty()){ return; }
+
+        std::function<void()> chunk = std::move(chunks_.front());
+        chunks_.pop_front();
+        lock.unlock();
+        chunk();
+        lock.lock();
+
+        if (--unfinished_ == 0){ chunk_done_.notify_one(); }
+    }
+}
+
+template <typename T>
+void EvaluationServer<T>::evaluate(const std::vector<Job*>& batch){
+    // first row of every job in the batch
+    std::vector<size_t> offsets{0};
+    for (Job* job : batch){ offsets.push_back(offsets.back() + job->rows); }
+    size_t total = offsets.back();
+
+    size_t threads = std::max<size_t>(1, std::min(workers_.size() + 1, total / std::max<size_t>(1, config_.rows_per_thread)));
+
+    auto body = [&](size_t begin, size_t end){
+        std::vector<T> row;
+        size_t j = std::upper_bound(offsets.begin(), offsets.end(), begin) - offsets.begin() - 1;
+        for (size_t i = begin; i < end; i++){
+            while (i >= offsets[j + 1]){ j++; }
+            const Job& job = *batch[j];
+            const FlatExpression<T>& expression = expressions_[job.expression];
+            size_t columns = expression.variables().size();
+            size_t r = i - offsets[j];
+
+            row.assign(job.values + r * columns, job.values + (r + 1) * columns);
+            job.out[r] = expression.resolve(row);
+        }
+    };
+
+    size_t chunk = (total + threads - 1) / threads;
+    if (threads > 1){
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        for (size_t t = 1; t < threads; t++){
+            size_t begin = std::min(total, t * chunk);
+            size_t end = std::min(total, begin + chunk);
+            chunks_.push_back([&body, begin, end]{ body(begin, end); });
+        }
+        unfinished_ = threads - 1;
+        chunk_queued_.notify_all();
+    }
+    body(0, std::min(total, chunk));
+
+    std::unique_lock<std::mutex> lock(pool_mutex_);
+    chunk_done_.wait(lock, [&]{ return unfinished_ == 0; });
+}
+
+template <typename T>
+size_t EvaluationServer<T>::size() const { return expressions_.size(); }
+
+template <typename T>
+size_t EvaluationServer<T>::requests() const { return requests_; }
+
+template <typename T>
+size_t EvaluationServer<T>::batches() const { return batches_; }
+
+
+/*CLIENT*/
+
+template <typename T>
+EvaluationClient<T>::EvaluationClient(const std::string& socket_path){
+#ifdef EXPRESSIONS_POSIX
+    sockaddr_un address = socket_address(socket_path);
+    fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0){ throw std::runtime_error(std::string("can't create socket: ") + std::strerror(errno)); }
+    if (::connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0){
+        std::string error = std::strerror(errno);
+        ::close(fd_);
+        throw std::runtime_error("can't connect to " + socket_path + ": " + error);
+    }
+#else
+    (void)socket_path;
+    throw std::runtime_error("the evaluation client needs a POSIX system");
+#endif
+}
+
+template <typename T>
+EvaluationClient<T>::~EvaluationClient(){
+#ifdef EXPRESSIONS_POSIX
+    if (fd_ >= 0){ ::close(fd_); }
+#endif
+}
+
+template <typename T>
+ResponseHeader EvaluationClient<T>::call(const RequestHeader& request, const void* payload, size_t bytes){
+    ResponseHeader response{};
+#ifdef EXPRESSIONS_POSIX
+    if (!send_all(fd_, &request, sizeof(request)) || !send_all(fd_, payload, bytes) ||
+        !receive_all(fd_, &response, sizeof(response))){
+        throw std::runtime_error("connection to the evaluation server was lost");
+    }
+    if (response.status != static_cast<uint32_t>(ResponseStatus::Ok)){
+        throw std::runtime_error(text(response.size));
+    }
+#else
+    (void)request; (void)payload; (void)bytes;
+#endif
+    return response;
+}
+
+template <typename T>
+std::string EvaluationClient<T>::text(uint32_t size){
+    std::string result(size, '\0');
+#ifdef EXPRESSIONS_POSIX
+    if (!receive_all(fd_, result.data(), size)){ throw std::runtime_error("connection to the evaluation server was lost"); }
+#endif
+    return result;
+}
+
+template <typename T>
+size_t EvaluationClient<T>::count(){
+    return call(RequestHeader{static_cast<uint32_t>(RequestOp::Count), 0, 0, 0}, nullptr, 0).size;
+}
+
+template <typename T>
+std::vector<std::string> EvaluationClient<T>::variables(uint32_t expression){
+    std::string names = text(call(RequestHeader{static_cast<uint32_t>(RequestOp::Describe), expression, 0, 0}, nullptr, 0).size);
+
+    std::vector<std::string> result;
+    for (size_t begin = 0; begin < names.size();){
+        size_t end = std::min(names.find('\n', begin), names.size());
+        result.push_back(names.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return result;
+}
+
+template <typename T>
+void EvaluationClient<T>::evaluate(uint32_t expression, size_t rows, size_t columns, const T* values, T* out){
+    RequestHeader request{static_cast<uint32_t>(RequestOp::Evaluate), expression,
+                          static_cast<uint32_t>(rows), static_cast<uint32_t>(columns)};
+    ResponseHeader response = call(request, values, rows * columns * sizeof(T));
+#ifdef EXPRESSIONS_POSIX
+    if (response.size != rows || !receive_all(fd_, out, rows * sizeof(T))){
+        throw std::runtime_error("connection to the evaluation server was lost");
+    }
+#else
+    (void)response; (void)out;
+#endif
+}
+
+template class EvaluationServer<float>;
+template class EvaluationServer<double>;
+template class EvaluationServer<long double>;
+template class EvaluationClient<float>;
+template class EvaluationClient<double>;
+template class EvaluationClient<long double>;
+
+} // namespace Expressions
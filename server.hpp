@@ -0,0 +1,170 @@
+#ifndef HEADER_GUARD_SERVER_HPP_INCLUDED
+#define HEADER_GUARD_SERVER_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+#include "expression.hpp"
+#include "flat.hpp"
+
+namespace Expressions {
+
+// binary protocol of the evaluation server over a Unix domain socket
+// the socket is local, so everything is sent in native byte order and values as T
+//
+// request:  RequestHeader, then rows * columns values for Evaluate (row-major,
+//           columns in the order of the variables of the expression)
+// response: ResponseHeader, then size values for Evaluate, size bytes of text for Describe and errors
+
+enum class RequestOp : uint32_t
+{
+    Count = 1,      // number of loaded expressions, answered in size
+    Describe = 2,   // variables of the expression, separated by '\n'
+    Evaluate = 3,   // values of the expression for every row
+};
+
+enum class ResponseStatus : uint32_t
+{
+    Ok = 0,
+    Error = 1,      // followed by the error message
+};
+
+struct RequestHeader
+{
+    uint32_t op;
+    uint32_t expression;
+    uint32_t rows;
+    uint32_t columns;
+};
+
+struct ResponseHeader
+{
+    uint32_t status;
+    uint32_t size;
+};
+
+// largest number of values in one request
+constexpr uint32_t SERVER_MAX_VALUES = 1u << 24;
+
+struct ServerConfig
+{
+    std::string socket_path;
+    // evaluation threads, 0 = all cores
+    size_t threads = 0;
+    // a batch is evaluated once it has this many rows ...
+    size_t batch_rows = 4096;
+    // ... or once its first request waited this long
+    std::chrono::microseconds batch_delay{100};
+    // batches smaller than this per thread are evaluated on fewer threads
+    size_t rows_per_thread = 256;
+    // also strength reduce the expressions (see FlatExpression<T>::optimize()), results may then differ
+    // in the last bits and where the expression is undefined; without, they are those of the tree
+    bool allow_rewrites = false;
+};
+
+// evaluation daemon: holds the flat form of every expression once,
+// serves every connection on its own thread and coalesces concurrent requests into batches
+// evaluated by a single dispatcher thread, split over a pool of evaluation threads
+// a batch is dispatched without waiting when every open connection has a request in it
+// POSIX only, start() throws std::runtime_error elsewhere
+template <typename T>
+class EvaluationServer
+{
+private:
+    // one request waiting for its batch
+    struct Job
+    {
+        uint32_t expression;
+        size_t rows;
+        const T* values;
+        T* out;
+        bool done = false;
+    };
+
+    std::vector<FlatExpression<T>> expressions_;
+    ServerConfig config_;
+
+    int listener_ = -1;
+    std::atomic<bool> running_{false};
+    std::thread acceptor_;
+    std::thread dispatcher_;
+
+    std::mutex mutex_;
+    std::condition_variable queued_;    // signals the dispatcher
+    std::condition_variable finished_;  // signals the connections
+    std::deque<Job*> queue_;
+    size_t queued_rows_ = 0;
+    // open connections, every one has at most one queued job
+    size_t connections_ = 0;
+    // their sockets, shut down by stop()
+    std::vector<int> clients_;
+
+    // evaluation pool, started by start() and joined by stop()
+    // the dispatcher evaluates the first chunk of a batch and queues the others
+    std::vector<std::thread> workers_;
+    std::mutex pool_mutex_;
+    std::condition_variable chunk_queued_;  // signals the workers
+    std::condition_variable chunk_done_;    // signals the dispatcher
+    std::deque<std::function<void()>> chunks_;
+    size_t unfinished_ = 0;
+    bool pool_stopping_ = false;
+
+    std::atomic<size_t> requests_{0};
+    std::atomic<size_t> batches_{0};
+
+    void accept_loop();
+    void dispatch_loop();
+    void serve(int fd);
+    void work();
+    void evaluate(const std::vector<Job*>& batch);
+
+public:
+    EvaluationServer(const std::vector<Expression<T>>& expressions, ServerConfig config);
+    EvaluationServer(const EvaluationServer&) = delete;
+    EvaluationServer& operator = (const EvaluationServer&) = delete;
+    ~EvaluationServer();
+
+    // binds the socket (replacing a stale socket file) and starts serving in the background
+    void start();
+    // closes the socket and joins all threads, open connections are shut down once their queued job is done
+    void stop();
+
+    size_t size() const;
+    // evaluated requests and the batches they were coalesced into
+    size_t requests() const;
+    size_t batches() const;
+};
+
+// blocking client of one connection, not synchronized: use one client per thread
+// server errors are thrown as std::runtime_error
+template <typename T>
+class EvaluationClient
+{
+private:
+    int fd_ = -1;
+
+    ResponseHeader call(const RequestHeader& request, const void* payload, size_t bytes);
+    std::string text(uint32_t size);
+
+public:
+    explicit EvaluationClient(const std::string& socket_path);
+    EvaluationClient(const EvaluationClient&) = delete;
+    EvaluationClient& operator = (const EvaluationClient&) = delete;
+    ~EvaluationClient();
+
+    size_t count();
+    std::vector<std::string> variables(uint32_t expression);
+    // values holds rows * columns values, row-major, columns in the order of variables(expression)
+    // out receives rows values
+    void evaluate(uint32_t expression, size_t rows, size_t columns, const T* values, T* out);
+};
+} // namespace Expressions
+
+#endif // HEADER_GUARD_SERVER_HPP_INCLUDED
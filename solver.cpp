@@ -0,0 +1,152 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "solver.hpp"
+#include "parallel.hpp"
+
+namespace Expressions {
+
+namespace {
+
+// slot of a variable in a flat expression, variables().size() if it is absent
+template <typename T>
+uint32_t slot_of(const FlatExpression<T>& expr, const std::string& name){
+    const std::vector<std::string>& vars = expr.variables();
+    return static_cast<uint32_t>(std::find(vars.begin(), vars.end(), name) - vars.begin());
+}
+
+template <typename T>
+void bind(std::vector<T>& values, uint32_t slot, T value){
+    if (slot < values.size()){ values[slot] = value; }
+}
+
+} // namespace
+
+template <typename T>
+NewtonSolver<T>::NewtonSolver(const Expression<T>& f, const std::string& var, const std::vector<std::string>& parameters,
+                              bool allow_rewrites) :
+f_(FlatExpression<T>(f).prepared(allow_rewrites)), df_(f_.diff(var).prepared(allow_rewrites)), parameters_(parameters), f_var_(0), df_var_(0), f_params_(), df_params_() {
+    f_var_ = slot_of(f_, var);
+    df_var_ = slot_of(df_, var);
+    for (const std::string& param : parameters){
+        f_params_.push_back(slot_of(f_, param));
+        df_params_.push_back(slot_of(df_, param));
+    }
+}
+
+// safeguarded Newton iteration for one problem, parameters are already bound in f_values and df_values
+template <typename T>
+NewtonResult<T> NewtonSolver<T>::solve_row(T start, bool bracketed, T lower, T upper,
+                                           std::vector<T>& f_values, std::vector<T>& df_values,
+                                           const NewtonOptions<T>& options) const {
+    auto f = [&](T x){
+        bind(f_values, f_var_, x);
+        return f_.resolve(f_values);
+    };
+
+    T f_lower = 0;
+    if (bracketed){
+        if (lower > upper){ std::swap(lower, upper); }
+        f_lower = f(lower);
+        T f_upper = f(upper);
+        if (f_lower == 0){ return NewtonResult<T>{lower, f_lower, 0, SolveStatus::Converged}; }
+        if (f_upper == 0){ return NewtonResult<T>{upper, f_upper, 0, SolveStatus::Converged}; }
+        // no sign change, plain Newton from the starting point
+        bracketed = std::signbit(f_lower) != std::signbit(f_upper);
+        if (bracketed && !(lower < start && start < upper)){ start = lower + (upper - lower) / 2; }
+    }
+
+    T x = start;
+    for (size_t it = 1; it <= options.max_iterations; it++){
+        T fx = f(x);
+        if (fx == 0){ return NewtonResult<T>{x, fx, it, SolveStatus::Converged}; }
+
+        bind(df_values, df_var_, x);
+        T dfx = df_.resolve(df_values);
+
+        if (bracketed){
+            // shrink the bracket around the sign change
+            if (std::signbit(fx) == std::signbit(f_lower)){
+                lower = x;
+                f_lower = fx;
+            } else {
+                upper = x;
+            }
+        }
+
+        T next = x - fx / dfx;
+        if (bracketed && !(lower < next && next < upper)){
+            // Newton step left the bracket or is not finite: bisect
+            next = lower + (upper - lower) / 2;
+        } else if (!std::isfinite(next)){
+            return NewtonResult<T>{x, fx, it, SolveStatus::Failed};
+        }
+
+        T step = next - x;
+        x = next;
+        if (std::abs(step) <= options.tolerance * (1 + std::abs(x)) ||
+            (bracketed && upper - lower <= options.tolerance * (1 + std::abs(x)))){
+            return NewtonResult<T>{x, f(x), it, SolveStatus::Converged};
+        }
+    }
+
+    return NewtonResult<T>{x, f(x), options.max_iterations, SolveStatus::MaxIterations};
+}
+
+template <typename T>
+std::vector<NewtonResult<T>> NewtonSolver<T>::solve_rows(const std::vector<T>& starts,
+                                                         const std::vector<T>* lowers,
+                                                         const std::vector<T>* uppers,
+                                                         const std::vector<T>& parameter_rows,
+                                                         const NewtonOptions<T>& options) const {
+    size_t rows = starts.size();
+    size_t width = f_params_.size();
+    if (parameter_rows.size() < rows * width){
+        throw std::invalid_argument("Expected " + std::to_string(width) + " parameter values per row");
+    }
+    if (lowers && (lowers->size() < rows || uppers->size() < rows)){
+        throw std::invalid_argument("Expected a bracket for every row");
+    }
+
+    std::vector<NewtonResult<T>> results(rows);
+    parallel_for(rows, [&](size_t begin, size_t end){
+        std::vector<T> f_values(f_.variables().size(), T(0));
+        std::vector<T> df_values(df_.variables().size(), T(0));
+
+        for (size_t row = begin; row < end; row++){
+            for (size_t p = 0; p < width; p++){
+                bind(f_values, f_params_[p], parameter_rows[row * width + p]);
+                bind(df_values, df_params_[p], parameter_rows[row * width + p]);
+            }
+            results[row] = lowers ? solve_row(starts[row], true, (*lowers)[row], (*uppers)[row], f_values, df_values, options)
+                                  : solve_row(starts[row], false, T(0), T(0), f_values, df_values, options);
+        }
+    }, options.threads);
+
+    return results;
+}
+
+template <typename T>
+std::vector<NewtonResult<T>> NewtonSolver<T>::solve(const std::vector<T>& starts,
+                                                    const std::vector<T>& parameter_rows,
+                                                    const NewtonOptions<T>& options) const {
+    return solve_rows(starts, nullptr, nullptr, parameter_rows, options);
+}
+
+template <typename T>
+std::vector<NewtonResult<T>> NewtonSolver<T>::solve(const std::vector<T>& starts,
+                                                    const std::vector<T>& lowers,
+                                                    const std::vector<T>& uppers,
+                                                    const std::vector<T>& parameter_rows,
+                                                    const NewtonOptions<T>& options) const {
+    return solve_rows(starts, &lowers, &uppers, parameter_rows, options);
+}
+
+template <typename T>
+const std::vector<std::string>& NewtonSolver<T>::parameters() const { return parameters_; }
+
+template class NewtonSolver<float>;
+template class NewtonSolver<double>;
+template class NewtonSolver<long double>;
+
+} // namespace Expressions
@@ -0,0 +1,79 @@
+#ifndef HEADER_GUARD_SOLVER_HPP_INCLUDED
+#define HEADER_GUARD_SOLVER_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include "expression.hpp"
+#include "flat.hpp"
+
+namespace Expressions {
+
+enum class SolveStatus
+{
+    Converged,      // step or residual below tolerance
+    MaxIterations,  // iteration limit reached
+    Failed,         // zero or non-finite derivative without a bracket to fall back to
+};
+
+template <typename T>
+struct NewtonOptions
+{
+    T tolerance = T(1e-12);     // relative step size treated as converged
+    size_t max_iterations = 50;
+    size_t threads = 0;         // 0 = all cores
+};
+
+template <typename T>
+struct NewtonResult
+{
+    T root;
+    T residual;                 // f(root)
+    size_t iterations;
+    SolveStatus status;
+};
+
+// solves f(var) = 0 for batches of independent problems
+// f and f' are flattened once, every row only binds new values
+// f and f' are evaluated like the tree unless allow_rewrites also strength reduces them, see FlatExpression<T>::optimize()
+template <typename T>
+class NewtonSolver
+{
+private:
+    FlatExpression<T> f_;
+    FlatExpression<T> df_;
+    std::vector<std::string> parameters_;
+    // slots of var and of every parameter in f_ and df_, variables() size if absent
+    uint32_t f_var_;
+    uint32_t df_var_;
+    std::vector<uint32_t> f_params_;
+    std::vector<uint32_t> df_params_;
+
+    NewtonResult<T> solve_row(T start, bool bracketed, T lower, T upper,
+                              std::vector<T>& f_values, std::vector<T>& df_values,
+                              const NewtonOptions<T>& options) const;
+    std::vector<NewtonResult<T>> solve_rows(const std::vector<T>& starts,
+                                            const std::vector<T>* lowers,
+                                            const std::vector<T>* uppers,
+                                            const std::vector<T>& parameter_rows,
+                                            const NewtonOptions<T>& options) const;
+public:
+    NewtonSolver(const Expression<T>& f, const std::string& var, const std::vector<std::string>& parameters = {},
+                 bool allow_rewrites = false);
+    ~NewtonSolver() = default;
+
+    // one problem per starting point, parameter_rows holds parameters().size() values per problem
+    std::vector<NewtonResult<T>> solve(const std::vector<T>& starts,
+                                       const std::vector<T>& parameter_rows,
+                                       const NewtonOptions<T>& options = {}) const;
+    // brackets [lowers[i], uppers[i]] with a sign change of f: steps leaving the bracket become bisection steps
+    std::vector<NewtonResult<T>> solve(const std::vector<T>& starts,
+                                       const std::vector<T>& lowers,
+                                       const std::vector<T>& uppers,
+                                       const std::vector<T>& parameter_rows,
+                                       const NewtonOptions<T>& options = {}) const;
+
+    const std::vector<std::string>& parameters() const;
+};
+} // namespace Expressions
+
+#endif // HEADER_GUARD_SOLVER_HPP_INCLUDED
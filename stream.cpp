@@ -0,0 +1,253 @@
+#include <string>
+#include <vector>
+#include <complex>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include "stream.hpp"
+#include "parser.hpp"
+#include "parallel.hpp"
+#include "budget.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define EXPRESSIONS_POSIX 1
+#endif
+
+namespace Expressions {
+
+namespace {
+
+bool is_separator(char c){ return c == ';' || c == '\n'; }
+
+// parses one statement, blank ones are skipped
+template <typename T>
+void parse_statement(std::string_view statement, size_t& count, const ExpressionCallback<T>& callback){
+    if (statement.find_first_not_of(" \t\r") == std::string_view::npos){ return; }
+
+    Expression<T> expr(T(0));
+    try {
+        Lexer lexer(statement);
+        Parser<T> parser(lexer);
+        expr = parser.parseExpression();
+    } catch (const BudgetExceeded& error) {
+        // callers tell exhausted budgets from parse errors by the type
+        throw BudgetExceeded("statement " + std::to_string(count) + ": " + error.what());
+    } catch (const std::runtime_error& error) {
+        throw std::runtime_error("statement " + std::to_string(count) + ": " + error.what());
+    }
+    callback(count++, std::move(expr));
+}
+
+// splits the data delivered by read(buffer, size) into statements
+// the unfinished statement is moved to the front of the buffer before the next read
+template <typename T>
+size_t parse_chunks(const std::function<size_t(char*, size_t)>& read, const ExpressionCallback<T>& callback){
+    std::vector<char> buffer(STREAM_CHUNK);
+    size_t begin = 0;   // start of the unfinished statement
+    size_t scanned = 0; // end of the bytes searched for separators
+    size_t filled = 0;  // end of the read bytes
+    size_t count = 0;
+
+    for (;;){
+        for (; scanned < filled; scanned++){
+            if (!is_separator(buffer[scanned])){ continue; }
+            parse_statement<T>(std::string_view(buffer.data() + begin, scanned - begin), count, callback);
+            begin = scanned + 1;
+        }
+
+        if (begin > 0){
+            std::memmove(buffer.data(), buffer.data() + begin, filled - begin);
+            filled -= begin;
+            scanned -= begin;
+            begin = 0;
+        }
+        // a statement longer than the buffer
+        if (filled + STREAM_CHUNK > buffer.size()){ buffer.resize(filled + STREAM_CHUNK); }
+
+        size_t got = read(buffer.data() + filled, buffer.size() - filled);
+        if (got == 0){ break; }
+        filled += got;
+    }
+
+    parse_statement<T>(std::string_view(buffer.data(), filled), count, callback);
+    return count;
+}
+
+} // namespace
+
+template <typename T>
+size_t parse_statements(std::string_view text, const ExpressionCallback<T>& callback){
+    size_t count = 0;
+    size_t begin = 0;
+    for (size_t i = 0; i < text.size(); i++){
+        if (!is_separator(text[i])){ continue; }
+        parse_statement<T>(text.substr(begin, i - begin), count, callback);
+        begin = i + 1;
+    }
+    parse_statement<T>(text.substr(begin), count, callback);
+    return count;
+}
+
+template <typename T>
+size_t parse_stream(std::istream& in, const ExpressionCallback<T>& callback){
+    return parse_chunks<T>([&](char* data, size_t size) -> size_t {
+        in.read(data, static_cast<std::streamsize>(size));
+        if (in.bad()){ throw std::runtime_error("error reading the expression stream"); }
+        return static_cast<size_t>(in.gcount());
+    }, callback);
+}
+
+template <typename T>
+size_t parse_fd(int fd, const ExpressionCallback<T>& callback){
+#ifdef EXPRESSIONS_POSIX
+    return parse_chunks<T>([&](char* data, size_t size) -> size_t {
+        for (;;){
+            ssize_t got = ::read(fd, data, size);
+            if (got >= 0){ return static_cast<size_t>(got); }
+            if (errno != EINTR){ throw std::runtime_error(std::string("error reading file descriptor: ") + std::strerror(errno)); }
+        }
+    }, callback);
+#else
+    throw std::runtime_error("parse_fd needs a POSIX system");
+#endif
+}
+
+namespace {
+
+// contents of a file, memory-mapped where mmap is available
+class FileContents
+{
+private:
+    std::string_view view_;
+    void* mapped_ = nullptr;
+    std::string copy_;
+public:
+    explicit FileContents(const std::string& path){
+#ifdef EXPRESSIONS_POSIX
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0){ throw std::runtime_error("can't open " + path + ": " + std::strerror(errno)); }
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0){
+            size_t size = static_cast<size_t>(info.st_size);
+            void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED){ throw std::runtime_error("can't map " + path + ": " + std::strerror(errno)); }
+            ::madvise(data, size, MADV_SEQUENTIAL);
+            mapped_ = data;
+            view_ = std::string_view(static_cast<const char*>(data), size);
+            return;
+        }
+        ::close(fd);
+#endif
+        std::ifstream in(path, std::ios::binary);
+        if (!in){ throw std::runtime_error("can't open " + path); }
+        copy_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        view_ = copy_;
+    }
+
+    FileContents(const FileContents&) = delete;
+    FileContents& operator = (const FileContents&) = delete;
+
+    ~FileContents(){
+#ifdef EXPRESSIONS_POSIX
+        if (mapped_){ ::munmap(mapped_, view_.size()); }
+#endif
+    }
+
+    std::string_view view() const { return view_; }
+};
+
+} // namespace
+
+template <typename T>
+size_t parse_file(const std::string& path, const ExpressionCallback<T>& callback){
+#ifdef EXPRESSIONS_POSIX
+    // pipes and other special files are streamed instead of being read whole
+    struct stat info;
+    if (::stat(path.c_str(), &info) == 0 && !S_ISREG(info.st_mode)){
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0){ throw std::runtime_error("can't open " + path + ": " + std::strerror(errno)); }
+        try {
+            size_t count = parse_fd<T>(fd, callback);
+            ::close(fd);
+            return count;
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+    }
+    FileContents contents(path);
+    return parse_statements<T>(contents.view(), callback);
+#else
+    std::ifstream in(path, std::ios::binary);
+    if (!in){ throw std::runtime_error("can't open " + path); }
+    return parse_stream<T>(in, callback);
+#endif
+}
+
+
+/*PARALLEL PARSING*/
+
+template <typename T>
+bool ParseResult<T>::ok() const { return expression.has_value(); }
+
+template <typename T>
+std::vector<ParseResult<T>> parse_many(std::span<const std::string_view> formulas, size_t threads){
+    std::vector<ParseResult<T>> results(formulas.size());
+
+    // every worker allocates the nodes of its own formulas and writes only its own results
+    parallel_for(formulas.size(), [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            try {
+                Lexer lexer(formulas[i]);
+                Parser<T> parser(lexer);
+                results[i].expression = parser.parseExpression();
+            } catch (const std::exception& error) {
+                results[i].error = error.what();
+            }
+        }
+    }, threads);
+
+    return results;
+}
+
+template <typename T>
+std::vector<ParseResult<T>> parse_many_file(const std::string& path, size_t threads){
+    FileContents contents(path);
+    std::string_view text = contents.view();
+
+    std::vector<std::string_view> statements;
+    size_t begin = 0;
+    for (size_t i = 0; i <= text.size(); i++){
+        if (i < text.size() && !is_separator(text[i])){ continue; }
+        std::string_view statement = text.substr(begin, i - begin);
+        if (statement.find_first_not_of(" \t\r") != std::string_view::npos){ statements.push_back(statement); }
+        begin = i + 1;
+    }
+
+    return parse_many<T>(statements, threads);
+}
+
+#define INSTANTIATE_STREAM(T) \
+    template size_t parse_statements(std::string_view, const ExpressionCallback<T>&); \
+    template size_t parse_stream(std::istream&, const ExpressionCallback<T>&); \
+    template size_t parse_fd(int, const ExpressionCallback<T>&); \
+    template size_t parse_file(const std::string&, const ExpressionCallback<T>&); \
+    template struct ParseResult<T>; \
+    template std::vector<ParseResult<T>> parse_many(std::span<const std::string_view>, size_t); \
+    template std::vector<ParseResult<T>> parse_many_file(const std::string&, size_t);
+
+INSTANTIATE_STREAM(float)
+INSTANTIATE_STREAM(double)
+INSTANTIATE_STREAM(long double)
+INSTANTIATE_STREAM(std::complex<long double>)
+
+#undef INSTANTIATE_STREAM
+
+} // namespace Expressions
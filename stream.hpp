@@ -0,0 +1,63 @@
+#ifndef HEADER_GUARD_STREAM_HPP_INCLUDED
+#define HEADER_GUARD_STREAM_HPP_INCLUDED
+
+#include <string>
+#include <string_view>
+#include <istream>
+#include <functional>
+#include <optional>
+#include <span>
+#include <vector>
+#include "expression.hpp"
+
+namespace Expressions {
+
+// bytes read at once by the streaming parsers
+constexpr size_t STREAM_CHUNK = 1 << 16;
+
+// receives every parsed expression with its index, in input order
+template <typename T>
+using ExpressionCallback = std::function<void(size_t index, Expression<T> expression)>;
+
+// parse a sequence of expressions separated by ';' or newlines, empty statements are skipped
+// only the statement being parsed is kept in memory, so memory stays proportional to the largest expression
+// parse errors are rethrown as std::runtime_error naming the statement, BudgetExceeded keeps its type
+// all of them return the number of parsed expressions
+
+// parses text in place, without copying it
+template <typename T>
+size_t parse_statements(std::string_view text, const ExpressionCallback<T>& callback);
+
+// reads the stream in chunks of STREAM_CHUNK bytes
+template <typename T>
+size_t parse_stream(std::istream& in, const ExpressionCallback<T>& callback);
+
+// reads a file descriptor (e.g. 0 for stdin or a pipe) in chunks, POSIX only
+template <typename T>
+size_t parse_fd(int fd, const ExpressionCallback<T>& callback);
+
+// memory-maps the file and parses it in place where mmap is available, streams it otherwise
+template <typename T>
+size_t parse_file(const std::string& path, const ExpressionCallback<T>& callback);
+
+// outcome of parsing one formula: the expression, or the error message if it failed
+template <typename T>
+struct ParseResult
+{
+    std::optional<Expression<T>> expression;
+    std::string error;
+
+    bool ok() const;
+};
+
+// parses independent formulas on threads worker threads (0 = all cores)
+// results are in the order of the formulas, a bad formula doesn't stop the others
+template <typename T>
+std::vector<ParseResult<T>> parse_many(std::span<const std::string_view> formulas, size_t threads = 0);
+
+// same for the statements of a file, split like parse_file does, the file is memory-mapped where possible
+template <typename T>
+std::vector<ParseResult<T>> parse_many_file(const std::string& path, size_t threads = 0);
+} // namespace Expressions
+
+#endif // HEADER_GUARD_STREAM_HPP_INCLUDED
@@ -0,0 +1,226 @@
+#include <cmath>
+#include <algorithm>
+#include "taylor.hpp"
+
+namespace Expressions {
+
+namespace {
+
+// truncated series operations, all series have n coefficients
+
+// c = a * b
+template <typename T>
+void series_mult(const T* a, const T* b, T* c, size_t n){
+    for (size_t k = 0; k < n; k++){
+        T sum = 0;
+        for (size_t j = 0; j <= k; j++){ sum += a[j] * b[k - j]; }
+        c[k] = sum;
+    }
+}
+
+// c = a / b, from a = b * c
+template <typename T>
+void series_div(const T* a, const T* b, T* c, size_t n){
+    for (size_t k = 0; k < n; k++){
+        T sum = a[k];
+        for (size_t j = 1; j <= k; j++){ sum -= b[j] * c[k - j]; }
+        c[k] = sum / b[0];
+    }
+}
+
+// c = exp(a), from c' = a' c
+template <typename T>
+void series_exp(const T* a, T* c, size_t n){
+    c[0] = std::exp(a[0]);
+    for (size_t k = 1; k < n; k++){
+        T sum = 0;
+        for (size_t j = 1; j <= k; j++){ sum += T(j) * a[j] * c[k - j]; }
+        c[k] = sum / T(k);
+    }
+}
+
+// c = ln(a), from a c' = a'
+template <typename T>
+void series_ln(const T* a, T* c, size_t n){
+    c[0] = std::log(a[0]);
+    for (size_t k = 1; k < n; k++){
+        T sum = 0;
+        for (size_t j = 1; j < k; j++){ sum += T(j) * c[j] * a[k - j]; }
+        c[k] = (a[k] - sum / T(k)) / a[0];
+    }
+}
+
+// s = sin(a), co = cos(a), from s' = a' co and co' = -a' s
+template <typename T>
+void series_sincos(const T* a, T* s, T* co, size_t n){
+    s[0] = std::sin(a[0]);
+    co[0] = std::cos(a[0]);
+    for (size_t k = 1; k < n; k++){
+        T sum_s = 0;
+        T sum_c = 0;
+        for (size_t j = 1; j <= k; j++){
+            sum_s += T(j) * a[j] * co[k - j];
+            sum_c += T(j) * a[j] * s[k - j];
+        }
+        s[k] = sum_s / T(k);
+        co[k] = -sum_c / T(k);
+    }
+}
+
+// c = a ^ p for a constant p, from a c' = p a' c
+template <typename T>
+void series_pow_const(const T* a, T p, T* c, size_t n){
+    c[0] = std::pow(a[0], p);
+    for (size_t k = 1; k < n; k++){
+        T sum = 0;
+        for (size_t j = 1; j <= k; j++){ sum += (p * T(j) - T(k - j)) * a[j] * c[k - j]; }
+        c[k] = sum / (T(k) * a[0]);
+    }
+}
+
+// c = a ^ p for a natural p by repeated squaring, works for a[0] = 0 too
+template <typename T>
+void series_pow_natural(const T* a, unsigned long long p, T* c, size_t n){
+    std::vector<T> base(a, a + n);
+    std::vector<T> tmp(n);
+    std::fill(c, c + n, T(0));
+    c[0] = 1;
+    while (p > 0){
+        if (p & 1){
+            series_mult(c, base.data(), tmp.data(), n);
+            std::copy(tmp.begin(), tmp.end(), c);
+        }
+        p >>= 1;
+        if (p > 0){
+            series_mult(base.data(), base.data(), tmp.data(), n);
+            base.swap(tmp);
+        }
+    }
+}
+
+} // namespace
+
+
+template <typename T>
+TaylorEvaluator<T>::TaylorEvaluator(const Expression<T>& expression, const std::string& var) : expr_(expression), slot_(0) {
+    const std::vector<std::string>& vars = expr_.variables();
+    slot_ = static_cast<uint32_t>(std::find(vars.begin(), vars.end(), var) - vars.begin());
+}
+
+template <typename T>
+std::vector<T> TaylorEvaluator<T>::coefficients(T point, size_t order, const std::vector<T>& values) const {
+    const std::vector<FlatNode<T>>& nodes = expr_.nodes();
+    const size_t n = order + 1;
+
+    // series of node i are c[i * n], ..., c[i * n + order]
+    std::vector<T> c(nodes.size() * n, T(0));
+    std::vector<T> tmp(2 * n);
+
+    for (size_t i = 0; i < nodes.size(); i++){
+        const FlatNode<T>& node = nodes[i];
+        T* res = &c[i * n];
+        const T* a = &c[node.left * n];
+        const T* b = &c[node.right * n];
+
+        switch (node.kind){
+            case NodeKind::Number:
+                res[0] = node.value;
+                break;
+            case NodeKind::Variable:
+                if (node.left == slot_){
+                    res[0] = point;
+                    if (n > 1){ res[1] = 1; }
+                } else {
+                    res[0] = node.left < values.size() ? values[node.left] : T(0);
+                }
+                break;
+            case NodeKind::Plus:
+                for (size_t k = 0; k < n; k++){ res[k] = a[k] + b[k]; }
+                break;
+            case NodeKind::Minus:
+                for (size_t k = 0; k < n; k++){ res[k] = a[k] - b[k]; }
+                break;
+            case NodeKind::Mult:
+                series_mult(a, b, res, n);
+                break;
+            case NodeKind::Div:
+                series_div(a, b, res, n);
+                break;
+            case NodeKind::Pow: {
+                bool constant_exponent = std::all_of(b + 1, b + n, [](T v){ return v == 0; });
+                if (constant_exponent && a[0] != 0){
+                    series_pow_const(a, b[0], res, n);
+                } else if (constant_exponent && b[0] >= 0 && std::floor(b[0]) == b[0]){
+                    series_pow_natural(a, static_cast<unsigned long long>(b[0]), res, n);
+                } else {
+                    // f^g = exp(g * ln(f))
+                    series_ln(a, tmp.data(), n);
+                    series_mult(b, tmp.data(), tmp.data() + n, n);
+                    series_exp(tmp.data() + n, res, n);
+                }
+                break;
+            }
+            case NodeKind::Sin:
+                series_sincos(a, res, tmp.data(), n);
+                break;
+            case NodeKind::Cos:
+                series_sincos(a, tmp.data(), res, n);
+                break;
+            case NodeKind::Ln:
+                series_ln(a, res, n);
+                break;
+            case NodeKind::Exp:
+                series_exp(a, res, n);
+                break;
+            case NodeKind::Sqrt:
+                series_pow_const(a, T(0.5), res, n);
+                break;
+            case NodeKind::Polynomial:
+                // lowered to Horner form by FlatExpression
+                break;
+        }
+    }
+
+    const T* root = &c[expr_.root() * n];
+    return std::vector<T>(root, root + n);
+}
+
+template <typename T>
+std::vector<T> TaylorEvaluator<T>::derivatives(T point, size_t order, const std::vector<T>& values) const {
+    std::vector<T> res = coefficients(point, order, values);
+    // f^(k) = k! c_k
+    T factorial = 1;
+    for (size_t k = 1; k < res.size(); k++){
+        factorial *= T(k);
+        res[k] *= factorial;
+    }
+    return res;
+}
+
+template <typename T>
+const std::vector<std::string>& TaylorEvaluator<T>::variables() const { return expr_.variables(); }
+
+template <typename T>
+std::vector<T> taylor_derivatives(const Expression<T>& expression, const std::string& var, T point, size_t order,
+                                  const std::vector<std::string>& variables, const std::vector<T>& values){
+    TaylorEvaluator<T> evaluator(expression, var);
+    std::vector<T> slots(evaluator.variables().size(), T(0));
+    for (size_t i = 0; i < variables.size() && i < values.size(); i++){
+        for (size_t slot = 0; slot < slots.size(); slot++){
+            if (evaluator.variables()[slot] == variables[i]){ slots[slot] = values[i]; }
+        }
+    }
+    return evaluator.derivatives(point, order, slots);
+}
+
+template class TaylorEvaluator<float>;
+template class TaylorEvaluator<double>;
+template class TaylorEvaluator<long double>;
+template std::vector<float> taylor_derivatives(const Expression<float>&, const std::string&, float, size_t,
+                                               const std::vector<std::string>&, const std::vector<float>&);
+template std::vector<double> taylor_derivatives(const Expression<double>&, const std::string&, double, size_t,
+                                                const std::vector<std::string>&, const std::vector<double>&);
+template std::vector<long double> taylor_derivatives(const Expression<long double>&, const std::string&, long double, size_t,
+                                                     const std::vector<std::string>&, const std::vector<long double>&);
+
+} // namespace Expressions
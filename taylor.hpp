@@ -0,0 +1,40 @@
+#ifndef HEADER_GUARD_TAYLOR_HPP_INCLUDED
+#define HEADER_GUARD_TAYLOR_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include "expression.hpp"
+#include "flat.hpp"
+
+namespace Expressions {
+
+// higher order derivatives by one variable without building derivative trees:
+// every node propagates its truncated Taylor series c_0 + c_1 h + ... + c_k h^k,
+// which costs O(k^2) per node instead of the exponential growth of repeated diff()
+template <typename T>
+class TaylorEvaluator
+{
+private:
+    FlatExpression<T> expr_;
+    // slot of the variable, variables() size if the expression doesn't depend on it
+    uint32_t slot_;
+public:
+    TaylorEvaluator(const Expression<T>& expression, const std::string& var);
+    ~TaylorEvaluator() = default;
+
+    // Taylor coefficients f^(k)(point) / k! for k = 0..order
+    // values of the other variables are given in the order of variables()
+    std::vector<T> coefficients(T point, size_t order, const std::vector<T>& values = {}) const;
+    // derivatives f^(k)(point) for k = 0..order
+    std::vector<T> derivatives(T point, size_t order, const std::vector<T>& values = {}) const;
+
+    const std::vector<std::string>& variables() const;
+};
+
+// derivatives of expression by var at point for k = 0..order, other variables given by name
+template <typename T>
+std::vector<T> taylor_derivatives(const Expression<T>& expression, const std::string& var, T point, size_t order,
+                                  const std::vector<std::string>& variables = {}, const std::vector<T>& values = {});
+} // namespace Expressions
+
+#endif // HEADER_GUARD_TAYLOR_HPP_INCLUDED
@@ -1,8 +1,54 @@
 #include "expression.hpp"
 #include "parser.hpp"
+#include "flat.hpp"
+#include "interval.hpp"
+#include "solver.hpp"
+#include "taylor.hpp"
+#include "complex.hpp"
+#include "mixed.hpp"
+#include "polynomial.hpp"
+#include "builder.hpp"
+#include "parallel.hpp"
+#include "stream.hpp"
+#include "server.hpp"
+#include "group.hpp"
+#include "egraph.hpp"
+#include "profile.hpp"
+#include "budget.hpp"
+#include "tiered.hpp"
+#include "calc.hpp"
 #include <string>
 #include <vector>
 #include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <chrono>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+// every allocation of the program is counted, tests compare the counts around an operation
+static std::atomic<size_t> allocations{0};
+
+void* operator new(std::size_t size){
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)){ return p; }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
 
 void run_tests(){
     // expression constructors
@@ -150,7 +196,973 @@ void run_tests(){
     if (expr31.to_string() == "((x ^ y) * ln(x))" && expr31.to_string() == "()"){
         std::cout << "OK\n";
     } else { std::cout << "FAIL\n"; }
-    
+
+    // flat expressions
+    std::cout << "Test 20: ";
+    Expressions::Expression<long double> expr33("sin(x) * y ^ 2 - ln(x / y) + exp(x)");
+    Expressions::FlatExpression<long double> flat1(expr33);
+    long double tree_value = expr33.eval_and_resolve({"x", "y"}, {1.5, 2});
+    if (flat1.eval_and_resolve({"x", "y"}, {1.5, 2}) == tree_value &&
+        flat1.to_expression().eval_and_resolve({"x", "y"}, {1.5, 2}) == tree_value){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    std::cout << "Test 21: ";
+    if (flat1.diff("x").to_string() == expr33.diff("x").to_string() &&
+        flat1.to_string() == expr33.to_string()){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    std::cout << "Test 22: ";
+    Expressions::Expression<long double> expr34("x * x + x * x");
+    if (Expressions::FlatExpression<long double>(expr34).size() == 3 &&
+        flat1.evaluate({"y"}, {2}).variables() == std::vector<std::string>{"x"}){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    // interval bounds
+    std::cout << "Test 23: ";
+    Expressions::Expression<long double> expr35("x * x - 2 * x");
+    Expressions::IntervalEvaluator<long double> natural(expr35);
+    Expressions::IntervalEvaluator<long double> mean_value(expr35, true);
+    Expressions::Interval<long double> box(0, 2);
+    Expressions::Interval<long double> nb = natural.bounds({box});
+    Expressions::Interval<long double> mb = mean_value.bounds({box});
+    if (nb.lower <= -1 && nb.upper >= 0 && mb.lower <= -1 && mb.upper >= 0 && mb.width() < nb.width()){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    std::cout << "Test 24: ";
+    Expressions::Interval<long double> sb = Expressions::eval_interval(
+        Expressions::Expression<long double>("sin(x) + ln(y)"), {"x", "y"}, {{0, 3.2}, {1, 2}});
+    if (sb.lower <= std::sin(3.2L) && sb.lower > -0.1 && sb.upper >= 1 + std::log(2.0L) && sb.upper < 1.7){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    // sampling
+    std::cout << "Test 25: ";
+    Expressions::Expression<long double> expr36("sin(x) * y + y ^ 2");
+    std::vector<long double> line(11);
+    expr36.sample("x", 0, 1, line.size(), line.data(), {"y"}, {3});
+    bool line_ok = true;
+    for (size_t i = 0; i < line.size(); i++){
+        long double x = i * 0.1L;
+        line_ok = line_ok && std::abs(line[i] - expr36.eval_and_resolve({"x", "y"}, {x, 3})) < 1e-15;
+    }
+    if (line_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    std::cout << "Test 26: ";
+    std::vector<long double> grid(3 * 600);
+    expr36.sample_grid({"y", "x"}, {1, 0}, {2, 2}, {3, 600}, grid.data());
+    if (std::abs(grid[600 + 599] - expr36.eval_and_resolve({"x", "y"}, {2, 1.5})) < 1e-15 &&
+        std::abs(grid[2 * 600 + 300] - expr36.eval_and_resolve({"x", "y"}, {300 * 2.0L / 599, 2})) < 1e-15){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    // newton solver
+    std::cout << "Test 27: ";
+    Expressions::NewtonSolver<long double> sqrt_solver(Expressions::Expression<long double>("x * x - a"), "x", {"a"});
+    auto roots = sqrt_solver.solve({1, 1, 1}, {2, 9, 16});
+    if (roots[0].status == Expressions::SolveStatus::Converged && std::abs(roots[0].root - std::sqrt(2.0L)) < 1e-15 &&
+        std::abs(roots[1].root - 3) < 1e-15 && std::abs(roots[2].root - 4) < 1e-15){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    std::cout << "Test 28: ";
+    // starting at the maximum of f, plain Newton can't move
+    Expressions::NewtonSolver<long double> cos_solver(Expressions::Expression<long double>("cos(x) - x * c"), "x", {"c"});
+    auto plain = cos_solver.solve({0}, {0});
+    auto bracketed = cos_solver.solve({0}, {-1}, {2}, {0});
+    if (plain[0].status == Expressions::SolveStatus::Failed &&
+        bracketed[0].status == Expressions::SolveStatus::Converged &&
+        std::abs(bracketed[0].root - std::acos(0.0L)) < 1e-15){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    // taylor mode derivatives
+    std::cout << "Test 29: ";
+    Expressions::Expression<long double> expr37("sin(x * y) * ln(x + 2) ^ 3 / (x + 1) + exp(x) ^ 0.5 - cos(x) ^ 2");
+    std::vector<long double> taylor = Expressions::taylor_derivatives(expr37, "x", 0.7L, 3, {"y"}, {1.5});
+    Expressions::Expression<long double> symbolic = expr37;
+    bool taylor_ok = true;
+    for (size_t k = 0; k <= 3; k++){
+        long double expected = symbolic.eval_and_resolve({"x", "y"}, {0.7, 1.5});
+        taylor_ok = taylor_ok && std::abs(taylor[k] - expected) < 1e-12 * (1 + std::abs(expected));
+        symbolic = symbolic.diff("x");
+    }
+    if (taylor_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    std::cout << "Test 30: ";
+    std::vector<long double> exp_taylor = Expressions::taylor_derivatives(
+        Expressions::Expression<long double>("exp(2 * x) * x ^ 2"), "x", 0.0L, 8);
+    // (x^2 e^(2x))^(8) at 0 = 8 * 7 * 2^6
+    if (std::abs(exp_taylor[8] - 8 * 7 * 64) < 1e-12 && exp_taylor[0] == 0){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    // complex expressions
+    using Complex = std::complex<long double>;
+    std::cout << "Test 31: ";
+    Expressions::Expression<Complex> expr38("3i + 2 * i * x - 1");
+    Complex value38 = expr38.eval_and_resolve({"x"}, {Complex(1, 0)});
+    if (value38 == Complex(-1, 5) && Expressions::Expression<Complex>("i").to_string() == "i"){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    std::cout << "Test 32: ";
+    Expressions::Expression<Complex> expr39("exp(i * w * t) / (1 + i * w) + sin(w) ^ 2 - ln(t)");
+    Expressions::ComplexBatchEvaluator<long double> batch(expr39, {"w", "t"});
+    Expressions::FlatExpression<Complex> flat39(expr39);
+    std::vector<long double> w_col{0.5, 1, 2, 30}, t_col{1, -2, 3, 0.25};
+    std::vector<long double> out_re(4), out_im(4);
+    std::vector<const long double*> re_cols, im_cols;
+    for (const std::string& var : batch.variables()){
+        re_cols.push_back(var == "w" ? w_col.data() : t_col.data());
+        im_cols.push_back(nullptr);
+    }
+    batch.evaluate(re_cols, im_cols, 4, out_re.data(), out_im.data());
+    bool batch_ok = batch.real_nodes() > 0;
+    for (size_t i = 0; i < 4; i++){
+        Complex expected = flat39.eval_and_resolve({"w", "t"}, {Complex(w_col[i]), Complex(t_col[i])});
+        batch_ok = batch_ok && std::abs(Complex(out_re[i], out_im[i]) - expected) < 1e-15L * (1 + std::abs(expected));
+    }
+    if (batch_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    // float and double precision
+    std::cout << "Test 33: ";
+    Expressions::Expression<double> expr40("x * 2.5 + sin(x) ^ 2");
+    Expressions::Expression<float> expr41("x * 2.5 + sin(x) ^ 2");
+    if (std::abs(expr40.eval_and_resolve({"x"}, {2}) - (5 + std::sin(2.0) * std::sin(2.0))) < 1e-12 &&
+        std::abs(expr41.eval_and_resolve({"x"}, {2}) - (5 + std::sin(2.0f) * std::sin(2.0f))) < 1e-5f){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    std::cout << "Test 34: ";
+    Expressions::Expression<long double> expr42("exp(x / 3) * ln(y) - x ^ 3");
+    Expressions::Expression<double> expr43 = expr42.convert<double>();
+    Expressions::FlatExpression<double> flat43(expr43.diff("x"));
+    long double precise = expr42.diff("x").eval_and_resolve({"x", "y"}, {1.5, 2.5});
+    if (expr43.to_string() == expr42.to_string() &&
+        std::abs(flat43.eval_and_resolve({"x", "y"}, {1.5, 2.5}) - precise) < 1e-12){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    // mixed precision
+    std::cout << "Test 35: ";
+    Expressions::Expression<long double> expr44b("ln(x) * 2 + x");
+    Expressions::MixedPrecisionEvaluator<double> mixed(expr44b, 1e-12L);
+    std::vector<long double> mixed_rows{5, 1 + 1e-10L, 0.25};
+    std::vector<long double> mixed_out;
+    size_t fallbacks = mixed.evaluate(mixed_rows, mixed_out);
+    // the sum stays well conditioned even where ln(x) alone is not
+    bool mixed_ok = fallbacks == 0;
+    // ln near 1 needs long double
+    Expressions::Expression<long double> ln_near_one("ln(x)");
+    std::vector<long double> ln_out;
+    mixed_ok = mixed_ok && Expressions::MixedPrecisionEvaluator<double>(ln_near_one, 1e-12L).evaluate({1 + 1e-10L, 5}, ln_out) == 1;
+    for (size_t i = 0; i < mixed_rows.size(); i++){
+        long double expected = expr44b.eval_and_resolve({"x"}, {mixed_rows[i]});
+        mixed_ok = mixed_ok && std::abs(mixed_out[i] - expected) <= 1e-12L * std::abs(expected);
+    }
+    mixed_ok = mixed_ok && std::abs(ln_out[0] - std::log(1 + 1e-10L)) <= 1e-15L * 1e-10L;
+    if (mixed_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // polynomial form
+    std::cout << "Test 36: ";
+    Expressions::Expression<long double> expr45("x * x * x + 3 * x * y - 2 * y ^ 2 + 5");
+    Expressions::Expression<long double> poly45 = Expressions::polynomial_form(expr45);
+    Expressions::Expression<long double> dpoly45 = poly45.diff("x");
+    // the tree derivative of y ^ 2 has ln(y), so y stays positive
+    long double poly_expected = expr45.eval_and_resolve({"x", "y"}, {1.5, 0.5});
+    long double dpoly_expected = expr45.diff("x").eval_and_resolve({"x", "y"}, {1.5, 0.5});
+    if (poly45.root()->kind() == Expressions::NodeKind::Polynomial &&
+        dpoly45.root()->kind() == Expressions::NodeKind::Polynomial &&
+        std::abs(poly45.eval_and_resolve({"x", "y"}, {1.5, 0.5}) - poly_expected) < 1e-15 &&
+        std::abs(dpoly45.eval_and_resolve({"x", "y"}, {1.5, 0.5}) - dpoly_expected) < 1e-15 &&
+        std::abs(Expressions::FlatExpression<long double>(dpoly45).eval_and_resolve({"x", "y"}, {1.5, 0.5}) - dpoly_expected) < 1e-15){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+
+    std::cout << "Test 37: ";
+    Expressions::Expression<long double> expr46 = Expressions::polynomial_form(Expressions::Expression<long double>("(x ^ 2 + 1) / (x - 1) + sin(x * 2)"));
+    Expressions::Expression<long double> expr47 = Expressions::polynomial_form(Expressions::Expression<long double>("(x + 1) ^ 10"));
+    const auto& quotient = expr46.root()->operand(0);
+    if (quotient->kind() == Expressions::NodeKind::Div &&
+        quotient->operand(0)->kind() == Expressions::NodeKind::Polynomial &&
+        quotient->operand(1)->kind() == Expressions::NodeKind::Polynomial &&
+        std::abs(expr46.eval_and_resolve({"x"}, {3}) - (5 + std::sin(6.0L))) < 1e-15 &&
+        std::abs(expr47.eval_and_resolve({"x"}, {0.5}) - std::pow(1.5L, 10)) < 1e-13 &&
+        expr47.diff("x").diff("x").to_string() == Expressions::polynomial_form(Expressions::Expression<long double>("90 * (x + 1) ^ 8")).to_string()){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // strength reduction
+    std::cout << "Test 38: ";
+    Expressions::Expression<long double> expr48 = Expressions::Expression<long double>("x ^ 3 + sin(x * y) * cos(x * y) + exp(ln(y * y)) + x ^ 0.5") -
+                                                  (Expressions::Expression<long double>("y") ^ Expressions::Expression<long double>(-2.0L));
+    Expressions::FlatExpression<long double> flat48 = Expressions::FlatExpression<long double>(expr48).optimize();
+    bool reduced = true;
+    for (const auto& node : flat48.nodes()){
+        reduced = reduced && node.kind != Expressions::NodeKind::Pow && node.kind != Expressions::NodeKind::Ln &&
+                  node.kind != Expressions::NodeKind::Exp;
+    }
+    long double expected48 = expr48.eval_and_resolve({"x", "y"}, {2.25, 0.75});
+    long double dexpected48 = expr48.diff("x").eval_and_resolve({"x", "y"}, {2.25, 0.75});
+    if (reduced &&
+        std::abs(flat48.eval_and_resolve({"x", "y"}, {2.25, 0.75}) - expected48) < 1e-15 * std::abs(expected48) &&
+        std::abs(flat48.diff("x").optimize().eval_and_resolve({"x", "y"}, {2.25, 0.75}) - dexpected48) < 1e-15 * std::abs(dexpected48) &&
+        std::abs(flat48.to_expression().eval_and_resolve({"x", "y"}, {2.25, 0.75}) - expected48) < 1e-15 * std::abs(expected48)){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // single-threaded builder and concurrent evaluation
+    std::cout << "Test 39: ";
+    Expressions::ExpressionBuilder<long double> builder;
+    uint32_t bx = builder.variable("x");
+    uint32_t bsum = builder.number(1);
+    for (int k = 1; k <= 3; k++){
+        bsum = builder.op(Expressions::NodeKind::Plus, bsum,
+                          builder.op(Expressions::NodeKind::Pow, bx, builder.number(k)));
+    }
+    uint32_t bsin = builder.op(Expressions::NodeKind::Sin, bsum);
+    Expressions::Expression<long double> built49 = builder.build(bsin);
+    Expressions::Expression<long double> expr49("sin(1 + x ^ 1 + x ^ 2 + x ^ 3)");
+    bool builder_ok = built49.to_string() == expr49.to_string() &&
+                      builder.flatten(bsin).to_string() == built49.to_string() &&
+                      builder.build(builder.add(expr49)).to_string() == expr49.to_string();
+    try {
+        builder.op(Expressions::NodeKind::Plus, bx, 1000);
+        builder_ok = false;
+    } catch (const std::out_of_range&) {}
+
+    Expressions::Expression<long double> dexpr49 = expr49.diff("x");
+    std::vector<long double> concurrent(64);
+    Expressions::parallel_for(concurrent.size(), [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            concurrent[i] = expr49.diff("x").eval_and_resolve({"x"}, {1 + i / 64.0L});
+        }
+    }, 8);
+    for (size_t i = 0; i < concurrent.size(); i++){
+        builder_ok = builder_ok && concurrent[i] == dexpr49.eval_and_resolve({"x"}, {1 + i / 64.0L});
+    }
+    if (builder_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // operator precedence and unary minus
+    std::cout << "Test 40: ";
+    Expressions::Expression<long double> expr50("-x ^ 2 + 3 * -y - 8 / 2 / 2 - 2 ^ 3 ^ 2 + -(x - 5)");
+    Expressions::Expression<long double> expr51("x ^ -1");
+    bool parser_ok = expr50.eval_and_resolve({"x", "y"}, {2, 1}) == -518 &&
+                     expr51.root()->operand(1)->kind() == Expressions::NodeKind::Number &&
+                     expr51.eval_and_resolve({"x"}, {4}) == 0.25;
+    try {
+        Expressions::Expression<long double> broken("x + * 2");
+        parser_ok = false;
+    } catch (const std::runtime_error&) {}
+    if (parser_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // streaming parser
+    std::cout << "Test 41: ";
+    std::vector<long double> streamed;
+    auto collect = [&](size_t, Expressions::Expression<long double> e){ streamed.push_back(e.eval_and_resolve({"x", "y"}, {2, 3})); };
+    size_t in_place = Expressions::parse_statements<long double>("x + 1; sin(y)\n\n  \r\n2.5e1 * x;", collect);
+    // one statement longer than a chunk
+    std::string long_statement = "0";
+    while (long_statement.size() <= 2 * Expressions::STREAM_CHUNK){ long_statement += " + x * y"; }
+    std::istringstream stream_in("x ^ 2\n" + long_statement + ";y - x");
+    size_t from_stream = Expressions::parse_stream<long double>(stream_in, collect);
+    {
+        std::ofstream file("stream_test.txt");
+        file << "x * y;\nexp(x)\n";
+    }
+    size_t from_file = Expressions::parse_file<long double>("stream_test.txt", collect);
+    std::remove("stream_test.txt");
+    bool stream_ok = in_place == 3 && from_stream == 3 && from_file == 2 && streamed.size() == 8 &&
+                     streamed[0] == 3 && streamed[1] == std::sin(3.0L) && streamed[2] == 50 && streamed[3] == 4 &&
+                     streamed[4] == 6 * ((long_statement.size() - 1) / 8) && streamed[5] == 1 &&
+                     streamed[6] == 6 && streamed[7] == std::exp(2.0L);
+    try {
+        Expressions::parse_statements<long double>("x + 1; x +", collect);
+        stream_ok = false;
+    } catch (const std::runtime_error& error) {
+        stream_ok = stream_ok && std::string(error.what()).starts_with("statement 1");
+    }
+    if (stream_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // parallel parsing
+    std::cout << "Test 42: ";
+    std::vector<std::string_view> formulas{"x + 1", "x +", "sin(y) * 2", "", "2 ^ x", "x ) 1"};
+    auto parsed = Expressions::parse_many<long double>(formulas, 4);
+    {
+        std::ofstream file("parse_many_test.txt");
+        file << "x * y;\n  \nx $ y\nexp(x)";
+    }
+    auto parsed_file = Expressions::parse_many_file<long double>("parse_many_test.txt", 2);
+    std::remove("parse_many_test.txt");
+    bool many_ok = parsed.size() == 6 && parsed[0].ok() && !parsed[1].ok() && parsed[2].ok() &&
+                   !parsed[3].ok() && parsed[4].ok() && !parsed[5].ok() && !parsed[1].error.empty() &&
+                   parsed[0].expression->eval_and_resolve({"x"}, {2}) == 3 &&
+                   parsed[2].expression->eval_and_resolve({"y"}, {1}) == 2 * std::sin(1.0L) &&
+                   parsed[4].expression->eval_and_resolve({"x"}, {3}) == 8 &&
+                   parsed_file.size() == 3 && parsed_file[0].ok() && !parsed_file[1].ok() && parsed_file[2].ok() &&
+                   parsed_file[0].expression->eval_and_resolve({"x", "y"}, {2, 3}) == 6 &&
+                   parsed_file[2].expression->eval_and_resolve({"x"}, {0}) == 1;
+    if (many_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // partial evaluation
+    std::cout << "Test 43: ";
+    Expressions::Expression<long double> expr52("a * x ^ 2 + sin(b * c) * y + (a - 2) * exp(b) + 0 * c + x / (c - 2)");
+    Expressions::Expression<long double> spec52 = expr52.specialize({{"a", 2}, {"b", 0.5}, {"c", 3}});
+    Expressions::Expression<long double> part52 = expr52.specialize({{"b", 0.5}});
+    Expressions::Expression<long double> same52 = expr52.specialize({{"z", 1}});
+    // a - 2 = 0 still multiplies exp(b), but the product is folded to 0 and x / 1 is reduced to x
+    bool specialize_ok = spec52.to_string().find('a') == std::string::npos &&
+                         spec52.to_string().find("exp") == std::string::npos &&
+                         spec52.eval_and_resolve({"x", "y"}, {1.5, -2}) == expr52.eval_and_resolve({"a", "b", "c", "x", "y"}, {2, 0.5, 3, 1.5, -2}) &&
+                         part52.eval_and_resolve({"a", "c", "x", "y"}, {1, 4, 2, 3}) == expr52.eval_and_resolve({"a", "b", "c", "x", "y"}, {1, 0.5, 4, 2, 3}) &&
+                         same52.root() == expr52.root();
+    if (specialize_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // evaluation server over a Unix domain socket
+    std::cout << "Test 44: ";
+    std::vector<Expressions::Expression<double>> served{Expressions::Expression<double>("x * y + sin(x)"),
+                                                        Expressions::Expression<double>("exp(t) / 2")};
+    Expressions::ServerConfig server_config;
+    server_config.socket_path = "server_test.sock";
+    // batches of a few rows are split over the evaluation pool
+    server_config.threads = 3;
+    server_config.rows_per_thread = 1;
+    bool server_ok = true;
+    size_t server_requests = 0;
+    try {
+        Expressions::EvaluationServer<double> server(served, server_config);
+        server.start();
+        std::vector<Expressions::FlatExpression<double>> expected{Expressions::FlatExpression<double>(served[0]),
+                                                                   Expressions::FlatExpression<double>(served[1])};
+        std::vector<int> client_ok(4, 0);
+        Expressions::parallel_for(client_ok.size(), [&](size_t begin, size_t end){
+            for (size_t c = begin; c < end; c++){
+                Expressions::EvaluationClient<double> client("server_test.sock");
+                bool ok = client.count() == 2 && client.variables(0) == expected[0].variables() &&
+                          client.variables(1) == std::vector<std::string>{"t"};
+                for (size_t r = 0; r < 50; r++){
+                    // 3 rows of expression 0, then 1 row of expression 1
+                    std::vector<double> rows{0.5 * c, r * 0.1, 1.5, -2, r * 0.01, c * 1.0};
+                    std::vector<double> out(3);
+                    client.evaluate(0, 3, 2, rows.data(), out.data());
+                    for (size_t i = 0; i < 3; i++){
+                        ok = ok && out[i] == expected[0].resolve({rows[2 * i], rows[2 * i + 1]});
+                    }
+                    client.evaluate(1, 1, 1, rows.data() + 5, out.data());
+                    ok = ok && out[0] == expected[1].resolve({rows[5]});
+                }
+                try {
+                    client.evaluate(1, 1, 2, std::vector<double>{1, 2}.data(), nullptr);
+                    ok = false;
+                } catch (const std::runtime_error&) {}
+                try {
+                    client.variables(7);
+                    ok = false;
+                } catch (const std::runtime_error& error) {
+                    ok = ok && std::string(error.what()) == "unknown expression 7";
+                }
+                client_ok[c] = ok;
+            }
+        }, 4);
+        server.stop();
+        server_requests = server.requests();
+        server_ok = std::count(client_ok.begin(), client_ok.end(), 1) == 4 && server.batches() <= server_requests;
+    } catch (const std::exception&) {
+        server_ok = false;
+    }
+    if (server_ok && server_requests == 400){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // fused evaluation of several outputs
+    std::cout << "Test 45: ";
+    Expressions::Expression<long double> expr53("sin(x) * exp(y) + x ^ 2 * y");
+    std::vector<Expressions::Expression<long double>> outputs53{expr53, expr53.diff("x"), expr53.diff("y"),
+                                                                 Expressions::Expression<long double>("sin(x) + z")};
+    Expressions::ExpressionGroup<long double> group53(outputs53);
+    size_t separate53 = 0;
+    for (const auto& output : outputs53){ separate53 += Expressions::FlatExpression<long double>(output).size(); }
+    // positive values, the tree diff of x ^ 2 contains ln(x)
+    std::vector<long double> rows53{0.5, 1.5, 2, 1.75, 0.25, 3};
+    std::vector<long double> out53(group53.size() * 2);
+    group53.resolve_rows(rows53.data(), 2, out53.data(), 2);
+    bool group_ok = group53.size() == 4 && group53.nodes() < separate53;
+    for (size_t row = 0; row < 2; row++){
+        std::vector<std::string> names = group53.variables();
+        std::vector<long double> values(rows53.begin() + row * 3, rows53.begin() + row * 3 + 3);
+        std::vector<long double> single = group53.resolve(values);
+        for (size_t i = 0; i < outputs53.size(); i++){
+            long double expected = outputs53[i].eval_and_resolve(names, values);
+            group_ok = group_ok && single[i] == expected && out53[row * 4 + i] == expected;
+        }
+    }
+    if (group_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // equality saturation
+    std::cout << "Test 46: ";
+    Expressions::EGraph<double> graph54;
+    uint32_t factored54 = graph54.add(Expressions::Expression<double>("x * (y + z)"));
+    uint32_t expanded54 = graph54.add(Expressions::Expression<double>("x * y + x * z"));
+    graph54.saturate();
+    bool egraph_ok = graph54.find(factored54) == graph54.find(expanded54);
+    Expressions::Expression<double> expr54 = Expressions::Expression<double>("sin(x) * exp(y) + x ^ 2 * y").diff("x");
+    Expressions::Expression<double> saturated54 = Expressions::saturate(expr54);
+    egraph_ok = egraph_ok && Expressions::evaluation_cost(saturated54) < Expressions::evaluation_cost(expr54);
+    std::vector<std::string> names54{"x", "y"};
+    for (double x : {0.5, 1.25, 3.0}){
+        std::vector<double> values{x, 0.75};
+        double expected = expr54.eval_and_resolve(names54, values);
+        egraph_ok = egraph_ok && std::abs(saturated54.eval_and_resolve(names54, values) - expected) <= 1e-12 * std::abs(expected);
+    }
+    // limits stop the rewriting of an expression whose rewrites never end
+    Expressions::SaturationLimits limits54;
+    limits54.max_nodes = 500;
+    Expressions::EGraph<double> bounded54;
+    bounded54.add(Expressions::Expression<double>("a * b * c * d * e + a * b * c + b * c * d * e + a + b + c + d + e"));
+    bounded54.saturate(limits54);
+    egraph_ok = egraph_ok && bounded54.size() < 5000;
+    if (egraph_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // lazy derivatives
+    std::cout << "Test 47: ";
+    Expressions::Expression<long double> lazy55("sin(x) * exp(y) + ln(x + 2) / (y + 1) - x ^ 3 * cos(x * y) + 2 ^ (x * y)");
+    std::vector<Expressions::Expression<long double>> cases55{
+        lazy55, lazy55.diff("y"), Expressions::polynomial_form(Expressions::Expression<long double>("(x + y) ^ 4 + 3 * x"))};
+    bool lazy_ok = lazy55.lazy_diff("x").to_string() == lazy55.diff("x").to_string();
+    for (const auto& expression : cases55){
+        for (const char* var : {"x", "y"}){
+            Expressions::DiffView<long double> lazy = expression.lazy_diff(var);
+            for (long double x : {0.5L, 1.25L, 3.0L}){
+                std::vector<long double> values{x, 0.75L};
+                long double expected = expression.diff(var).eval_and_resolve({"x", "y"}, values);
+                auto [value, derivative] = lazy.value_and_derivative({"x", "y"}, values);
+                lazy_ok = lazy_ok && std::abs(derivative - expected) <= 1e-15L * std::max(1.0L, std::abs(expected)) &&
+                          value == expression.eval_and_resolve({"x", "y"}, values);
+            }
+        }
+    }
+    // defined where the tree diff of a power takes ln of a negative base
+    Expressions::Expression<long double> cube55("x ^ 3");
+    lazy_ok = lazy_ok && std::isnan(cube55.diff("x").eval_and_resolve({"x"}, {-2})) &&
+              cube55.lazy_diff("x").eval_and_resolve({"x"}, {-2}) == 12 &&
+              cube55.lazy_diff("x").lazy_diff("x").eval_and_resolve({"x"}, {0.5L}) == 3;
+    if (lazy_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // profiling
+    std::cout << "Test 48: ";
+    Expressions::Expression<long double> profiled56 = Expressions::Expression<long double>("sin(x) * exp(y) + x ^ 2.5 * ln(y + 1)").diff("x");
+    Expressions::ExpressionProfiler<long double> profiler56(profiled56);
+    bool profile_ok = true;
+    for (size_t i = 0; i < 50; i++){
+        std::vector<long double> values{0.5L + i / 16.0L, 1.5L};
+        profile_ok = profile_ok && profiler56.eval_and_resolve({"x", "y"}, values) == profiled56.eval_and_resolve({"x", "y"}, values);
+    }
+    std::vector<Expressions::ProfileEntry> by_inclusive56 = profiler56.top(3, true);
+    std::vector<Expressions::ProfileEntry> by_self56 = profiler56.top(100);
+    double self56 = 0;
+    for (const auto& e : by_self56){ self56 += e.self_ns; }
+    std::ostringstream folded56;
+    profiler56.write_folded(folded56);
+    profile_ok = profile_ok && profiler56.runs() == 50 &&
+                 by_inclusive56.size() == 3 && by_inclusive56[0].expression == profiled56.to_string() &&
+                 by_inclusive56[0].calls == 50 && by_inclusive56[0].inclusive_ns >= by_inclusive56[1].inclusive_ns &&
+                 std::abs(self56 - by_inclusive56[0].inclusive_ns) <= 0.05 * by_inclusive56[0].inclusive_ns &&
+                 folded56.str().find(';') != std::string::npos;
+    profiler56.reset();
+    profile_ok = profile_ok && profiler56.runs() == 0 && profiler56.top(1)[0].calls == 0;
+    if (profile_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // resource budgets
+    std::cout << "Test 49: ";
+    Expressions::Expression<double> expr57("sin(x * y) / (x + 1) + x ^ y - ln(cos(x) + 2) * exp(y)");
+    bool budget_ok = true;
+    {
+        Expressions::ResourceBudget unlimited;
+        Expressions::BudgetScope scope(unlimited);
+        Expressions::ResourceEstimate estimate = Expressions::estimate_diff(expr57, "x");
+        Expressions::Expression<double> derivative = expr57.diff("x");
+        budget_ok = budget_ok && scope.nodes() == estimate.nodes && scope.bytes() == estimate.bytes &&
+                    Expressions::estimate_size(derivative).depth == estimate.depth;
+        size_t before = scope.nodes();
+        derivative.evaluate({"x"}, {0.5});
+        budget_ok = budget_ok && scope.nodes() - before == Expressions::estimate_evaluate(derivative, {"x"}).nodes;
+    }
+    // repeated derivatives are rejected before anything is built
+    Expressions::ResourceBudget budget57;
+    budget57.max_nodes = 100000;
+    budget57.max_depth = 200;
+    Expressions::Expression<double> power57("x ^ x");
+    size_t derivatives57 = 0;
+    try {
+        Expressions::BudgetScope scope(budget57);
+        for (; derivatives57 < 20; derivatives57++){
+            size_t before = scope.nodes();
+            try {
+                power57 = power57.diff("x");
+            } catch (const Expressions::BudgetExceeded&) {
+                budget_ok = budget_ok && scope.nodes() == before;
+                throw;
+            }
+        }
+    } catch (const Expressions::BudgetExceeded&) {}
+    budget_ok = budget_ok && derivatives57 > 2 && derivatives57 < 20;
+    // deep nesting and long chains while parsing, the innermost of nested scopes
+    std::string nested57 = std::string(1000, '(') + "x" + std::string(1000, ')');
+    std::string chain57 = "x";
+    for (size_t i = 0; i < 500; i++){ chain57 += " + x"; }
+    for (const std::string& text : {nested57, chain57}){
+        bool thrown = false;
+        try {
+            Expressions::BudgetScope scope(budget57);
+            Expressions::Expression<double> parsed(text);
+        } catch (const Expressions::BudgetExceeded&) { thrown = true; }
+        budget_ok = budget_ok && thrown;
+    }
+    try {
+        Expressions::ResourceBudget small;
+        small.max_nodes = 10;
+        Expressions::BudgetScope outer(small);
+        Expressions::BudgetScope inner(budget57);
+        Expressions::Expression<double> parsed("x + y + z + w + v + u");
+        budget_ok = false;
+    } catch (const Expressions::BudgetExceeded&) {}
+    budget_ok = budget_ok && !Expressions::BudgetScope::active() && Expressions::Expression<double>(chain57).diff("x").resolve() == 501;
+    if (budget_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // allocations of composition
+    std::cout << "Test 50: ";
+    Expressions::Expression<double> x58("x");
+    Expressions::Expression<double> y58("y");
+    size_t start58 = allocations;
+    Expressions::Expression<double> composed58 = x58 * y58 + x58;
+    size_t compose_allocations58 = allocations - start58;
+    start58 = allocations;
+    Expressions::Expression<double> moved58 = std::move(composed58);
+    composed58 = moved58;
+    composed58 = std::move(moved58);
+    size_t move_allocations58 = allocations - start58;
+    start58 = allocations;
+    Expressions::Expression<double> function58 = std::move(composed58).sin().exp() * 2.0;
+    size_t function_allocations58 = allocations - start58;
+    bool compose_ok = compose_allocations58 == 2 && move_allocations58 == 0 && function_allocations58 == 4 &&
+                      !composed58.root() && !moved58.root() &&
+                      function58.to_string() == "(exp(sin(((x * y) + x))) * 2.000000)";
+    // a generated sum of n terms costs n - 1 nodes and one reservation
+    const size_t terms58 = 1000;
+    std::vector<Expressions::Expression<double>> generated58;
+    for (size_t i = 0; i < terms58; i++){ generated58.push_back(Expressions::Expression<double>(static_cast<double>(i))); }
+    start58 = allocations;
+    Expressions::ExpressionAccumulator<double> sum58;
+    sum58.reserve(terms58);
+    for (const auto& term : generated58){ sum58.add(term); }
+    Expressions::Expression<double> built58 = sum58.build();
+    size_t sum_allocations58 = allocations - start58;
+    Expressions::ExpressionAccumulator<double> product58(Expressions::NodeKind::Mult);
+    product58.add(x58).add(Expressions::Expression<double>(2.0)).add(y58);
+    compose_ok = compose_ok && sum_allocations58 == terms58 && sum58.size() == 0 &&
+                 built58.resolve() == terms58 * (terms58 - 1) / 2 && Expressions::estimate_size(built58).depth == 11 &&
+                 product58.build().eval_and_resolve({"x", "y"}, {3, 5}) == 30 &&
+                 Expressions::ExpressionAccumulator<double>(Expressions::NodeKind::Mult).build().resolve() == 1;
+    if (compose_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // variable dependencies
+    std::cout << "Test 51: ";
+    Expressions::Expression<double> heavy59("sin(y) * exp(y ^ 3) / (ln(y) + cos(y * 2))");
+    Expressions::Expression<double> mixed59 = heavy59 + Expressions::Expression<double>("x * z");
+    size_t start59 = allocations;
+    Expressions::Expression<double> independent59 = heavy59.diff("x");
+    size_t diff_allocations59 = allocations - start59;
+    Expressions::Expression<double> bound59 = mixed59.evaluate({"x"}, {2});
+    Expressions::Expression<double> unbound59 = mixed59.evaluate({"w"}, {2});
+    bool dependencies_ok = diff_allocations59 == 1 && independent59.to_string() == "0.000000" &&
+                           bound59.root()->operand(0) == heavy59.root() &&
+                           bound59.root()->operand(1)->to_string() == "(2.000000 * z)" &&
+                           unbound59.root() == mixed59.root() &&
+                           mixed59.diff("x").eval_and_resolve({"y", "z"}, {1.5, 3}) == 3 &&
+                           mixed59.free_variables() == std::vector<std::string>{"x", "y", "z"} &&
+                           Expressions::Expression<double>(4.0).free_variables().empty();
+    // names past the 63rd share one bit, they are still told apart
+    Expressions::ExpressionAccumulator<double> many59;
+    for (size_t i = 0; i < 80; i++){
+        auto variable59 = std::make_shared<Expressions::VariableNode<double>>("v59_" + std::to_string(i));
+        many59.add(Expressions::Expression<double>(variable59) * static_cast<double>(i));
+    }
+    Expressions::Expression<double> wide59 = many59.build();
+    std::vector<std::string> names59 = wide59.free_variables();
+    dependencies_ok = dependencies_ok && names59.size() == 80 &&
+                      std::is_sorted(names59.begin(), names59.end()) &&
+                      wide59.diff("v59_75").eval_and_resolve({}, {}) == 75 &&
+                      wide59.diff("v59_2").eval_and_resolve({}, {}) == 2 &&
+                      wide59.diff("v59_80").eval_and_resolve({}, {}) == 0;
+    if (dependencies_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // tiered evaluation
+    std::cout << "Test 52: ";
+    Expressions::TierThresholds thresholds60;
+    thresholds60.flat_calls = 4;
+    thresholds60.optimized_calls = 8;
+    Expressions::TieredEvaluator<double> tiered60(thresholds60);
+    Expressions::Expression<double> hot60("sin(x) * y + x * x * x - (x + 0) * 1");
+    size_t hot_id60 = tiered60.add(hot60);
+    size_t cold_id60 = tiered60.add(Expressions::Expression<double>("ln(x) + y"));
+    std::vector<std::string> names60{"x", "y"};
+    bool tiered_ok = true;
+    std::vector<Expressions::EvaluationTier> tiers60;
+    for (size_t i = 0; i < 12; i++){
+        double x = 0.5 + 0.1 * static_cast<double>(i);
+        double expected = hot60.eval_and_resolve(names60, {x, 2});
+        tiered_ok = tiered_ok && std::abs(tiered60.eval_and_resolve(hot_id60, names60, {x, 2}) - expected) < 1e-12;
+        // promotions are published in the background, wait for them to see every tier
+        tiered60.wait_idle();
+        tiers60.push_back(tiered60.stats(hot_id60).tier);
+    }
+    tiered_ok = tiered_ok && tiered60.eval_and_resolve(cold_id60, names60, {1, 3}) == 3;
+    Expressions::TierStats hot_stats60 = tiered60.stats(hot_id60);
+    Expressions::TierStats cold_stats60 = tiered60.stats(cold_id60);
+    tiered_ok = tiered_ok && tiers60[2] == Expressions::EvaluationTier::Tree &&
+                tiers60[3] == Expressions::EvaluationTier::Flat && tiers60[6] == Expressions::EvaluationTier::Flat &&
+                tiers60[7] == Expressions::EvaluationTier::Optimized &&
+                hot_stats60.calls == 12 && hot_stats60.tier_calls[0] == 4 && hot_stats60.tier_calls[1] == 4 &&
+                hot_stats60.tier_calls[2] == 4 && !hot_stats60.pending && !hot_stats60.failed &&
+                cold_stats60.tier == Expressions::EvaluationTier::Tree && cold_stats60.calls == 1;
+    try {
+        tiered60.eval_and_resolve(2, names60, {1, 1});
+        tiered_ok = false;
+    } catch (const std::out_of_range&) {}
+    if (tiered_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // exp(ln(x)) is only simplified where x can't be negative
+    std::cout << "Test 53: ";
+    Expressions::FlatExpression<double> exp_ln61 =
+        Expressions::FlatExpression<double>(Expressions::Expression<double>("exp(ln(x))")).optimize();
+    Expressions::FlatExpression<double> exp_ln_square61 =
+        Expressions::FlatExpression<double>(Expressions::Expression<double>("exp(ln(x * x + 1))")).optimize();
+    bool exp_ln_ok = std::isnan(exp_ln61.eval_and_resolve({"x"}, {-2})) &&
+                     exp_ln61.eval_and_resolve({"x"}, {0}) == 0 &&
+                     std::abs(exp_ln61.eval_and_resolve({"x"}, {3}) - 3) < 1e-12 &&
+                     exp_ln_square61.to_string().find("ln") == std::string::npos &&
+                     exp_ln_square61.eval_and_resolve({"x"}, {-2}) == 5;
+    if (exp_ln_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // stopping the server while a client doesn't read its response
+    std::cout << "Test 54: ";
+    bool stop_ok = true;
+#if defined(__unix__) || defined(__APPLE__)
+    try {
+        Expressions::ServerConfig config62;
+        config62.socket_path = "server_stop_test.sock";
+        Expressions::EvaluationServer<double> server62(served, config62);
+        server62.start();
+
+        sockaddr_un address62{};
+        address62.sun_family = AF_UNIX;
+        std::snprintf(address62.sun_path, sizeof(address62.sun_path), "%s", config62.socket_path.c_str());
+        int fd62 = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        stop_ok = fd62 >= 0 && ::connect(fd62, reinterpret_cast<sockaddr*>(&address62), sizeof(address62)) == 0;
+
+        // the response is far larger than the socket buffer, its send() blocks until stop()
+        Expressions::RequestHeader request62{static_cast<uint32_t>(Expressions::RequestOp::Evaluate), 1, 1u << 20, 1};
+        std::vector<double> rows62(request62.rows, 0.5);
+        stop_ok = stop_ok && ::send(fd62, &request62, sizeof(request62), 0) == sizeof(request62);
+        for (size_t sent = 0; stop_ok && sent < rows62.size() * sizeof(double);){
+            ssize_t bytes = ::send(fd62, reinterpret_cast<const char*>(rows62.data()) + sent, rows62.size() * sizeof(double) - sent, 0);
+            stop_ok = bytes > 0;
+            sent += stop_ok ? static_cast<size_t>(bytes) : 0;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        server62.stop();
+        stop_ok = stop_ok && server62.requests() == 1;
+        if (fd62 >= 0){ ::close(fd62); }
+    } catch (const std::exception&) {
+        stop_ok = false;
+    }
+#endif
+    if (stop_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // columnar evaluation of exprcalc.exe
+    std::cout << "Test 55: ";
+    Expressions::Expression<double> f63("x * y + sin(x)");
+    Expressions::Expression<double> dfdx63 = f63.diff("x");
+    Expressions::CalcOptions options63;
+    options63.expression = "x * y + sin(x)";
+    options63.derivatives = {"x"};
+    // (x, y) of the rows below
+    std::vector<double> rows63{2, 1, 4, 3, -1, 0.5};
+    // an unused column, a blank line and no newline at the end
+    std::istringstream csv63("y, x ,unused\n1,2,7\n\n3, 4 ,7\r\n0.5,-1,7");
+    std::ostringstream csv_out63;
+    Expressions::calc_csv(options63, csv63, csv_out63);
+    std::istringstream csv_result63(csv_out63.str());
+    std::string line63;
+    bool calc_ok = std::getline(csv_result63, line63) && line63 == "f,df/dx";
+    size_t csv_rows63 = 0;
+    while (std::getline(csv_result63, line63)){
+        double x = rows63[2 * csv_rows63], y = rows63[2 * csv_rows63 + 1];
+        double f = 0, dfdx = 0;
+        calc_ok = calc_ok && csv_rows63 < 3 && std::sscanf(line63.c_str(), "%lf,%lf", &f, &dfdx) == 2 &&
+                  std::abs(f - f63.eval_and_resolve({"x", "y"}, {x, y})) < 1e-12 &&
+                  std::abs(dfdx - dfdx63.eval_and_resolve({"x", "y"}, {x, y})) < 1e-12;
+        csv_rows63++;
+    }
+    calc_ok = calc_ok && csv_rows63 == 3;
+    try {
+        std::istringstream bad63("x,y\n1,2\n\n3,z\n");
+        std::ostringstream bad_out63;
+        Expressions::calc_csv(options63, bad63, bad_out63);
+        calc_ok = false;
+    } catch (const std::runtime_error& error) {
+        calc_ok = calc_ok && std::string(error.what()) == "line 4: invalid number \"z\"";
+    }
+    std::string binary63 = "x,y\n";
+    binary63.append(reinterpret_cast<const char*>(rows63.data()), rows63.size() * sizeof(double));
+    std::istringstream binary_in63(binary63);
+    std::ostringstream binary_out63;
+    Expressions::calc_binary(options63, binary_in63, binary_out63);
+    std::string binary_result63 = binary_out63.str();
+    calc_ok = calc_ok && binary_result63.size() == 8 + 6 * sizeof(double) && binary_result63.compare(0, 8, "f,df/dx\n") == 0;
+    for (size_t r = 0; calc_ok && r < 3; r++){
+        double values[2];
+        std::memcpy(values, binary_result63.data() + 8 + r * sizeof(values), sizeof(values));
+        calc_ok = std::abs(values[0] - f63.eval_and_resolve({"x", "y"}, {rows63[2 * r], rows63[2 * r + 1]})) < 1e-12 &&
+                  std::abs(values[1] - dfdx63.eval_and_resolve({"x", "y"}, {rows63[2 * r], rows63[2 * r + 1]})) < 1e-12;
+    }
+    if (calc_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // trigonometric rules of the e-graph, exp(ln(x)) only where x can't be negative
+    std::cout << "Test 56: ";
+    Expressions::EGraph<double> graph64;
+    uint32_t sin_neg64 = graph64.add(Expressions::Expression<double>("sin(-x)"));
+    uint32_t neg_sin64 = graph64.add(Expressions::Expression<double>("-sin(x)"));
+    uint32_t cos_neg64 = graph64.add(Expressions::Expression<double>("cos(-(x + y))"));
+    uint32_t cos64 = graph64.add(Expressions::Expression<double>("cos(x + y)"));
+    graph64.saturate();
+    Expressions::Expression<double> pythagoras64 = Expressions::saturate(Expressions::Expression<double>("cos(x * y) ^ 2 + sin(x * y) ^ 2"));
+    Expressions::Expression<double> exp_ln64 = Expressions::saturate(Expressions::Expression<double>("exp(ln(x))"));
+    Expressions::Expression<double> exp_ln_square64 = Expressions::saturate(Expressions::Expression<double>("exp(ln(x ^ 2 + exp(y)))"));
+    bool trig_ok = graph64.find(sin_neg64) == graph64.find(neg_sin64) && graph64.find(cos_neg64) == graph64.find(cos64) &&
+                   pythagoras64.to_string().find("sin") == std::string::npos &&
+                   pythagoras64.eval_and_resolve({"x", "y"}, {0.3, 2}) == 1 && std::isnan(exp_ln64.eval_and_resolve({"x"}, {-2})) &&
+                   exp_ln_square64.to_string().find("ln") == std::string::npos &&
+                   std::abs(exp_ln_square64.eval_and_resolve({"x", "y"}, {-2, 0}) - 5) < 1e-12;
+    if (trig_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // an exhausted budget while parsing statements keeps its type
+    std::cout << "Test 57: ";
+    std::string statements65 = "x + 1; " + nested57 + "; y";
+    size_t parsed65 = 0;
+    std::string budget_error65;
+    try {
+        Expressions::BudgetScope scope(budget57);
+        Expressions::parse_statements<double>(statements65, [&](size_t, Expressions::Expression<double>){ parsed65++; });
+    } catch (const Expressions::BudgetExceeded& error) {
+        budget_error65 = error.what();
+    } catch (const std::exception&) {}
+    if (parsed65 == 1 && budget_error65.rfind("statement 1: ", 0) == 0){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // every tier returns the values of the tree, also where the expression is undefined
+    std::cout << "Test 58: ";
+    Expressions::TierThresholds thresholds66;
+    thresholds66.flat_calls = 6;
+    thresholds66.optimized_calls = 12;
+    Expressions::TieredEvaluator<double> tiered66(thresholds66);
+    thresholds66.allow_rewrites = true;
+    Expressions::TieredEvaluator<double> rewriting66(thresholds66);
+    std::vector<Expressions::Expression<double>> formulas66{
+        Expressions::Expression<double>("exp(ln(x))"), Expressions::Expression<double>("x - x"),
+        Expressions::Expression<double>("sin(x) * cos(x) + x ^ 3"), Expressions::Expression<double>("x * 0 + (x + 0) * 1"),
+        Expressions::Expression<double>("1 / 0 + 1 / (x + -0)")};
+    for (const auto& formula : formulas66){
+        tiered66.add(formula);
+        rewriting66.add(formula);
+    }
+    std::vector<double> inputs66{-2, -0.0, 0.5, INFINITY, -INFINITY, NAN};
+    auto same66 = [](double a, double b){ return std::isnan(a) ? std::isnan(b) : std::memcmp(&a, &b, sizeof(a)) == 0; };
+    bool tiers_ok = true;
+    for (size_t round = 0; round < 4; round++){
+        for (size_t id = 0; id < formulas66.size(); id++){
+            for (double x : inputs66){
+                tiers_ok = tiers_ok && same66(tiered66.eval_and_resolve(id, {"x"}, {x}), formulas66[id].eval_and_resolve({"x"}, {x}));
+                rewriting66.eval_and_resolve(id, {"x"}, {x});
+            }
+        }
+        tiered66.wait_idle();
+        rewriting66.wait_idle();
+    }
+    for (size_t id = 0; id < formulas66.size(); id++){
+        Expressions::TierStats stats = tiered66.stats(id);
+        tiers_ok = tiers_ok && stats.tier == Expressions::EvaluationTier::Optimized && stats.tier_calls[0] == 6 &&
+                   stats.tier_calls[1] == 6 && stats.tier_calls[2] == 12;
+    }
+    // rewriting is opt-in: a - a = 0 assumes finite values
+    tiers_ok = tiers_ok && rewriting66.stats(1).tier == Expressions::EvaluationTier::Optimized &&
+               rewriting66.eval_and_resolve(1, {"x"}, {INFINITY}) == 0;
+    if (tiers_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // 0 and -0 constants stay distinct nodes when identical subtrees are merged
+    std::cout << "Test 59: ";
+    Expressions::Expression<double> expr67("1 / 0 + 1 / (x + -0)");
+    Expressions::FlatExpression<double> flat67(expr67);
+    double tree67 = expr67.eval_and_resolve({"x"}, {-0.0});
+    if (std::isnan(tree67) && std::isnan(flat67.eval_and_resolve({"x"}, {-0.0})) &&
+        flat67.eval_and_resolve({"x"}, {1}) == expr67.eval_and_resolve({"x"}, {1})){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // fused evaluation and exprcalc return the values of the tree unless rewrites are allowed
+    std::cout << "Test 60: ";
+    std::vector<Expressions::Expression<double>> outputs68{Expressions::Expression<double>("x ^ 0.5"),
+                                                           Expressions::Expression<double>("ln(exp(x))")};
+    Expressions::ExpressionGroup<double> group68(outputs68);
+    Expressions::ExpressionGroup<double> rewriting68(outputs68, true);
+    std::vector<double> inputs68{-INFINITY, 1000};
+    auto same68 = [](double a, double b){ return std::isnan(a) ? std::isnan(b) : std::memcmp(&a, &b, sizeof(a)) == 0; };
+    bool rewrites_ok = std::isnan(rewriting68.resolve({-INFINITY})[0]) && rewriting68.resolve({1000})[1] == 1000;
+    for (double x : inputs68){
+        std::vector<double> fused = group68.resolve({x});
+        for (size_t i = 0; i < outputs68.size(); i++){
+            rewrites_ok = rewrites_ok && same68(fused[i], outputs68[i].eval_and_resolve({"x"}, {x}));
+        }
+    }
+    Expressions::CalcOptions options68;
+    options68.expression = "ln(exp(x))";
+    std::string binary68 = "x\n";
+    binary68.append(reinterpret_cast<const char*>(inputs68.data()), inputs68.size() * sizeof(double));
+    std::istringstream binary_in68(binary68);
+    std::ostringstream binary_out68;
+    Expressions::calc_binary(options68, binary_in68, binary_out68);
+    std::string binary_result68 = binary_out68.str();
+    rewrites_ok = rewrites_ok && binary_result68.size() == 2 + 2 * sizeof(double);
+    for (size_t r = 0; rewrites_ok && r < 2; r++){
+        double value;
+        std::memcpy(&value, binary_result68.data() + 2 + r * sizeof(value), sizeof(value));
+        rewrites_ok = same68(value, outputs68[1].eval_and_resolve({"x"}, {inputs68[r]}));
+    }
+    if (rewrites_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // sampling returns the values of the tree unless rewrites are allowed
+    std::cout << "Test 61: ";
+    std::vector<Expressions::Expression<double>> formulas69{Expressions::Expression<double>("ln(exp(x))"),
+                                                            Expressions::Expression<double>("x ^ 0.5")};
+    bool sample_ok = true;
+    for (const auto& formula : formulas69){
+        for (double x : inputs68){
+            double line = 0, grid = 0;
+            formula.sample("x", x, x, 1, &line);
+            formula.sample_grid({"x"}, {x}, {x}, {1}, &grid);
+            double tree = formula.eval_and_resolve({"x"}, {x});
+            sample_ok = sample_ok && same68(line, tree) && same68(grid, tree);
+        }
+    }
+    double rewritten69 = 0;
+    formulas69[0].sample("x", 1000, 1000, 1, &rewritten69, {}, {}, true);
+    if (sample_ok && rewritten69 == 1000){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // exp(a) ^ b = exp(a * b) only holds for real numbers
+    std::cout << "Test 62: ";
+    using Complex = std::complex<long double>;
+    Expressions::Expression<Complex> expr70("exp(x) ^ y");
+    Expressions::Expression<Complex> saturated70 = Expressions::saturate(expr70);
+    Complex point70 = Complex(0, 2 * std::acos(-1.0L));
+    Complex expected70 = expr70.eval_and_resolve({"x", "y"}, {point70, 0.5L});
+    Complex value70 = saturated70.eval_and_resolve({"x", "y"}, {point70, 0.5L});
+    if (std::abs(value70 - expected70) < 1e-15 && std::abs(expected70 - Complex(1)) < 1e-15){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // unary plus binds like unary minus
+    std::cout << "Test 63: ";
+    bool unary_plus_ok = false;
+    try {
+        Expressions::Expression<double> plus71("+3");
+        unary_plus_ok = plus71.root()->kind() == Expressions::NodeKind::Number && plus71.resolve() == 3 &&
+                        Expressions::Expression<double>("2 * +3").resolve() == 6 &&
+                        Expressions::Expression<double>("x + +1").eval_and_resolve({"x"}, {2}) == 3 &&
+                        Expressions::Expression<double>("+x ^ 2").eval_and_resolve({"x"}, {-3}) == 9 &&
+                        Expressions::Expression<double>("-+2").resolve() == -2;
+    } catch (const std::exception&) {}
+    if (unary_plus_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // printing builds no nodes, so it doesn't count against a budget
+    std::cout << "Test 64: ";
+    Expressions::Expression<double> expr72("x ^ 0.5 + 2 * sin(x)");
+    Expressions::FlatExpression<double> flat72 = Expressions::FlatExpression<double>(expr72).optimize();
+    Expressions::Expression<double> poly72 = Expressions::polynomial_form(Expressions::Expression<double>("(x + 2) ^ 2"));
+    std::string flat_text72 = flat72.to_string();
+    std::string poly_text72 = poly72.to_string();
+    Expressions::ResourceBudget budget72;
+    budget72.max_nodes = 0;
+    bool printing_ok = true;
+    try {
+        Expressions::BudgetScope scope(budget72);
+        printing_ok = flat72.to_string() == flat_text72 && poly72.to_string() == poly_text72 && expr72.to_string().size() > 0;
+    } catch (const std::exception&) {
+        printing_ok = false;
+    }
+    if (printing_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // the depth of left associative chains is checked by every parser entry point
+    std::cout << "Test 65: ";
+    std::string chain73 = "x";
+    for (size_t i = 0; i < 100; i++){ chain73 += " + x"; }
+    Expressions::ResourceBudget budget73;
+    budget73.max_depth = 50;
+    bool chain_ok = true;
+    {
+        Expressions::BudgetScope scope(budget73);
+        try {
+            Expressions::parse_statements<double>(chain73, [](size_t, Expressions::Expression<double>){});
+            chain_ok = false;
+        } catch (const Expressions::BudgetExceeded&) {}
+        std::vector<std::string_view> many73{chain73};
+        auto parsed73 = Expressions::parse_many<double>(many73, 1);
+        chain_ok = chain_ok && !parsed73[0].ok() && parsed73[0].error.find("depth budget") != std::string::npos;
+    }
+    if (chain_ok){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
+    // a budget covers parallel work too, whatever the number of threads
+    std::cout << "Test 66: ";
+    std::vector<std::string_view> many74(8, "x + 1");
+    Expressions::ResourceBudget budget74;
+    budget74.max_nodes = 5;
+    std::vector<bool> parsed74[2];
+    size_t threads74[2] = {1, 4};
+    for (size_t k = 0; k < 2; k++){
+        Expressions::BudgetScope scope(budget74);
+        for (const auto& result : Expressions::parse_many<double>(many74, threads74[k])){ parsed74[k].push_back(result.ok()); }
+    }
+    if (parsed74[0] == parsed74[1] && parsed74[0][0] && std::count(parsed74[0].begin(), parsed74[0].end(), true) == 1){
+        std::cout << "OK\n";
+    } else { std::cout << "FAIL\n"; }
 }
 
 int main(){
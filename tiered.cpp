@@ -0,0 +1,154 @@
+#include <string>
+#include <vector>
+#include <chrono>
+#include <complex>
+#include <stdexcept>
+#include "tiered.hpp"
+
+namespace Expressions {
+
+template <typename T>
+TieredEvaluator<T>::Entry::Entry(const Expression<T>& expression) : expression(expression) {}
+
+template <typename T>
+TieredEvaluator<T>::TieredEvaluator(TierThresholds thresholds) : thresholds_(thresholds) {
+    worker_ = std::thread(&TieredEvaluator<T>::work, this);
+}
+
+template <typename T>
+TieredEvaluator<T>::~TieredEvaluator(){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        queued_.notify_all();
+    }
+    worker_.join();
+}
+
+template <typename T>
+size_t TieredEvaluator<T>::add(const Expression<T>& expression){
+    entries_.emplace_back(expression);
+    return entries_.size() - 1;
+}
+
+template <typename T>
+size_t TieredEvaluator<T>::size() const { return entries_.size(); }
+
+template <typename T>
+T TieredEvaluator<T>::eval_and_resolve(size_t id, const std::vector<std::string>& variables, const std::vector<T>& values){
+    Entry& entry = entries_.at(id);
+    // only the call reaching a threshold queues the promotion
+    uint64_t calls = entry.calls.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (calls == thresholds_.flat_calls || calls == thresholds_.optimized_calls){ queue(entry); }
+
+    // the acquire makes the representation built before the tier was published visible
+    switch (entry.tier.load(std::memory_order_acquire)){
+        case EvaluationTier::Optimized: return entry.optimized->eval_and_resolve(variables, values);
+        case EvaluationTier::Flat:      return entry.flat->eval_and_resolve(variables, values);
+        default:                        return entry.expression.eval_and_resolve(variables, values);
+    }
+}
+
+template <typename T>
+TierStats TieredEvaluator<T>::stats(size_t id){
+    Entry& entry = entries_.at(id);
+    std::lock_guard<std::mutex> lock(mutex_);
+    TierStats res;
+    res.tier = entry.tier.load(std::memory_order_acquire);
+    res.calls = entry.calls.load(std::memory_order_relaxed);
+    res.pending = entry.pending;
+    res.failed = entry.failed;
+    res.promotion_ms = entry.promotion_ms;
+
+    // every tier answered the calls from its promotion to the next one
+    size_t top = static_cast<size_t>(res.tier);
+    for (size_t tier = 0; tier <= top; tier++){
+        uint64_t end = tier == top ? res.calls : entry.promoted_at[tier + 1];
+        res.tier_calls[tier] = end - entry.promoted_at[tier];
+    }
+    return res;
+}
+
+template <typename T>
+void TieredEvaluator<T>::wait_idle(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [&]{ return queue_.empty() && !busy_; });
+}
+
+template <typename T>
+void TieredEvaluator<T>::queue(Entry& entry){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entry.pending || entry.failed){ return; }
+    entry.pending = true;
+    queue_.push_back(&entry);
+    queued_.notify_one();
+}
+
+// builds the tier the calls so far ask for, skipping the flat tier if the optimized one is due
+template <typename T>
+void TieredEvaluator<T>::promote(Entry& entry){
+    uint64_t calls = entry.calls.load(std::memory_order_relaxed);
+    EvaluationTier tier = entry.tier.load(std::memory_order_relaxed);
+    EvaluationTier target = thresholds_.optimized_calls > 0 && calls >= thresholds_.optimized_calls ?
+                            EvaluationTier::Optimized : EvaluationTier::Flat;
+    if (tier >= target){ return; }
+
+    auto begin = std::chrono::steady_clock::now();
+    if (target == EvaluationTier::Optimized && thresholds_.allow_rewrites){
+        Expression<T> saturated = saturate(entry.expression, CostModel{}, thresholds_.saturation);
+        entry.optimized = std::make_unique<FlatExpression<T>>(FlatExpression<T>(saturated).optimize());
+    } else if (target == EvaluationTier::Optimized){
+        // the pairing keeps the values bit for bit, see FlatExpression<T>::pair_sincos()
+        entry.optimized = std::make_unique<FlatExpression<T>>(entry.expression);
+        entry.optimized->pair_sincos();
+    } else {
+        entry.flat = std::make_unique<FlatExpression<T>>(entry.expression);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry.promotion_ms += ms;
+    for (size_t i = static_cast<size_t>(tier) + 1; i <= static_cast<size_t>(target); i++){
+        entry.promoted_at[i] = entry.calls.load(std::memory_order_relaxed);
+    }
+    entry.tier.store(target, std::memory_order_release);
+}
+
+template <typename T>
+void TieredEvaluator<T>::work(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true){
+        queued_.wait(lock, [&]{ return stopping_ || !queue_.empty(); });
+        if (stopping_){ return; }
+
+        Entry* entry = queue_.front();
+        queue_.pop_front();
+        busy_ = true;
+        lock.unlock();
+        bool failed = false;
+        try {
+            promote(*entry);
+        } catch (const std::exception&){
+            failed = true;
+        }
+        lock.lock();
+
+        busy_ = false;
+        entry->pending = false;
+        entry->failed = failed;
+        // the optimized threshold may have been reached while the flat tier was built
+        if (!failed && thresholds_.optimized_calls > 0 && entry->tier.load() < EvaluationTier::Optimized &&
+            entry->calls.load(std::memory_order_relaxed) >= thresholds_.optimized_calls){
+            entry->pending = true;
+            queue_.push_back(entry);
+        }
+        if (queue_.empty()){ idle_.notify_all(); }
+    }
+}
+
+template class TieredEvaluator<float>;
+template class TieredEvaluator<double>;
+template class TieredEvaluator<long double>;
+template class TieredEvaluator<std::complex<long double>>;
+
+} // namespace Expressions
@@ -0,0 +1,117 @@
+#ifndef HEADER_GUARD_TIERED_HPP_INCLUDED
+#define HEADER_GUARD_TIERED_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <memory>
+#include "expression.hpp"
+#include "flat.hpp"
+#include "egraph.hpp"
+
+namespace Expressions {
+
+// evaluation strategies of TieredEvaluator, from the cheapest to build to the fastest to evaluate
+enum class EvaluationTier : uint8_t
+{
+    Tree = 0,       // Expression<T>::eval_and_resolve
+    Flat = 1,       // FlatExpression<T> of the expression
+    Optimized = 2,  // FlatExpression<T> computing sin and cos of one argument together, see TierThresholds
+};
+
+// number of calls after which an expression is promoted, 0 never promotes to that tier
+struct TierThresholds
+{
+    uint64_t flat_calls = 16;
+    uint64_t optimized_calls = 4096;
+    // the optimized tier also saturates the expression (see EGraph<T>) and strength reduces it
+    // (see FlatExpression<T>::optimize()), its results may then differ in the last bits and where
+    // the expression is undefined; without, every tier returns the same values
+    bool allow_rewrites = false;
+    // bounds of that saturation
+    SaturationLimits saturation{};
+};
+
+struct TierStats
+{
+    EvaluationTier tier = EvaluationTier::Tree;
+    uint64_t calls = 0;
+    // calls answered by every tier, approximate while other threads evaluate
+    uint64_t tier_calls[3] = {0, 0, 0};
+    // a promotion is queued or being built
+    bool pending = false;
+    // building a tier threw, the expression stays where it is
+    bool failed = false;
+    // time the background thread spent building the tiers
+    double promotion_ms = 0;
+};
+
+// evaluates many expressions, starting every one with the tree evaluation and promoting it
+// to a faster representation once it was called often enough
+// promotions are built on a background thread and published when ready, callers never wait for them;
+// promoting doesn't change results unless TierThresholds::allow_rewrites is set
+// eval_and_resolve() and stats() may be called from many threads, add() not while other threads evaluate
+template <typename T>
+class TieredEvaluator
+{
+private:
+    struct Entry
+    {
+        Expression<T> expression;
+        // built by the background thread before their tier is published, never replaced
+        std::unique_ptr<FlatExpression<T>> flat;
+        std::unique_ptr<FlatExpression<T>> optimized;
+        std::atomic<EvaluationTier> tier{EvaluationTier::Tree};
+        std::atomic<uint64_t> calls{0};
+
+        // guarded by mutex_
+        uint64_t promoted_at[3] = {0, 0, 0};
+        bool pending = false;
+        bool failed = false;
+        double promotion_ms = 0;
+
+        explicit Entry(const Expression<T>& expression);
+    };
+
+    TierThresholds thresholds_;
+    std::deque<Entry> entries_;
+
+    std::mutex mutex_;
+    std::condition_variable queued_;    // signals the background thread
+    std::condition_variable idle_;      // signals wait_idle()
+    std::deque<Entry*> queue_;
+    bool busy_ = false;
+    bool stopping_ = false;
+    std::thread worker_;
+
+    void queue(Entry& entry);
+    void promote(Entry& entry);
+    void work();
+
+public:
+    explicit TieredEvaluator(TierThresholds thresholds = {});
+    TieredEvaluator(const TieredEvaluator&) = delete;
+    TieredEvaluator& operator = (const TieredEvaluator&) = delete;
+    // queued promotions are dropped
+    ~TieredEvaluator();
+
+    // returns the id of the expression
+    size_t add(const Expression<T>& expression);
+    size_t size() const;
+
+    // value of expression id, variables not given are 0 like in Expression<T>::eval_and_resolve
+    // throws std::out_of_range for an unknown id
+    T eval_and_resolve(size_t id, const std::vector<std::string>& variables, const std::vector<T>& values);
+
+    TierStats stats(size_t id);
+    // blocks until every queued promotion is published
+    void wait_idle();
+};
+} // namespace Expressions
+
+#endif // HEADER_GUARD_TIERED_HPP_INCLUDED